@@ -5,13 +5,21 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
-#include <QStandardItem>
+#include <QtConcurrent>
+#include <QScrollBar>
 #include <QDebug>
 
 namespace {
 const QString DEFAULT_SERVER_IP   = "127.0.0.1";
 const quint16 DEFAULT_SERVER_PORT = 4545;
 const int     CONNECTION_TIMEOUT  = 5000;
+const int     PAGE_SIZE           = 500;
+const int     FILTER_DELAY_MS     = 150;
+const int     CANCEL_CHECK_ROWS   = 4096;
+const int     THUMBNAIL_SIZE      = 48;
+const int     MIN_RETRY_MS        = 50;
+
+enum Column { ColId, ColTitle, ColCategory, ColPrice, ColStatus, ColUpdatedAt, ColHasImage };
 }
 
 AdsBrowserWindow::AdsBrowserWindow(QWidget *parent)
@@ -21,7 +29,19 @@ AdsBrowserWindow::AdsBrowserWindow(QWidget *parent)
     , connectionTimer(new QTimer(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
-    , model(new QStandardItemModel(this))
+    , reader(new JsonLineReader(this))
+    , model(new CompactTableModel(this))
+    , requestedAfterId(0)
+    , lastLoadedId(0)
+    , pageRows(0)
+    , pageInFlight(false)
+    , retryTimer(new QTimer(this))
+    , cache("ads-approved")
+    , deltaRequested(false)
+    , thumbnails(new ThumbnailLoader(cache, THUMBNAIL_SIZE, this))
+    , filterActive(false)
+    , filterTimer(new QTimer(this))
+    , filterGeneration(new QAtomicInt(0))
 {
     ui->setupUi(this);
     setWindowTitle("KalaNet - Browse Ads");
@@ -35,6 +55,22 @@ AdsBrowserWindow::AdsBrowserWindow(QWidget *parent)
     connect(socket, &QTcpSocket::readyRead,    this, &AdsBrowserWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &AdsBrowserWindow::onSocketError);
 
+    // Listings are streamed: rows show up while the response downloads.
+    reader->streamArray("ads");
+    connect(reader, &JsonLineReader::messageReceived, this, &AdsBrowserWindow::onMessage);
+    connect(reader, &JsonLineReader::arrayStarted,    this, &AdsBrowserWindow::onAdsStarted);
+    connect(reader, &JsonLineReader::rowReceived,     this, &AdsBrowserWindow::onAdRow);
+    connect(model,  &CompactTableModel::fetchMoreRequested, this, &AdsBrowserWindow::onFetchMore);
+
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(FILTER_DELAY_MS);
+    connect(filterTimer, &QTimer::timeout, this, &AdsBrowserWindow::applyFilters);
+    connect(&filterWatcher, &QFutureWatcher<FilterResult>::finished,
+            this, &AdsBrowserWindow::onFilterFinished);
+
+    retryTimer->setSingleShot(true);
+    connect(retryTimer, &QTimer::timeout, this, [this]() { requestPage(requestedAfterId); });
+
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
         socket->abort();
@@ -49,11 +85,14 @@ AdsBrowserWindow::AdsBrowserWindow(QWidget *parent)
     ui->maxPriceSpinBox->setMinimum(0);
     ui->maxPriceSpinBox->setMaximum(1e9);
 
+    if (cache.load())
+        showCachedListing();
     requestAdsList();
 }
 
 AdsBrowserWindow::~AdsBrowserWindow()
 {
+    cancelFilter();
     delete ui;
 }
 
@@ -61,6 +100,7 @@ void AdsBrowserWindow::setServerAddress(const QString &ip, quint16 port)
 {
     serverIp   = ip;
     serverPort = port;
+    thumbnails->setServerAddress(ip, port);
 }
 
 void AdsBrowserWindow::setCurrentUser(const QString &username)
@@ -99,100 +139,223 @@ void AdsBrowserWindow::setupUiDesign()
 
 void AdsBrowserWindow::setupModel()
 {
-    model->setColumnCount(5);
-    model->setHeaderData(0, Qt::Horizontal, "ID");
-    model->setHeaderData(1, Qt::Horizontal, "Title");
-    model->setHeaderData(2, Qt::Horizontal, "Category");
-    model->setHeaderData(3, Qt::Horizontal, "Price");
-    model->setHeaderData(4, Qt::Horizontal, "Status");
+    model->addColumn("id",       "ID",       CompactTableModel::ColumnType::Int);
+    model->addColumn("title",    "Title",    CompactTableModel::ColumnType::String);
+    model->addColumn("category", "Category", CompactTableModel::ColumnType::Label);
+    model->addColumn("price",    "Price",    CompactTableModel::ColumnType::Double);
+    model->addColumn("status",   "Status",   CompactTableModel::ColumnType::Label);
+    model->addColumn("updated_at", "Updated", CompactTableModel::ColumnType::String);
+    model->addColumn("has_image",  "Image",   CompactTableModel::ColumnType::Int);
+
+    model->setDecoration(ColTitle, [this](int row) -> QVariant {
+        if (!model->intAt(row, ColHasImage))
+            return QVariant();
+        QPixmap pixmap = thumbnails->thumbnail(int(model->intAt(row, ColId)),
+                                               model->stringAt(row, ColUpdatedAt));
+        return pixmap.isNull() ? QVariant() : QVariant(pixmap);
+    });
 
     ui->adsTableView->setModel(model);
+    ui->adsTableView->setColumnHidden(ColUpdatedAt, true);
+    ui->adsTableView->setColumnHidden(ColHasImage, true);
+    ui->adsTableView->setIconSize(QSize(THUMBNAIL_SIZE, THUMBNAIL_SIZE));
+    ui->adsTableView->verticalHeader()->setDefaultSectionSize(THUMBNAIL_SIZE + 8);
     ui->adsTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui->adsTableView->setSelectionMode(QAbstractItemView::SingleSelection);
     ui->adsTableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->adsTableView->horizontalHeader()->setStretchLastSection(true);
+
+    // A finished thumbnail only needs a repaint; the view coalesces them.
+    connect(thumbnails, &ThumbnailLoader::thumbnailReady,
+            ui->adsTableView->viewport(), [this]() { ui->adsTableView->viewport()->update(); });
+    connect(ui->adsTableView->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &AdsBrowserWindow::updateVisibleThumbnails);
+    connect(model, &QAbstractItemModel::modelReset,
+            this, &AdsBrowserWindow::updateVisibleThumbnails);
+}
+
+// Queued thumbnail loads for rows no longer on screen are dropped; the
+// rows now shown ask for theirs when they are painted.
+void AdsBrowserWindow::updateVisibleThumbnails()
+{
+    QTableView *view = ui->adsTableView;
+    int first = view->rowAt(0);
+    int last  = view->rowAt(view->viewport()->height() - 1);
+    if (first < 0)
+        first = 0;
+    if (last < 0)
+        last = model->rowCount() - 1;
+
+    QSet<int> ids;
+    for (int r = first; r <= last; ++r) {
+        int row = model->sourceRow(r);
+        if (row >= 0)
+            ids.insert(int(model->intAt(row, ColId)));
+    }
+    thumbnails->retainOnly(ids);
 }
 
 void AdsBrowserWindow::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
 
 void AdsBrowserWindow::requestAdsList()
 {
-    connectToServer();
+    retryTimer->stop();
+    if (cache.isValid())
+        requestDelta();
+    else
+        requestPage(0);
 }
 
-void AdsBrowserWindow::populateTable(const QList<AdItem> &ads)
+void AdsBrowserWindow::requestDelta()
 {
-    model->removeRows(0, model->rowCount());
+    deltaRequested = true;
+    requestPage(0);
+}
 
-    int row = 0;
-    for (const auto &ad : ads) {
-        model->insertRow(row);
-        model->setData(model->index(row, 0), ad.id);
-        model->setData(model->index(row, 1), ad.title);
-        model->setData(model->index(row, 2), ad.category);
-        model->setData(model->index(row, 3), ad.price);
-        model->setData(model->index(row, 4), ad.status);
-        ++row;
-    }
+// The first page (afterId 0) replaces the listing; later pages append.
+void AdsBrowserWindow::requestPage(int afterId)
+{
+    requestedAfterId = afterId;
+    pageRows = 0;
+    pageInFlight = true;
+    if (socket->state() == QAbstractSocket::ConnectedState)
+        sendAdsRequest();
+    else
+        connectToServer();
+}
+
+AdsBrowserWindow::Filter AdsBrowserWindow::currentFilter() const
+{
+    Filter f;
+    f.search   = normalizeForSearch(ui->searchLineEdit->text().trimmed());
+    f.category = ui->categoryFilterComboBox->currentText();
+    f.minPrice = ui->minPriceSpinBox->value();
+    f.maxPrice = ui->maxPriceSpinBox->value();
+    if (f.maxPrice <= 0) f.maxPrice = 1e12;
+    return f;
 }
 
-QList<AdsBrowserWindow::AdItem> AdsBrowserWindow::filteredAds() const
+bool AdsBrowserWindow::isFilterActive(const Filter &f) const
 {
-    QList<AdItem> result;
+    return !f.search.isEmpty() || (!f.category.isEmpty() && f.category != "All")
+           || f.minPrice > 0 || f.maxPrice < 1e12;
+}
 
-    QString searchText = ui->searchLineEdit->text().trimmed().toLower();
-    QString category   = ui->categoryFilterComboBox->currentText();
-    double minPrice    = ui->minPriceSpinBox->value();
-    double maxPrice    = ui->maxPriceSpinBox->value();
-    if (maxPrice <= 0) maxPrice = 1e12;
+// Compatibility decomposition with combining marks dropped, then case
+// folded, so "Café", "CAFE" and "cafe" all match each other.
+QString AdsBrowserWindow::normalizeForSearch(const QString &text)
+{
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString out;
+    out.reserve(decomposed.size());
+    for (const QChar c : decomposed)
+        if (c.category() != QChar::Mark_NonSpacing)
+            out.append(c);
+    return out.toCaseFolded();
+}
 
-    for (const auto &ad : allAds) {
-        if (!searchText.isEmpty() &&
-            !ad.title.toLower().contains(searchText)) {
-            continue;
-        }
+bool AdsBrowserWindow::matches(const Filter &f, const SearchIndex &index, int row)
+{
+    if (!f.search.isEmpty() && !index.titles[row].contains(f.search))
+        return false;
 
-        if (category != "All" && ad.category != category)
-            continue;
+    if (f.category != "All" && index.categories[row] != f.category)
+        return false;
 
-        if (ad.price < minPrice || ad.price > maxPrice)
-            continue;
+    double price = index.prices[row];
+    if (price < f.minPrice || price > f.maxPrice)
+        return false;
 
-        result.append(ad);
-    }
+    return true;
+}
 
+AdsBrowserWindow::FilterResult AdsBrowserWindow::runFilter(const Filter &f, const SearchIndex &index,
+                                                           int generation, QSharedPointer<QAtomicInt> latest)
+{
+    FilterResult result;
+    result.generation = generation;
+    result.scanned    = index.titles.size();
+
+    for (int row = 0; row < result.scanned; ++row) {
+        if (row % CANCEL_CHECK_ROWS == 0 && latest->loadAcquire() != generation) {
+            result.cancelled = true;
+            result.rows.clear();
+            return result;
+        }
+        if (matches(f, index, row))
+            result.rows.append(row);
+    }
     return result;
 }
 
+void AdsBrowserWindow::scheduleFilter()
+{
+    filterTimer->start();
+}
+
+void AdsBrowserWindow::cancelFilter()
+{
+    filterGeneration->fetchAndAddOrdered(1);
+}
+
 void AdsBrowserWindow::applyFilters()
 {
-    populateTable(filteredAds());
+    const int generation = filterGeneration->fetchAndAddOrdered(1) + 1;
+
+    Filter f = currentFilter();
+    filterActive = isFilterActive(f);
+    activeFilter = f;
+    if (!filterActive) {
+        model->clearFilter();
+        return;
+    }
+
+    SearchIndex snapshot = searchIndex;
+    QSharedPointer<QAtomicInt> latest = filterGeneration;
+    filterWatcher.setFuture(QtConcurrent::run([f, snapshot, generation, latest]() {
+        return runFilter(f, snapshot, generation, latest);
+    }));
+}
+
+void AdsBrowserWindow::onFilterFinished()
+{
+    FilterResult result = filterWatcher.result();
+    if (result.cancelled || result.generation != filterGeneration->loadAcquire())
+        return;
+
+    // Rows that streamed in while the worker ran were not in its snapshot.
+    QVector<int> rows = result.rows;
+    for (int row = result.scanned; row < searchIndex.titles.size(); ++row)
+        if (matches(activeFilter, searchIndex, row))
+            rows.append(row);
+    model->setVisibleRows(rows);
 }
 
 
 void AdsBrowserWindow::on_searchLineEdit_textChanged(const QString &)
 {
-    applyFilters();
+    scheduleFilter();
 }
 
 void AdsBrowserWindow::on_categoryFilterComboBox_currentIndexChanged(int)
 {
-    applyFilters();
+    scheduleFilter();
 }
 
 void AdsBrowserWindow::on_minPriceSpinBox_valueChanged(double)
 {
-    applyFilters();
+    scheduleFilter();
 }
 
 void AdsBrowserWindow::on_maxPriceSpinBox_valueChanged(double)
 {
-    applyFilters();
+    scheduleFilter();
 }
 
 void AdsBrowserWindow::on_refreshButton_clicked()
@@ -208,8 +371,8 @@ void AdsBrowserWindow::on_addToCartButton_clicked()
         return;
     }
 
-    int row = idx.row();
-    int adId = model->data(model->index(row, 0)).toInt();
+    int row = model->sourceRow(idx.row());
+    int adId = int(model->intAt(row, ColId));
 
     emit addToCartRequested(adId);
     QMessageBox::information(this, "Cart", "Ad added to cart (client-side signal).");
@@ -218,10 +381,22 @@ void AdsBrowserWindow::on_addToCartButton_clicked()
 
 
 void AdsBrowserWindow::onConnected()
+{
+    connectionTimer->stop();
+    sendAdsRequest();
+}
+
+void AdsBrowserWindow::sendAdsRequest()
 {
     QJsonObject obj;
     obj["type"] = "get_ads";
     obj["status"] = "Approved";
+    obj["after_id"] = requestedAfterId;
+    obj["limit"] = PAGE_SIZE;
+    if (deltaRequested) {
+        obj["since_version"] = cache.version();
+        obj["catalog_epoch"] = cache.epoch();
+    }
 
     QJsonDocument doc(obj);
     QByteArray data = doc.toJson(QJsonDocument::Compact);
@@ -238,44 +413,148 @@ void AdsBrowserWindow::onDisconnected()
 
 void AdsBrowserWindow::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
+    reader->feed(socket->readAll());
+}
 
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
+void AdsBrowserWindow::onAdsStarted(const QString &)
+{
+    // Delta rows are held back until the reply says what they are.
+    if (deltaRequested) {
+        deltaRows.clear();
+        return;
+    }
+    if (requestedAfterId != 0)
+        return;
 
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
+    // A scan still running refers to the rows being dropped.
+    cancelFilter();
+    model->clear();
+    searchIndex = SearchIndex();
+    cache.clear();
+    lastLoadedId = 0;
+    if (filterActive)
+        model->setVisibleRows(QVector<int>());
+}
 
-        QJsonObject obj = doc.object();
-        QString type = obj["type"].toString();
+void AdsBrowserWindow::onAdRow(const QString &, const QJsonObject &a)
+{
+    if (deltaRequested) {
+        deltaRows.append(a);
+        return;
+    }
 
-        if (type == "get_ads_response") {
-            allAds.clear();
+    int row = model->appendRow(a);
+    indexRow(row);
+    cache.addRow(a);
+    lastLoadedId = a["id"].toInt();
+    pageRows++;
 
-            QJsonArray arr = obj["ads"].toArray();
-            for (const auto &v : arr) {
-                if (!v.isObject()) continue;
-                QJsonObject a = v.toObject();
+    if (filterActive && model->isFiltered() && matches(activeFilter, searchIndex, row))
+        model->showRow(row);
+}
 
-                AdItem item;
-                item.id       = a["id"].toInt();
-                item.title    = a["title"].toString();
-                item.category = a["category"].toString();
-                item.price    = a["price"].toDouble();
-                item.status   = a["status"].toString();
-                item.thumbnailBase64 = a["thumbnail_base64"].toString();
+void AdsBrowserWindow::indexRow(int row)
+{
+    searchIndex.titles.append(normalizeForSearch(model->stringAt(row, ColTitle)));
+    searchIndex.categories.append(model->stringAt(row, ColCategory));
+    searchIndex.prices.append(model->doubleAt(row, ColPrice));
+}
 
-                allAds.append(item);
-            }
+void AdsBrowserWindow::onFetchMore(int)
+{
+    if (!pageInFlight)
+        requestPage(lastLoadedId);
+}
 
-            applyFilters();
+void AdsBrowserWindow::onMessage(const QJsonObject &obj)
+{
+    QString type = obj["type"].toString();
+
+    if (type == "get_ads_response") {
+        handleAdsResponse(obj);
+    } else if (type == "error") {
+        // The same page again, keeping the download (and deltaRequested)
+        // where it was.
+        if (pageInFlight && obj["code"].toString() == "rate_limited") {
+            retryTimer->start(qMax(MIN_RETRY_MS, obj["retry_after_ms"].toInt()));
+            return;
+        }
+        pageInFlight = false;
+        deltaRequested = false;
+        deltaRows.clear();
+    }
+}
+
+void AdsBrowserWindow::handleAdsResponse(const QJsonObject &obj)
+{
+    pageInFlight = false;
+    const QString epoch = obj["catalog_epoch"].toString();
+    const qint64 version = qint64(obj["catalog_version"].toDouble());
+    const int total = obj["total"].toInt();
+
+    if (deltaRequested) {
+        deltaRequested = false;
+        const QJsonArray removed = obj["removed"].toArray();
+        if (obj["delta"].toBool()) {
+            cache.applyDelta(deltaRows, removed, version);
+            cache.save();
+            if (!deltaRows.isEmpty() || !removed.isEmpty())
+                showCachedListing();
+            deltaRows.clear();
+            return;
         }
+
+        // The server's catalog started over; this is the first full page.
+        cancelFilter();
+        model->clear();
+        searchIndex = SearchIndex();
+        cache.clear();
+        lastLoadedId = 0;
+        for (const auto &row : deltaRows) {
+            indexRow(model->appendRow(row));
+            cache.addRow(row);
+            lastLoadedId = row["id"].toInt();
+        }
+        pageRows = deltaRows.size();
+        deltaRows.clear();
+        if (filterActive)
+            applyFilters();
     }
+
+    // The first page pins the version the download belongs to. An ad
+    // that changes while later pages load is newer than that version, so
+    // the delta asked for at the end brings it (or its removal) in.
+    if (obj["after_id"].toInt() == 0)
+        cache.setCatalogVersion(epoch, version);
+    model->setTotalRows(qMax(total, model->loadedRows()));
+
+    // The whole listing is fetched, not just what the view scrolls to:
+    // only a complete download can be kept as the on-disk cache.
+    if (pageRows == PAGE_SIZE) {
+        requestPage(lastLoadedId);
+        return;
+    }
+
+    model->setTotalRows(model->loadedRows());
+    cache.markComplete();
+    cache.save();
+    if (version != cache.version())
+        requestDelta();
+}
+
+void AdsBrowserWindow::showCachedListing()
+{
+    cancelFilter();
+    model->clear();
+    searchIndex = SearchIndex();
+
+    int first = model->appendRows(cache.rows());
+    for (int row = first; row < model->loadedRows(); ++row)
+        indexRow(row);
+    model->setTotalRows(model->loadedRows());
+
+    if (filterActive)
+        applyFilters();
 }
 
 void AdsBrowserWindow::onSocketError(QAbstractSocket::SocketError)
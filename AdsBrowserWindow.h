@@ -4,7 +4,13 @@
 #include <QMainWindow>
 #include <QTcpSocket>
 #include <QTimer>
-#include <QStandardItemModel>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include "jsonlinereader.h"
+#include "compacttablemodel.h"
+#include "adcatalogcache.h"
+#include "thumbnailloader.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class AdsBrowserWindow; }
@@ -39,6 +45,15 @@ private slots:
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
 
+    void onMessage(const QJsonObject &obj);
+    void onAdsStarted(const QString &key);
+    void onAdRow(const QString &key, const QJsonObject &row);
+    void onFetchMore(int loadedRows);
+    void updateVisibleThumbnails();
+
+    void applyFilters();
+    void onFilterFinished();
+
 private:
     Ui::AdsBrowserWindow *ui;
 
@@ -49,27 +64,83 @@ private:
     QString     serverIp;
     quint16     serverPort;
 
-    QStandardItemModel *model;
+    JsonLineReader *reader;
+
+    // Loaded rows live in the model; filters pick a subset of them. Pages
+    // are asked for by the last id loaded (after_id), so ads changing
+    // status mid-download cannot shift rows across a page boundary.
+    CompactTableModel *model;
+    int requestedAfterId;
+    int lastLoadedId;
+    int pageRows;
+    bool pageInFlight;
+    // Pages go out back to back and can run into the server's get_ads
+    // budget; a refused page is asked for again after retry_after_ms.
+    QTimer *retryTimer;
+
+    // The approved listing is shown from the on-disk cache at once and then
+    // brought up to date with a get_ads delta. Without a valid cache every
+    // page is fetched in turn until the cache holds the whole listing.
+    AdCatalogCache cache;
+    bool deltaRequested;
+    QList<QJsonObject> deltaRows;
+
+    // Thumbnails are asked for as the view paints title cells.
+    ThumbnailLoader *thumbnails;
+
+    struct Filter {
+        QString search;         // normalized, see normalizeForSearch()
+        QString category;       // "All" matches every category
+        double  minPrice;
+        double  maxPrice;
+    };
+
+    // The columns a filter reads, one entry per loaded row. Titles are
+    // stored normalized so a query is a plain substring scan. Copies are
+    // implicitly shared, so a worker can scan a snapshot of it.
+    struct SearchIndex {
+        QVector<QString> titles;
+        QVector<QString> categories;
+        QVector<double>  prices;
+    };
 
-    struct AdItem {
-        int     id;
-        QString title;
-        QString category;
-        double  price;
-        QString status;
-        QString thumbnailBase64;
+    struct FilterResult {
+        int  generation = 0;
+        int  scanned    = 0;    // rows in the snapshot
+        bool cancelled  = false;
+        QVector<int> rows;
     };
 
-    QList<AdItem> allAds;
+    // Edits restart filterTimer; when it fires the scan runs on a worker.
+    // Each scan gets a new generation, and a scan whose generation is no
+    // longer the latest stops early and its result is dropped.
+    SearchIndex searchIndex;
+    Filter      activeFilter;
+    bool        filterActive;
+    QTimer     *filterTimer;
+    QFutureWatcher<FilterResult> filterWatcher;
+    QSharedPointer<QAtomicInt>   filterGeneration;
 
     void setupUiDesign();
     void setupModel();
     void connectToServer();
     void requestAdsList();
-    void applyFilters();
-    void populateTable(const QList<AdItem> &ads);
-
-    QList<AdItem> filteredAds() const;
+    void requestPage(int afterId);
+    void sendAdsRequest();
+    void requestDelta();
+    void handleAdsResponse(const QJsonObject &obj);
+    void showCachedListing();
+    void indexRow(int row);
+    void scheduleFilter();
+    void cancelFilter();
+
+    Filter currentFilter() const;
+    bool isFilterActive(const Filter &filter) const;
+
+    static QString normalizeForSearch(const QString &text);
+    static bool matches(const Filter &filter, const SearchIndex &index, int row);
+    static FilterResult runFilter(const Filter &filter, const SearchIndex &index,
+                                  int generation, QSharedPointer<QAtomicInt> latest);
 };
 
 #endif // ADSBROWSERWINDOW_H
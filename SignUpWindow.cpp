@@ -22,6 +22,7 @@ SignUpWindow::SignUpWindow(QWidget *parent)
     , ui(new Ui::SignUpWindow)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
 {
@@ -47,6 +48,7 @@ SignUpWindow::SignUpWindow(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &SignUpWindow::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &SignUpWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &SignUpWindow::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &SignUpWindow::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -138,6 +140,7 @@ void SignUpWindow::showInfoMessage(const QString &title, const QString &message)
 void SignUpWindow::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT_MS);
 }
@@ -234,33 +237,23 @@ void SignUpWindow::onDisconnected()
 
 void SignUpWindow::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (QByteArray msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
-
-        QJsonObject obj = doc.object();
-        QString type = obj["type"].toString();
-
-        if (type == "signup_response") {
-            bool success = obj["success"].toBool();
-            QString message = obj["message"].toString();
-
-            if (success) {
-                showInfoMessage("Success", message.isEmpty() ? "Sign up successful!" : message);
-                emit signupSuccessful(ui->usernameLineEdit->text().trimmed());
-                close();
-            } else {
-                showValidationError("Sign up failed", message.isEmpty() ? "Username or email already exists." : message);
-            }
+    reader->feed(socket->readAll());
+}
+
+void SignUpWindow::onMessage(const QJsonObject &obj)
+{
+    QString type = obj["type"].toString();
+
+    if (type == "signup_response") {
+        bool success = obj["success"].toBool();
+        QString message = obj["message"].toString();
+
+        if (success) {
+            showInfoMessage("Success", message.isEmpty() ? "Sign up successful!" : message);
+            emit signupSuccessful(ui->usernameLineEdit->text().trimmed());
+            close();
+        } else {
+            showValidationError("Sign up failed", message.isEmpty() ? "Username or email already exists." : message);
         }
     }
 }
@@ -5,6 +5,7 @@
 #include <QTcpSocket>
 #include <QTimer>
 #include <QMap>
+#include "jsonlinereader.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class SignUpWindow; }
@@ -35,6 +36,7 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
 
 private:
     Ui::SignUpWindow *ui;
@@ -42,6 +44,7 @@ private:
     // Network
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
     QString     serverIp;
     quint16     serverPort;
 
@@ -0,0 +1,190 @@
+#include "adcatalogcache.h"
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QVariantMap>
+
+namespace {
+const quint32 CACHE_MAGIC   = 0x4B4E4143;   // "KNAC"
+const quint32 CACHE_FORMAT  = 2;   // 2: rows carry has_image
+// Images travel as thumbnails; keeping them in the listing would bloat it.
+const QString INLINE_IMAGE_KEY = "image_base64";
+}
+
+AdCatalogCache::AdCatalogCache(const QString &name)
+    : dir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/cache")
+    , name(name)
+    , catalogVersion(0)
+    , complete(false)
+{
+}
+
+QString AdCatalogCache::listingPath() const
+{
+    return dir + "/" + name + ".bin";
+}
+
+QString AdCatalogCache::thumbnailDir() const
+{
+    return dir + "/" + name + "-thumbnails";
+}
+
+QString AdCatalogCache::thumbnailPath(int id) const
+{
+    return QString("%1/%2.img").arg(thumbnailDir()).arg(id);
+}
+
+// Written as the first line of a thumbnail file.
+QByteArray AdCatalogCache::thumbnailStamp(const QString &updatedAt)
+{
+    return QCryptographicHash::hash(updatedAt.toUtf8(), QCryptographicHash::Sha1).toHex().left(12) + '\n';
+}
+
+bool AdCatalogCache::load()
+{
+    catalogEpoch.clear();
+    catalogVersion = 0;
+    complete = false;
+    ads.clear();
+    // Thumbnails from before each listing had a directory of its own.
+    QDir(dir + "/thumbnails").removeRecursively();
+
+    QFile file(listingPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic = 0, format = 0;
+    in >> magic >> format;
+    if (magic != CACHE_MAGIC || format != CACHE_FORMAT)
+        return false;
+
+    QString epoch;
+    qint64 version = 0;
+    quint32 count = 0;
+    in >> epoch >> version >> count;
+
+    QMap<int, QJsonObject> loaded;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QVariantMap row;
+        in >> row;
+        QJsonObject obj = QJsonObject::fromVariantMap(row);
+        loaded.insert(obj.value("id").toInt(), obj);
+    }
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    catalogEpoch   = epoch;
+    catalogVersion = version;
+    ads            = loaded;
+    complete       = true;
+    return true;
+}
+
+// Only a complete listing is written; a partial one would hide the rows
+// it is missing behind later deltas.
+bool AdCatalogCache::save() const
+{
+    if (!isValid() || !QDir().mkpath(dir))
+        return false;
+
+    QSaveFile file(listingPath());
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << CACHE_MAGIC << CACHE_FORMAT
+        << catalogEpoch << catalogVersion << quint32(ads.size());
+    for (const auto &row : ads)
+        out << row.toVariantMap();
+
+    return file.commit();
+}
+
+void AdCatalogCache::clear()
+{
+    catalogEpoch.clear();
+    catalogVersion = 0;
+    complete = false;
+    ads.clear();
+    QDir(thumbnailDir()).removeRecursively();
+}
+
+QJsonArray AdCatalogCache::rows() const
+{
+    QJsonArray arr;
+    for (const auto &row : ads)
+        arr.append(row);
+    return arr;
+}
+
+void AdCatalogCache::setCatalogVersion(const QString &epoch, qint64 version)
+{
+    catalogEpoch   = epoch;
+    catalogVersion = version;
+}
+
+void AdCatalogCache::addRow(const QJsonObject &row)
+{
+    QJsonObject stored = row;
+    stored.remove(INLINE_IMAGE_KEY);
+    ads.insert(stored.value("id").toInt(), stored);
+}
+
+void AdCatalogCache::markComplete()
+{
+    complete = true;
+}
+
+void AdCatalogCache::applyDelta(const QList<QJsonObject> &changed, const QJsonArray &removed, qint64 version)
+{
+    for (const auto &row : changed) {
+        int id = row.value("id").toInt();
+        auto it = ads.constFind(id);
+        if (it != ads.constEnd() && it->value("updated_at") != row.value("updated_at"))
+            dropThumbnail(id);
+        addRow(row);
+    }
+    for (const auto &v : removed) {
+        int id = v.toInt();
+        if (ads.remove(id))
+            dropThumbnail(id);
+    }
+    catalogVersion = version;
+}
+
+QByteArray AdCatalogCache::thumbnail(int id, const QString &updatedAt) const
+{
+    QFile file(thumbnailPath(id));
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    const QByteArray stamp = thumbnailStamp(updatedAt);
+    if (file.read(stamp.size()) != stamp)
+        return QByteArray();
+    return file.readAll();
+}
+
+// Replaces whatever was stored for the ad, in one rename.
+void AdCatalogCache::storeThumbnail(int id, const QString &updatedAt, const QByteArray &data)
+{
+    if (!QDir().mkpath(thumbnailDir()))
+        return;
+
+    QSaveFile file(thumbnailPath(id));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(thumbnailStamp(updatedAt));
+    file.write(data);
+    file.commit();
+}
+
+void AdCatalogCache::dropThumbnail(int id)
+{
+    QFile::remove(thumbnailPath(id));
+}
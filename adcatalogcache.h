@@ -0,0 +1,62 @@
+#ifndef ADCATALOGCACHE_H
+#define ADCATALOGCACHE_H
+
+#include <QString>
+#include <QMap>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QList>
+
+// On-disk copy of one ad listing plus ad thumbnails, kept under
+// QStandardPaths::AppDataLocation so the ads browser can show the
+// catalogue before the server answers.
+//
+// The listing belongs to a server catalog epoch and version (see
+// get_ads). A full download is written page by page after clear() and
+// counts only once markComplete() is called; from then on
+// applyDelta() keeps it in step with get_ads deltas. Thumbnails are one
+// file per ad id in a directory of the listing's own, stamped with the
+// updated_at they were made for, so an edited ad never shows a stale
+// image. clear() removes them with the listing: ids from another epoch
+// may name other ads.
+class AdCatalogCache
+{
+public:
+    explicit AdCatalogCache(const QString &name);
+
+    bool load();
+    bool save() const;
+    void clear();
+
+    bool isValid() const { return complete && !catalogEpoch.isEmpty(); }
+    QString epoch() const { return catalogEpoch; }
+    qint64 version() const { return catalogVersion; }
+    int size() const { return ads.size(); }
+    // Ordered by ad id.
+    QJsonArray rows() const;
+
+    void setCatalogVersion(const QString &epoch, qint64 version);
+    void addRow(const QJsonObject &row);
+    void markComplete();
+    void applyDelta(const QList<QJsonObject> &changed, const QJsonArray &removed, qint64 version);
+
+    QByteArray thumbnail(int id, const QString &updatedAt) const;
+    void storeThumbnail(int id, const QString &updatedAt, const QByteArray &data);
+
+private:
+    QString dir;
+    QString name;
+
+    QString catalogEpoch;
+    qint64  catalogVersion;
+    bool    complete;
+    QMap<int, QJsonObject> ads;
+
+    QString listingPath() const;
+    QString thumbnailDir() const;
+    QString thumbnailPath(int id) const;
+    static QByteArray thumbnailStamp(const QString &updatedAt);
+    void dropThumbnail(int id);
+};
+
+#endif
@@ -5,21 +5,30 @@
 #include <QHostAddress>
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QFile>
-#include <QBuffer>
+#include <QCryptographicHash>
+#include <QtConcurrent>
+#include <QStatusBar>
 #include <QDebug>
 
 namespace {
 const QString DEFAULT_SERVER_IP   = "127.0.0.1";
 const quint16 DEFAULT_SERVER_PORT = 4545;
 const int     CONNECTION_TIMEOUT  = 5000;
+const int     DEFAULT_CHUNK_SIZE  = 256 * 1024;
+const int     MAX_RESUME_ATTEMPTS = 5;
+const int     RESUME_DELAY        = 1000;
 }
 
 AddAdWindow::AddAdWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::AddAdWindow)
+    , uploadState(UploadState::Idle)
+    , uploadOffset(0)
+    , uploadChunkSize(DEFAULT_CHUNK_SIZE)
+    , resumeAttempts(0)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
 {
@@ -33,10 +42,15 @@ AddAdWindow::AddAdWindow(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &AddAdWindow::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &AddAdWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &AddAdWindow::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &AddAdWindow::onMessage);
+
+    connect(&compressWatcher, &QFutureWatcher<ImageCompressor::Result>::finished,
+            this, &AddAdWindow::onImageCompressed);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
         socket->abort();
+        finishUpload(QString());
         QMessageBox::critical(this, "Network", "Server did not respond in time.");
         emit networkError("Timeout in AddAdWindow");
     });
@@ -58,6 +72,11 @@ void AddAdWindow::setCurrentUser(const QString &username)
     currentUsername = username;
 }
 
+void AddAdWindow::setImageOptions(const ImageCompressor::Options &options)
+{
+    imageOptions = options;
+}
+
 void AddAdWindow::setupUiDesign()
 {
     this->setStyleSheet(
@@ -118,50 +137,173 @@ bool AddAdWindow::validateInputs(QString &errorMessage) const
 void AddAdWindow::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
 
-QByteArray AddAdWindow::loadImageAsBase64() const
+void AddAdWindow::sendJson(const QJsonObject &obj)
 {
-    if (selectedImagePath.isEmpty())
-        return QByteArray();
-
-    QFile file(selectedImagePath);
-    if (!file.open(QIODevice::ReadOnly))
-        return QByteArray();
-
-    QByteArray data = file.readAll();
-    return data.toBase64();
+    QByteArray data = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+    data.append('\n');
+    socket->write(data);
+    socket->flush();
 }
 
 void AddAdWindow::sendAddAdRequest()
 {
-    QString title      = ui->titleLineEdit->text().trimmed();
-    QString desc       = ui->descriptionTextEdit->toPlainText().trimmed();
-    QString priceStr   = ui->priceLineEdit->text().trimmed();
-    QString category   = ui->categoryComboBox->currentText();
-    QByteArray imgBase64 = loadImageAsBase64();
+    uploadState = UploadState::Submitting;
 
     QJsonObject obj;
     obj["type"]        = "add_ad";
-    obj["owner"]       = currentUsername;
-    obj["title"]       = title;
-    obj["description"] = desc;
-    obj["price"]       = priceStr.toDouble();
-    obj["category"]    = category;
-    obj["status"]      = "Pending";
-    obj["image_base64"]= QString::fromUtf8(imgBase64);
-
-    QJsonDocument doc(obj);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
-    data.append('\n');
+    obj["username"]    = currentUsername;
+    obj["title"]       = ui->titleLineEdit->text().trimmed();
+    obj["description"] = ui->descriptionTextEdit->toPlainText().trimmed();
+    obj["price"]       = ui->priceLineEdit->text().trimmed().toDouble();
+    obj["category"]    = ui->categoryComboBox->currentText();
+    if (!imageBlobId.isEmpty())
+        obj["image_blob"] = imageBlobId;
+    if (!thumbnailBlobId.isEmpty())
+        obj["thumbnail_blob"] = thumbnailBlobId;
+
+    sendJson(obj);
+}
 
-    socket->write(data);
-    socket->flush();
+void AddAdWindow::onImageCompressed()
+{
+    if (uploadState != UploadState::Compressing)
+        return;
+
+    const ImageCompressor::Result r = compressWatcher.result();
+    if (!r.error.isEmpty()) {
+        finishUpload("Cannot read the image: " + r.error);
+        return;
+    }
+    pendingThumbnail = r.thumbnail;
+    startUpload(r.data);
+    connectToServer();
+}
+
+void AddAdWindow::startUpload(const QByteArray &data)
+{
+    uploadBuffer.close();
+    uploadData = data;
+    uploadBuffer.setBuffer(&uploadData);
+    uploadBuffer.open(QIODevice::ReadOnly);
+
+    uploadSha256 = QString::fromLatin1(
+        QCryptographicHash::hash(uploadData, QCryptographicHash::Sha256).toHex());
+
+    uploadId.clear();
+    uploadOffset = 0;
+    resumeAttempts = 0;
+    uploadState = UploadState::Beginning;
 }
 
+void AddAdWindow::sendBeginUpload()
+{
+    uploadState = UploadState::Beginning;
+
+    QJsonObject obj;
+    obj["type"]     = "begin_upload";
+    obj["username"] = currentUsername;
+    obj["size"]     = uploadBuffer.size();
+    if (!uploadId.isEmpty())
+        obj["upload_id"] = uploadId;
+    sendJson(obj);
+}
 
+// One chunk in flight at a time: the next one goes out when the server
+// acknowledges the previous, so a resume never has more than one chunk
+// to resend.
+void AddAdWindow::sendNextChunk()
+{
+    const qint64 size = uploadBuffer.size();
+    if (uploadOffset >= size) {
+        uploadState = UploadState::Committing;
+        QJsonObject obj;
+        obj["type"]      = "commit_upload";
+        obj["username"]  = currentUsername;
+        obj["upload_id"] = uploadId;
+        obj["sha256"]    = uploadSha256;
+        sendJson(obj);
+        return;
+    }
+
+    uploadState = UploadState::Sending;
+    uploadBuffer.seek(uploadOffset);
+    QByteArray chunk = uploadBuffer.read(uploadChunkSize);
+
+    QJsonObject obj;
+    obj["type"]      = "upload_chunk";
+    obj["username"]  = currentUsername;
+    obj["upload_id"] = uploadId;
+    obj["offset"]    = uploadOffset;
+    obj["data"]      = QString::fromLatin1(chunk.toBase64());
+    sendJson(obj);
+
+    statusBar()->showMessage(QString("Uploading image... %1%").arg(uploadOffset * 100 / size));
+}
+
+void AddAdWindow::handleUploadResponse(const QJsonObject &obj)
+{
+    const QString type = obj["type"].toString();
+    const bool success = obj["success"].toBool();
+    const QString message = obj["message"].toString();
+
+    if (type == "begin_upload_response") {
+        if (!success) {
+            finishUpload(message.isEmpty() ? "Upload was refused." : message);
+            return;
+        }
+        uploadId = obj["upload_id"].toString();
+        uploadOffset = qint64(obj["received"].toDouble());
+        uploadChunkSize = obj["chunk_size"].toInt(DEFAULT_CHUNK_SIZE);
+        sendNextChunk();
+    } else if (type == "upload_chunk_response") {
+        // A stale offset is not fatal: continue from where the server is.
+        if (!success && message != "Unexpected offset") {
+            finishUpload(message.isEmpty() ? "Upload failed." : message);
+            return;
+        }
+        uploadOffset = qint64(obj["received"].toDouble());
+        resumeAttempts = 0;
+        sendNextChunk();
+    } else if (type == "commit_upload_response") {
+        if (!success) {
+            finishUpload(message.isEmpty() ? "Upload failed." : message);
+            return;
+        }
+        if (imageBlobId.isEmpty())
+            imageBlobId = obj["blob_id"].toString();
+        else
+            thumbnailBlobId = obj["blob_id"].toString();
+        uploadBuffer.close();
+        uploadData.clear();
+
+        if (!pendingThumbnail.isEmpty()) {
+            startUpload(pendingThumbnail);
+            pendingThumbnail.clear();
+            sendBeginUpload();
+            return;
+        }
+        statusBar()->clearMessage();
+        sendAddAdRequest();
+    }
+}
+
+void AddAdWindow::finishUpload(const QString &error)
+{
+    uploadBuffer.close();
+    uploadData.clear();
+    pendingThumbnail.clear();
+    uploadState = UploadState::Idle;
+    ui->submitButton->setEnabled(true);
+    statusBar()->clearMessage();
+
+    if (!error.isEmpty())
+        QMessageBox::critical(this, "Upload failed", error);
+}
 
 void AddAdWindow::on_browseImageButton_clicked()
 {
@@ -169,7 +311,7 @@ void AddAdWindow::on_browseImageButton_clicked()
         this,
         "Select Image",
         QString(),
-        "Images (*.png *.jpg *.jpeg *.bmp)"
+        "Images (*.png *.jpg *.jpeg *.bmp *.webp)"
         );
 
     if (!fileName.isEmpty()) {
@@ -191,8 +333,22 @@ void AddAdWindow::on_submitButton_clicked()
         return;
     }
 
-    connectToServer();
-    sendAddAdRequest();
+    imageBlobId.clear();
+    thumbnailBlobId.clear();
+    ui->submitButton->setEnabled(false);
+
+    if (selectedImagePath.isEmpty()) {
+        connectToServer();
+        return;
+    }
+
+    uploadState = UploadState::Compressing;
+    statusBar()->showMessage("Preparing image...");
+    const QString path = selectedImagePath;
+    const ImageCompressor::Options options = imageOptions;
+    compressWatcher.setFuture(QtConcurrent::run([path, options]() {
+        return ImageCompressor::compress(path, options);
+    }));
 }
 
 void AddAdWindow::on_cancelButton_clicked()
@@ -204,7 +360,12 @@ void AddAdWindow::on_cancelButton_clicked()
 
 void AddAdWindow::onConnected()
 {
+    connectionTimer->stop();
 
+    if (uploadState == UploadState::Idle || uploadState == UploadState::Submitting)
+        sendAddAdRequest();
+    else
+        sendBeginUpload();
 }
 
 void AddAdWindow::onDisconnected()
@@ -214,42 +375,54 @@ void AddAdWindow::onDisconnected()
 
 void AddAdWindow::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
-
-        QJsonObject obj = doc.object();
-        QString type = obj["type"].toString();
-
-        if (type == "add_ad_response") {
-            bool success = obj["success"].toBool();
-            QString message = obj["message"].toString();
-
-            if (success) {
-                QMessageBox::information(this, "Ad created",
-                                         message.isEmpty() ? "Ad created successfully and is pending approval." : message);
-                emit adCreated();
-                close();
-            } else {
-                QMessageBox::critical(this, "Error",
-                                      message.isEmpty() ? "Failed to create ad." : message);
-            }
+    reader->feed(socket->readAll());
+}
+
+void AddAdWindow::onMessage(const QJsonObject &obj)
+{
+    QString type = obj["type"].toString();
+
+    if (type == "begin_upload_response" || type == "upload_chunk_response"
+        || type == "commit_upload_response") {
+        handleUploadResponse(obj);
+    } else if (type == "add_ad_response") {
+        bool success = obj["success"].toBool();
+        QString message = obj["message"].toString();
+        finishUpload(QString());
+
+        if (success) {
+            QMessageBox::information(this, "Ad created",
+                                     message.isEmpty() ? "Ad created successfully and is pending approval." : message);
+            emit adCreated();
+            close();
+        } else {
+            QMessageBox::critical(this, "Error",
+                                  message.isEmpty() ? "Failed to create ad." : message);
         }
+    } else if (type == "error") {
+        // Refused before reaching a handler (rate limits); whatever step
+        // was waiting for a reply will not get one.
+        const QString message = obj["message"].toString();
+        finishUpload(message.isEmpty() ? "The server refused the request." : message);
     }
 }
 
 void AddAdWindow::onSocketError(QAbstractSocket::SocketError)
 {
     connectionTimer->stop();
+
+    const bool uploading = uploadState == UploadState::Beginning
+                           || uploadState == UploadState::Sending
+                           || uploadState == UploadState::Committing;
+    if (uploading && resumeAttempts < MAX_RESUME_ATTEMPTS) {
+        resumeAttempts++;
+        uploadState = UploadState::Beginning;
+        statusBar()->showMessage("Connection lost, resuming upload...");
+        QTimer::singleShot(RESUME_DELAY * resumeAttempts, this, &AddAdWindow::connectToServer);
+        return;
+    }
+    finishUpload(QString());
+
     QString err = socket->errorString();
     QMessageBox::critical(this, "Network error", err);
     emit networkError(err);
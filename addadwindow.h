@@ -4,6 +4,11 @@
 #include <QMainWindow>
 #include <QTcpSocket>
 #include <QTimer>
+#include <QBuffer>
+#include <QJsonObject>
+#include <QFutureWatcher>
+#include "imagecompressor.h"
+#include "jsonlinereader.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class AddAdWindow; }
@@ -19,6 +24,8 @@ public:
 
     void setServerAddress(const QString &ip, quint16 port);
     void setCurrentUser(const QString &username);
+    // Size limit, quality and format used to re-encode images before upload.
+    void setImageOptions(const ImageCompressor::Options &options);
 
 signals:
     void adCreated();
@@ -34,24 +41,53 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
+
+    void onImageCompressed();
 
 private:
+    // The image is first re-encoded on a worker thread, then goes up in
+    // chunks (begin_upload, upload_chunk, commit_upload), followed the same
+    // way by its thumbnail; add_ad refers to both committed blobs. After a
+    // disconnect the upload resumes from the server's received offset.
+    enum class UploadState { Idle, Compressing, Beginning, Sending, Committing, Submitting };
+
     Ui::AddAdWindow *ui;
 
     QString currentUsername;
     QString selectedImagePath;
 
+    UploadState uploadState;
+    ImageCompressor::Options imageOptions;
+    QFutureWatcher<ImageCompressor::Result> compressWatcher;
+    QByteArray  uploadData;
+    QBuffer     uploadBuffer;
+    QString     uploadId;
+    QString     uploadSha256;
+    qint64      uploadOffset;
+    int         uploadChunkSize;
+    int         resumeAttempts;
+    QString     imageBlobId;
+    QByteArray  pendingThumbnail;   // uploaded once the image is committed
+    QString     thumbnailBlobId;
+
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
     QString     serverIp;
     quint16     serverPort;
 
     void setupUiDesign();
     bool validateInputs(QString &errorMessage) const;
     void connectToServer();
+    void sendJson(const QJsonObject &obj);
     void sendAddAdRequest();
 
-    QByteArray loadImageAsBase64() const;
+    void startUpload(const QByteArray &data);
+    void sendBeginUpload();
+    void sendNextChunk();
+    void handleUploadResponse(const QJsonObject &obj);
+    void finishUpload(const QString &error);
 };
 
 #endif
@@ -5,12 +5,13 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
-#include <QStandardItem>
+#include <QTableView>
 
 namespace {
 const QString DEFAULT_SERVER_IP   = "127.0.0.1";
 const quint16 DEFAULT_SERVER_PORT = 4545;
 const int     CONNECTION_TIMEOUT  = 5000;
+const int     PAGE_SIZE           = 500;
 }
 
 AdminPanel::AdminPanel(QWidget *parent)
@@ -18,13 +19,15 @@ AdminPanel::AdminPanel(QWidget *parent)
     , ui(new Ui::AdminPanel)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
-    , pendingModel(new QStandardItemModel(this))
-    , approvedModel(new QStandardItemModel(this))
-    , rejectedModel(new QStandardItemModel(this))
+    , pendingModel(new CompactTableModel(this))
+    , approvedModel(new CompactTableModel(this))
+    , rejectedModel(new CompactTableModel(this))
     , pendingRequest(PendingRequest::None)
     , selectedAdId(-1)
+    , listOffset(0)
 {
     ui->setupUi(this);
     setWindowTitle("Admin Panel");
@@ -36,6 +39,7 @@ AdminPanel::AdminPanel(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &AdminPanel::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &AdminPanel::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &AdminPanel::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &AdminPanel::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -85,65 +89,59 @@ void AdminPanel::setupUiDesign()
 
 void AdminPanel::setupModels()
 {
-    pendingModel->setColumnCount(5);
-    pendingModel->setHeaderData(0, Qt::Horizontal, "ID");
-    pendingModel->setHeaderData(1, Qt::Horizontal, "Title");
-    pendingModel->setHeaderData(2, Qt::Horizontal, "Price");
-    pendingModel->setHeaderData(3, Qt::Horizontal, "Category");
-    pendingModel->setHeaderData(4, Qt::Horizontal, "Owner");
-    ui->pendingTableView->setModel(pendingModel);
-    ui->pendingTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
-    ui->pendingTableView->setSelectionMode(QAbstractItemView::SingleSelection);
-    ui->pendingTableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    ui->pendingTableView->horizontalHeader()->setStretchLastSection(true);
-
-    approvedModel->setColumnCount(5);
-    approvedModel->setHeaderData(0, Qt::Horizontal, "ID");
-    approvedModel->setHeaderData(1, Qt::Horizontal, "Title");
-    approvedModel->setHeaderData(2, Qt::Horizontal, "Price");
-    approvedModel->setHeaderData(3, Qt::Horizontal, "Category");
-    approvedModel->setHeaderData(4, Qt::Horizontal, "Owner");
-    ui->approvedTableView->setModel(approvedModel);
-    ui->approvedTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
-    ui->approvedTableView->setSelectionMode(QAbstractItemView::SingleSelection);
-    ui->approvedTableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    ui->approvedTableView->horizontalHeader()->setStretchLastSection(true);
-
-    rejectedModel->setColumnCount(5);
-    rejectedModel->setHeaderData(0, Qt::Horizontal, "ID");
-    rejectedModel->setHeaderData(1, Qt::Horizontal, "Title");
-    rejectedModel->setHeaderData(2, Qt::Horizontal, "Price");
-    rejectedModel->setHeaderData(3, Qt::Horizontal, "Category");
-    rejectedModel->setHeaderData(4, Qt::Horizontal, "Owner");
-    ui->rejectedTableView->setModel(rejectedModel);
-    ui->rejectedTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
-    ui->rejectedTableView->setSelectionMode(QAbstractItemView::SingleSelection);
-    ui->rejectedTableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    ui->rejectedTableView->horizontalHeader()->setStretchLastSection(true);
+    setupList(pendingModel,  ui->pendingTableView,  PendingRequest::GetPending);
+    setupList(approvedModel, ui->approvedTableView, PendingRequest::GetApproved);
+    setupList(rejectedModel, ui->rejectedTableView, PendingRequest::GetRejected);
+}
+
+void AdminPanel::setupList(CompactTableModel *model, QTableView *view, PendingRequest request)
+{
+    model->addColumn("id",       "ID",       CompactTableModel::ColumnType::Int);
+    model->addColumn("title",    "Title",    CompactTableModel::ColumnType::String);
+    model->addColumn("price",    "Price",    CompactTableModel::ColumnType::Double);
+    model->addColumn("category", "Category", CompactTableModel::ColumnType::Label);
+    model->addColumn("owner",    "Owner",    CompactTableModel::ColumnType::Label);
+
+    // Further pages load as the view scrolls to the end.
+    connect(model, &CompactTableModel::fetchMoreRequested, this, [this, request](int offset) {
+        if (request == PendingRequest::GetPending)       requestPendingAds(offset);
+        else if (request == PendingRequest::GetApproved) requestApprovedAds(offset);
+        else                                             requestRejectedAds(offset);
+    });
+
+    view->setModel(model);
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setSelectionMode(QAbstractItemView::SingleSelection);
+    view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    view->horizontalHeader()->setStretchLastSection(true);
 }
 
 void AdminPanel::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
 
-void AdminPanel::requestPendingAds()
+void AdminPanel::requestPendingAds(int offset)
 {
     pendingRequest = PendingRequest::GetPending;
+    listOffset = offset;
     connectToServer();
 }
 
-void AdminPanel::requestApprovedAds()
+void AdminPanel::requestApprovedAds(int offset)
 {
     pendingRequest = PendingRequest::GetApproved;
+    listOffset = offset;
     connectToServer();
 }
 
-void AdminPanel::requestRejectedAds()
+void AdminPanel::requestRejectedAds(int offset)
 {
     pendingRequest = PendingRequest::GetRejected;
+    listOffset = offset;
     connectToServer();
 }
 
@@ -173,10 +171,13 @@ void AdminPanel::sendRequestForCurrentPending()
 
     if (pendingRequest == PendingRequest::GetPending) {
         obj["type"] = "get_pending_ads";
+        addListParams(obj, pendingModel);
     } else if (pendingRequest == PendingRequest::GetApproved) {
         obj["type"] = "get_approved_ads";
+        addListParams(obj, approvedModel);
     } else if (pendingRequest == PendingRequest::GetRejected) {
         obj["type"] = "get_rejected_ads";
+        addListParams(obj, rejectedModel);
     } else if (pendingRequest == PendingRequest::ApproveAd) {
         obj["type"] = "approve_ad";
         obj["ad_id"] = selectedAdId;
@@ -196,55 +197,42 @@ void AdminPanel::sendRequestForCurrentPending()
     socket->flush();
 }
 
+void AdminPanel::addListParams(QJsonObject &obj, CompactTableModel *model) const
+{
+    obj["offset"] = listOffset;
+    obj["limit"] = PAGE_SIZE;
+    if (listOffset == 0 && listEtags.contains(model))
+        obj["if_none_match"] = listEtags.value(model);
+}
+
 void AdminPanel::handlePendingResponse(const QJsonObject &obj)
 {
-    pendingModel->removeRows(0, pendingModel->rowCount());
-    QJsonArray arr = obj.value("ads").toArray();
-    int row = 0;
-    for (const auto &v : arr) {
-        QJsonObject a = v.toObject();
-        pendingModel->insertRow(row);
-        pendingModel->setData(pendingModel->index(row, 0), a["id"].toInt());
-        pendingModel->setData(pendingModel->index(row, 1), a["title"].toString());
-        pendingModel->setData(pendingModel->index(row, 2), a["price"].toDouble());
-        pendingModel->setData(pendingModel->index(row, 3), a["category"].toString());
-        pendingModel->setData(pendingModel->index(row, 4), a["owner"].toString());
-        row++;
-    }
+    fillList(pendingModel, obj);
 }
 
 void AdminPanel::handleApprovedResponse(const QJsonObject &obj)
 {
-    approvedModel->removeRows(0, approvedModel->rowCount());
-    QJsonArray arr = obj.value("ads").toArray();
-    int row = 0;
-    for (const auto &v : arr) {
-        QJsonObject a = v.toObject();
-        approvedModel->insertRow(row);
-        approvedModel->setData(approvedModel->index(row, 0), a["id"].toInt());
-        approvedModel->setData(approvedModel->index(row, 1), a["title"].toString());
-        approvedModel->setData(approvedModel->index(row, 2), a["price"].toDouble());
-        approvedModel->setData(approvedModel->index(row, 3), a["category"].toString());
-        approvedModel->setData(approvedModel->index(row, 4), a["owner"].toString());
-        row++;
-    }
+    fillList(approvedModel, obj);
 }
 
 void AdminPanel::handleRejectedResponse(const QJsonObject &obj)
 {
-    rejectedModel->removeRows(0, rejectedModel->rowCount());
-    QJsonArray arr = obj.value("ads").toArray();
-    int row = 0;
-    for (const auto &v : arr) {
-        QJsonObject a = v.toObject();
-        rejectedModel->insertRow(row);
-        rejectedModel->setData(rejectedModel->index(row, 0), a["id"].toInt());
-        rejectedModel->setData(rejectedModel->index(row, 1), a["title"].toString());
-        rejectedModel->setData(rejectedModel->index(row, 2), a["price"].toDouble());
-        rejectedModel->setData(rejectedModel->index(row, 3), a["category"].toString());
-        rejectedModel->setData(rejectedModel->index(row, 4), a["owner"].toString());
-        row++;
+    fillList(rejectedModel, obj);
+}
+
+// A reply at offset 0 replaces the list; later pages are appended. A
+// not_modified reply leaves the list (and the pages loaded after it) as
+// it is.
+void AdminPanel::fillList(CompactTableModel *model, const QJsonObject &obj)
+{
+    if (obj.value("not_modified").toBool())
+        return;
+    if (obj.value("offset").toInt() == 0) {
+        model->clear();
+        listEtags.insert(model, obj.value("etag").toString());
     }
+    model->appendRows(obj.value("ads").toArray());
+    model->setTotalRows(obj.value("total").toInt());
 }
 
 void AdminPanel::handleApproveResponse(const QJsonObject &obj)
@@ -303,8 +291,8 @@ void AdminPanel::on_approveButton_clicked()
         QMessageBox::warning(this, "Approve", "Select an ad");
         return;
     }
-    int row = idx.row();
-    int adId = pendingModel->data(pendingModel->index(row, 0)).toInt();
+    int row = pendingModel->sourceRow(idx.row());
+    int adId = int(pendingModel->intAt(row, 0));
     sendApproveRequest(adId);
 }
 
@@ -315,8 +303,8 @@ void AdminPanel::on_rejectButton_clicked()
         QMessageBox::warning(this, "Reject", "Select an ad");
         return;
     }
-    int row = idx.row();
-    int adId = pendingModel->data(pendingModel->index(row, 0)).toInt();
+    int row = pendingModel->sourceRow(idx.row());
+    int adId = int(pendingModel->intAt(row, 0));
     sendRejectRequest(adId);
 }
 
@@ -339,33 +327,25 @@ void AdminPanel::onDisconnected()
 
 void AdminPanel::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty()) continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject()) continue;
-
-        QJsonObject obj = doc.object();
-        QString type = obj.value("type").toString();
-
-        if (type == "get_pending_ads_response") {
-            handlePendingResponse(obj);
-        } else if (type == "get_approved_ads_response") {
-            handleApprovedResponse(obj);
-        } else if (type == "get_rejected_ads_response") {
-            handleRejectedResponse(obj);
-        } else if (type == "approve_ad_response") {
-            handleApproveResponse(obj);
-        } else if (type == "reject_ad_response") {
-            handleRejectResponse(obj);
-        } else if (type == "get_admin_stats_response") {
-            handleStatsResponse(obj);
-        }
+    reader->feed(socket->readAll());
+}
+
+void AdminPanel::onMessage(const QJsonObject &obj)
+{
+    QString type = obj.value("type").toString();
+
+    if (type == "get_pending_ads_response") {
+        handlePendingResponse(obj);
+    } else if (type == "get_approved_ads_response") {
+        handleApprovedResponse(obj);
+    } else if (type == "get_rejected_ads_response") {
+        handleRejectedResponse(obj);
+    } else if (type == "approve_ad_response") {
+        handleApproveResponse(obj);
+    } else if (type == "reject_ad_response") {
+        handleRejectResponse(obj);
+    } else if (type == "get_admin_stats_response") {
+        handleStatsResponse(obj);
     }
 
     pendingRequest = PendingRequest::None;
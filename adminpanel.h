@@ -4,7 +4,11 @@
 #include <QMainWindow>
 #include <QTcpSocket>
 #include <QTimer>
-#include <QStandardItemModel>
+#include <QHash>
+#include "jsonlinereader.h"
+#include "compacttablemodel.h"
+
+class QTableView;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class AdminPanel; }
@@ -34,6 +38,7 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
 
 private:
     Ui::AdminPanel *ui;
@@ -42,12 +47,13 @@ private:
 
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
     QString     serverIp;
     quint16     serverPort;
 
-    QStandardItemModel *pendingModel;
-    QStandardItemModel *approvedModel;
-    QStandardItemModel *rejectedModel;
+    CompactTableModel *pendingModel;
+    CompactTableModel *approvedModel;
+    CompactTableModel *rejectedModel;
 
     enum class PendingRequest {
         None,
@@ -61,20 +67,27 @@ private:
 
     PendingRequest pendingRequest;
     int selectedAdId;
+    int listOffset;
+    // Etag of each list's first page, sent back as if_none_match so an
+    // unchanged list is not downloaded again.
+    QHash<CompactTableModel *, QString> listEtags;
 
     void setupUiDesign();
     void setupModels();
+    void setupList(CompactTableModel *model, QTableView *view, PendingRequest request);
     void connectToServer();
-    void requestPendingAds();
-    void requestApprovedAds();
-    void requestRejectedAds();
+    void requestPendingAds(int offset = 0);
+    void requestApprovedAds(int offset = 0);
+    void requestRejectedAds(int offset = 0);
     void requestStats();
     void sendApproveRequest(int adId);
     void sendRejectRequest(int adId);
+    void addListParams(QJsonObject &obj, CompactTableModel *model) const;
 
     void handlePendingResponse(const QJsonObject &obj);
     void handleApprovedResponse(const QJsonObject &obj);
     void handleRejectedResponse(const QJsonObject &obj);
+    void fillList(CompactTableModel *model, const QJsonObject &obj);
     void handleApproveResponse(const QJsonObject &obj);
     void handleRejectResponse(const QJsonObject &obj);
     void handleStatsResponse(const QJsonObject &obj);
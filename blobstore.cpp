@@ -0,0 +1,269 @@
+#include "blobstore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+
+namespace {
+const qint64 UPLOAD_EXPIRY_MS = 24 * 60 * 60 * 1000;
+const qint64 UNCLAIMED_EXPIRY_MS = 60 * 60 * 1000;
+const int MAX_UPLOADS_PER_OWNER = 8;               // open plus unclaimed
+const qint64 MAX_PENDING_BYTES = qint64(1) << 30;
+const int HASH_READ_BYTES = 64 * 1024;
+}
+
+const qint64 BlobStore::MAX_BLOB_BYTES = 20 * 1024 * 1024;
+const int BlobStore::CHUNK_BYTES = 256 * 1024;
+const int BlobStore::MAX_CHUNK_BYTES = 1024 * 1024;
+
+BlobStore &BlobStore::instance()
+{
+    static BlobStore store;
+    return store;
+}
+
+BlobStore::BlobStore()
+{
+}
+
+bool BlobStore::setRoot(const QString &dir)
+{
+    QMutexLocker locker(&mutex);
+    QDir d(dir);
+    if (!d.mkpath("uploads") || !d.mkpath("blobs"))
+        return false;
+
+    root = d.absolutePath();
+    uploads.clear();
+    unclaimed.clear();
+    // Partial files from before a restart cannot be resumed: their owner
+    // and expected size were only kept in memory.
+    QDir partDir(root + "/uploads");
+    for (const QString &name : partDir.entryList({"*.part"}, QDir::Files))
+        partDir.remove(name);
+    return true;
+}
+
+QString BlobStore::partPath(const QString &uploadId) const
+{
+    return root + "/uploads/" + uploadId + ".part";
+}
+
+QString BlobStore::blobPath(const QString &blobId) const
+{
+    return root + "/blobs/" + blobId;
+}
+
+bool BlobStore::isValidBlobId(const QString &blobId)
+{
+    if (blobId.size() != 64)
+        return false;
+    for (QChar c : blobId)
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+            return false;
+    return true;
+}
+
+bool BlobStore::exists(const QString &blobId) const
+{
+    QMutexLocker locker(&mutex);
+    return !root.isEmpty() && isValidBlobId(blobId) && QFileInfo::exists(blobPath(blobId));
+}
+
+void BlobStore::expireUploads()
+{
+    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = uploads.begin(); it != uploads.end();) {
+        if (it->touchedMs < nowMs - UPLOAD_EXPIRY_MS) {
+            QFile::remove(partPath(it.key()));
+            it = uploads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = unclaimed.begin(); it != unclaimed.end();) {
+        if (it->committedMs < nowMs - UNCLAIMED_EXPIRY_MS) {
+            QFile::remove(blobPath(it.key()));
+            it = unclaimed.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Disk promised to open uploads plus what unclaimed blobs take.
+qint64 BlobStore::pendingBytes() const
+{
+    qint64 total = 0;
+    for (const Upload &u : uploads)
+        total += u.size;
+    for (const Unclaimed &c : unclaimed)
+        total += c.size;
+    return total;
+}
+
+void BlobStore::claim(const QString &blobId)
+{
+    QMutexLocker locker(&mutex);
+    unclaimed.remove(blobId);
+}
+
+int BlobStore::removeUnreferenced(const QSet<QString> &referenced)
+{
+    QMutexLocker locker(&mutex);
+    if (root.isEmpty())
+        return 0;
+    int removed = 0;
+    QDir blobDir(root + "/blobs");
+    for (const QString &name : blobDir.entryList(QDir::Files)) {
+        if (!referenced.contains(name) && !unclaimed.contains(name) && blobDir.remove(name))
+            removed++;
+    }
+    return removed;
+}
+
+QString BlobStore::beginUpload(const QString &owner, qint64 size, const QString &resumeId,
+                               qint64 *received, QString *error)
+{
+    QMutexLocker locker(&mutex);
+    if (root.isEmpty()) {
+        *error = "Image uploads are not enabled";
+        return QString();
+    }
+    expireUploads();
+
+    auto it = uploads.find(resumeId);
+    if (!resumeId.isEmpty() && it != uploads.end() && it->owner == owner && it->size == size) {
+        it->touchedMs = QDateTime::currentMSecsSinceEpoch();
+        *received = it->received;
+        return resumeId;
+    }
+
+    if (size <= 0 || size > MAX_BLOB_BYTES) {
+        *error = QString("Image must be between 1 byte and %1 MB").arg(MAX_BLOB_BYTES >> 20);
+        return QString();
+    }
+
+    int open = 0;
+    for (const Upload &u : uploads)
+        if (u.owner == owner)
+            open++;
+    for (const Unclaimed &c : unclaimed)
+        if (c.owner == owner)
+            open++;
+    if (open >= MAX_UPLOADS_PER_OWNER) {
+        *error = "Too many unfinished uploads";
+        return QString();
+    }
+    if (pendingBytes() + size > MAX_PENDING_BYTES) {
+        *error = "Upload storage is full, try again later";
+        return QString();
+    }
+
+    const QString id = QUuid::createUuid().toString(QUuid::Id128);
+    QFile part(partPath(id));
+    if (!part.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = "Cannot store upload";
+        return QString();
+    }
+
+    Upload u;
+    u.owner = owner;
+    u.size = size;
+    u.touchedMs = QDateTime::currentMSecsSinceEpoch();
+    uploads.insert(id, u);
+
+    *received = 0;
+    return id;
+}
+
+bool BlobStore::appendChunk(const QString &uploadId, const QString &owner, qint64 offset,
+                            const QByteArray &data, qint64 *received, QString *error)
+{
+    QMutexLocker locker(&mutex);
+    auto it = uploads.find(uploadId);
+    if (it == uploads.end() || it->owner != owner) {
+        *error = "Upload not found";
+        return false;
+    }
+
+    *received = it->received;
+    if (offset != it->received) {
+        *error = "Unexpected offset";
+        return false;
+    }
+    if (data.isEmpty() || data.size() > MAX_CHUNK_BYTES || it->received + data.size() > it->size) {
+        *error = "Invalid chunk size";
+        return false;
+    }
+
+    QFile part(partPath(uploadId));
+    if (!part.open(QIODevice::WriteOnly | QIODevice::Append) || part.size() != it->received
+        || part.write(data) != data.size()) {
+        // Keep the file in step with `received` so a retry can succeed.
+        part.resize(it->received);
+        *error = "Cannot store upload";
+        return false;
+    }
+
+    it->received += data.size();
+    it->touchedMs = QDateTime::currentMSecsSinceEpoch();
+    *received = it->received;
+    return true;
+}
+
+QString BlobStore::commitUpload(const QString &uploadId, const QString &owner,
+                                const QString &sha256, QString *error)
+{
+    QMutexLocker locker(&mutex);
+    auto it = uploads.find(uploadId);
+    if (it == uploads.end() || it->owner != owner) {
+        *error = "Upload not found";
+        return QString();
+    }
+    if (it->received != it->size) {
+        *error = "Upload is incomplete";
+        return QString();
+    }
+
+    QFile part(partPath(uploadId));
+    if (!part.open(QIODevice::ReadOnly)) {
+        *error = "Cannot read upload";
+        return QString();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    while (!part.atEnd())
+        hash.addData(part.read(HASH_READ_BYTES));
+    part.close();
+
+    const QString blobId = QString::fromLatin1(hash.result().toHex());
+    if (!sha256.isEmpty() && sha256.toLower() != blobId) {
+        part.remove();
+        uploads.erase(it);
+        *error = "Checksum mismatch";
+        return QString();
+    }
+
+    // Content-addressed, so an identical image is stored once. A blob
+    // that was already stored and is not waiting for a claim belongs to
+    // an ad, so it must not start expiring.
+    const bool stored = QFileInfo::exists(blobPath(blobId));
+    if (stored)
+        part.remove();
+    else if (!part.rename(blobPath(blobId))) {
+        *error = "Cannot store upload";
+        return QString();
+    }
+
+    if (!stored || unclaimed.contains(blobId)) {
+        Unclaimed &c = unclaimed[blobId];
+        c.owner = owner;
+        c.size = it->size;
+        c.committedMs = QDateTime::currentMSecsSinceEpoch();
+    }
+    uploads.erase(it);
+    return blobId;
+}
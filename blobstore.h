@@ -0,0 +1,79 @@
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+
+// On-disk store for uploaded images. Uploads arrive in chunks that are
+// appended straight to <root>/uploads/<upload id>.part, so the server
+// holds at most one chunk in memory per request. Committed blobs are
+// content-addressed: <root>/blobs/<sha256 hex>.
+//
+// An upload stays open (and resumable from its received offset) until it
+// is committed or has been untouched for UPLOAD_EXPIRY. A committed blob
+// no ad has claimed yet is removed after UNCLAIMED_EXPIRY. Open uploads
+// and unclaimed blobs count against a per-owner limit and a store-wide
+// byte budget, which bounds the disk they take whatever names are used.
+class BlobStore
+{
+public:
+    static const qint64 MAX_BLOB_BYTES;
+    static const int    CHUNK_BYTES;        // suggested to clients
+    static const int    MAX_CHUNK_BYTES;
+
+    static BlobStore &instance();
+
+    // Uploads are refused until a root directory is set.
+    bool setRoot(const QString &dir);
+
+    // Starts a new upload, or resumes `resumeId` if it is still open for
+    // this owner. Returns the upload id; *received is where to continue.
+    QString beginUpload(const QString &owner, qint64 size, const QString &resumeId,
+                        qint64 *received, QString *error);
+    // `offset` must equal the bytes received so far; on a mismatch the
+    // call fails and *received tells the client where to resume.
+    bool appendChunk(const QString &uploadId, const QString &owner, qint64 offset,
+                     const QByteArray &data, qint64 *received, QString *error);
+    // Checks size and SHA-256 (hex, optional) and returns the blob id.
+    QString commitUpload(const QString &uploadId, const QString &owner,
+                         const QString &sha256, QString *error);
+    // Called once an ad refers to the blob; it is then kept for good.
+    void claim(const QString &blobId);
+    // Deletes stored blobs that are not in `referenced`. Run at startup:
+    // which blobs were unclaimed is only known in memory.
+    int removeUnreferenced(const QSet<QString> &referenced);
+
+    bool exists(const QString &blobId) const;
+    QString blobPath(const QString &blobId) const;
+
+private:
+    BlobStore();
+
+    struct Upload {
+        QString owner;
+        qint64  size = 0;
+        qint64  received = 0;
+        qint64  touchedMs = 0;
+    };
+
+    struct Unclaimed {
+        QString owner;
+        qint64  size = 0;
+        qint64  committedMs = 0;
+    };
+
+    mutable QMutex mutex;
+    QString root;
+    QHash<QString, Upload> uploads;
+    QHash<QString, Unclaimed> unclaimed;
+
+    QString partPath(const QString &uploadId) const;
+    void expireUploads();
+    qint64 pendingBytes() const;
+    static bool isValidBlobId(const QString &blobId);
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QStandardItem>
+#include <QUuid>
 
 namespace {
 const QString DEFAULT_SERVER_IP   = "127.0.0.1";
@@ -19,6 +20,7 @@ CartWindow::CartWindow(QWidget *parent)
     , ui(new Ui::CartWindow)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
     , model(new QStandardItemModel(this))
@@ -34,6 +36,7 @@ CartWindow::CartWindow(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &CartWindow::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &CartWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &CartWindow::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &CartWindow::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -97,6 +100,7 @@ void CartWindow::setupModel()
 void CartWindow::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
@@ -123,9 +127,13 @@ void CartWindow::sendRemoveRequest(int adId)
 
 void CartWindow::sendPurchaseRequest()
 {
+    if (purchaseKey.isEmpty())
+        purchaseKey = QUuid::createUuid().toString(QUuid::WithoutBraces);
+
     QJsonObject obj;
-    obj["type"]     = "purchase_cart";
-    obj["username"] = currentUsername;
+    obj["type"]            = "purchase_cart";
+    obj["username"]        = currentUsername;
+    obj["idempotency_key"] = purchaseKey;
 
     QJsonDocument doc(obj);
     QByteArray data = doc.toJson(QJsonDocument::Compact);
@@ -195,6 +203,8 @@ void CartWindow::onConnected()
     QJsonObject obj;
     obj["type"]     = "get_cart";
     obj["username"] = currentUsername;
+    if (!cartEtag.isEmpty())
+        obj["if_none_match"] = cartEtag;
 
     QJsonDocument doc(obj);
     QByteArray data = doc.toJson(QJsonDocument::Compact);
@@ -210,57 +220,52 @@ void CartWindow::onDisconnected()
 
 void CartWindow::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
-
-        QJsonObject obj = doc.object();
-        QString type = obj["type"].toString();
+    reader->feed(socket->readAll());
+}
 
-        if (type == "get_cart_response") {
+void CartWindow::onMessage(const QJsonObject &obj)
+{
+    QString type = obj["type"].toString();
+
+    if (type == "get_cart_response") {
+        if (obj["not_modified"].toBool())
+            return;
+        cartEtag = obj["etag"].toString();
+        items.clear();
+        QJsonArray arr = obj["items"].toArray();
+        for (const auto &v : arr) {
+            if (!v.isObject()) continue;
+            QJsonObject a = v.toObject();
+
+            CartItem it;
+            it.id       = a["id"].toInt();
+            it.title    = a["title"].toString();
+            it.category = a["category"].toString();
+            it.price    = a["price"].toDouble();
+            items.append(it);
+        }
+        populateTable(items);
+        emit cartUpdated();
+    } else if (type == "remove_from_cart_response") {
+        bool success = obj["success"].toBool();
+        QString message = obj["message"].toString();
+        if (success) {
+            requestCart();
+        } else {
+            QMessageBox::critical(this, "Error", message);
+        }
+    } else if (type == "purchase_cart_response") {
+        purchaseKey.clear();
+        bool success = obj["success"].toBool();
+        QString message = obj["message"].toString();
+        if (success) {
+            QMessageBox::information(this, "Purchase", message);
+            cartEtag.clear();
             items.clear();
-            QJsonArray arr = obj["items"].toArray();
-            for (const auto &v : arr) {
-                if (!v.isObject()) continue;
-                QJsonObject a = v.toObject();
-
-                CartItem it;
-                it.id       = a["id"].toInt();
-                it.title    = a["title"].toString();
-                it.category = a["category"].toString();
-                it.price    = a["price"].toDouble();
-                items.append(it);
-            }
             populateTable(items);
-            emit cartUpdated();
-        } else if (type == "remove_from_cart_response") {
-            bool success = obj["success"].toBool();
-            QString message = obj["message"].toString();
-            if (success) {
-                requestCart();
-            } else {
-                QMessageBox::critical(this, "Error", message);
-            }
-        } else if (type == "purchase_cart_response") {
-            bool success = obj["success"].toBool();
-            QString message = obj["message"].toString();
-            if (success) {
-                QMessageBox::information(this, "Purchase", message);
-                items.clear();
-                populateTable(items);
-                emit purchaseCompleted();
-            } else {
-                QMessageBox::critical(this, "Error", message);
-            }
+            emit purchaseCompleted();
+        } else {
+            QMessageBox::critical(this, "Error", message);
         }
     }
 }
@@ -5,6 +5,7 @@
 #include <QTcpSocket>
 #include <QTimer>
 #include <QStandardItemModel>
+#include "jsonlinereader.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class CartWindow; }
@@ -35,6 +36,7 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
 
 private:
     Ui::CartWindow *ui;
@@ -43,6 +45,7 @@ private:
 
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
     QString     serverIp;
     quint16     serverPort;
 
@@ -57,6 +60,12 @@ private:
     };
 
     QList<CartItem> items;
+    // Etag of the shown cart; an unchanged cart answers not_modified.
+    QString cartEtag;
+
+    // Sent with purchase_cart and kept until the server answers, so a
+    // retried purchase is not charged twice.
+    QString purchaseKey;
 
     void setupUiDesign();
     void setupModel();
@@ -0,0 +1,245 @@
+#include "compacttablemodel.h"
+
+CompactTableModel::CompactTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , rows(0)
+    , totalRows(0)
+    , fetching(false)
+    , filtered(false)
+    , decorationColumn(-1)
+{
+}
+
+void CompactTableModel::addColumn(const QString &key, const QString &header, ColumnType type)
+{
+    beginResetModel();
+    Column c;
+    c.key    = key;
+    c.header = header;
+    c.type   = type;
+    switch (type) {
+    case ColumnType::Int:    c.ints.fill(0, rows);       break;
+    case ColumnType::Double: c.doubles.fill(0.0, rows);  break;
+    default:                 c.strings.resize(rows);     break;
+    }
+    columns.append(c);
+    endResetModel();
+}
+
+int CompactTableModel::columnIndex(const QString &key) const
+{
+    for (int i = 0; i < columns.size(); ++i)
+        if (columns[i].key == key)
+            return i;
+    return -1;
+}
+
+void CompactTableModel::setDecoration(int column, DecorationProvider provider)
+{
+    decorationColumn = column;
+    decoration       = std::move(provider);
+}
+
+// Keeps the filter mode: after clear() a filtered model shows nothing
+// until rows are shown again.
+void CompactTableModel::clear()
+{
+    beginResetModel();
+    for (auto &c : columns) {
+        c.ints.clear();
+        c.doubles.clear();
+        c.strings.clear();
+    }
+    labels.clear();
+    rows      = 0;
+    totalRows = 0;
+    fetching  = false;
+    visible.clear();
+    endResetModel();
+}
+
+void CompactTableModel::store(const QJsonObject &row)
+{
+    for (auto &c : columns) {
+        const QJsonValue v = row.value(c.key);
+        switch (c.type) {
+        case ColumnType::Int:
+            c.ints.append(v.isBool() ? qint64(v.toBool()) : qint64(v.toDouble()));
+            break;
+        case ColumnType::Double:
+            c.doubles.append(v.toDouble());
+            break;
+        case ColumnType::String:
+            c.strings.append(v.toString());
+            break;
+        case ColumnType::Label: {
+            QString s = v.toString();
+            auto it = labels.constFind(s);
+            if (it == labels.constEnd())
+                it = labels.insert(s);
+            c.strings.append(*it);
+            break;
+        }
+        }
+    }
+    ++rows;
+}
+
+int CompactTableModel::appendRow(const QJsonObject &row)
+{
+    const int first = rows;
+    fetching = false;
+
+    if (!filtered)
+        beginInsertRows(QModelIndex(), rows, rows);
+    store(row);
+    if (!filtered)
+        endInsertRows();
+    return first;
+}
+
+int CompactTableModel::appendRows(const QJsonArray &list)
+{
+    const int first = rows;
+    fetching = false;
+
+    int count = 0;
+    for (const auto &v : list)
+        if (v.isObject())
+            ++count;
+    if (count == 0)
+        return first;
+
+    for (auto &c : columns) {
+        switch (c.type) {
+        case ColumnType::Int:    c.ints.reserve(rows + count);    break;
+        case ColumnType::Double: c.doubles.reserve(rows + count); break;
+        default:                 c.strings.reserve(rows + count); break;
+        }
+    }
+
+    if (!filtered)
+        beginInsertRows(QModelIndex(), rows, rows + count - 1);
+    for (const auto &v : list)
+        if (v.isObject())
+            store(v.toObject());
+    if (!filtered)
+        endInsertRows();
+    return first;
+}
+
+void CompactTableModel::setTotalRows(int total)
+{
+    totalRows = total;
+    fetching  = false;
+}
+
+void CompactTableModel::setVisibleRows(const QVector<int> &sourceRows)
+{
+    beginResetModel();
+    filtered = true;
+    visible  = sourceRows;
+    endResetModel();
+}
+
+void CompactTableModel::showRow(int source)
+{
+    if (!filtered || source < 0 || source >= rows)
+        return;
+    beginInsertRows(QModelIndex(), visible.size(), visible.size());
+    visible.append(source);
+    endInsertRows();
+}
+
+void CompactTableModel::clearFilter()
+{
+    if (!filtered)
+        return;
+    beginResetModel();
+    filtered = false;
+    visible.clear();
+    endResetModel();
+}
+
+int CompactTableModel::sourceRow(int viewRow) const
+{
+    if (!filtered)
+        return (viewRow >= 0 && viewRow < rows) ? viewRow : -1;
+    return visible.value(viewRow, -1);
+}
+
+qint64 CompactTableModel::intAt(int source, int column) const
+{
+    if (column < 0 || column >= columns.size())
+        return 0;
+    return columns[column].ints.value(source);
+}
+
+double CompactTableModel::doubleAt(int source, int column) const
+{
+    if (column < 0 || column >= columns.size())
+        return 0.0;
+    return columns[column].doubles.value(source);
+}
+
+QString CompactTableModel::stringAt(int source, int column) const
+{
+    if (column < 0 || column >= columns.size())
+        return QString();
+    return columns[column].strings.value(source);
+}
+
+int CompactTableModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return filtered ? visible.size() : rows;
+}
+
+int CompactTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : columns.size();
+}
+
+QVariant CompactTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const int source = sourceRow(index.row());
+    if (source < 0 || index.column() >= columns.size())
+        return QVariant();
+
+    if (role == Qt::DecorationRole && index.column() == decorationColumn && decoration)
+        return decoration(source);
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    const Column &c = columns[index.column()];
+    switch (c.type) {
+    case ColumnType::Int:    return c.ints[source];
+    case ColumnType::Double: return c.doubles[source];
+    default:                 return c.strings[source];
+    }
+}
+
+QVariant CompactTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole
+        && section >= 0 && section < columns.size())
+        return columns[section].header;
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+bool CompactTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !fetching && rows < totalRows;
+}
+
+void CompactTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+    fetching = true;
+    emit fetchMoreRequested(rows);
+}
@@ -0,0 +1,100 @@
+#ifndef COMPACTTABLEMODEL_H
+#define COMPACTTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QVector>
+#include <QSet>
+#include <functional>
+
+// Read-only table over one typed vector per column instead of a
+// QStandardItem per cell. Rows are filled from JSON objects by key and
+// added in batches, so a large listing costs one insert notification.
+//
+// Server paging: setTotalRows() tells the model how many rows exist, and
+// while fewer are loaded the view's fetchMore() turns into
+// fetchMoreRequested(offset) for the owning window to answer.
+//
+// An optional row filter shows a subset of the loaded rows; row numbers
+// in indexes are then view rows, see sourceRow().
+//
+// One column can carry a decoration (e.g. a thumbnail) supplied by the
+// owner per source row when the view paints it.
+class CompactTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum class ColumnType {
+        Int,
+        Double,
+        String,
+        Label       // short repeated text (category, status); interned
+    };
+
+    explicit CompactTableModel(QObject *parent = nullptr);
+
+    using DecorationProvider = std::function<QVariant(int sourceRow)>;
+
+    void addColumn(const QString &key, const QString &header, ColumnType type);
+    int  columnIndex(const QString &key) const;
+    void setDecoration(int column, DecorationProvider provider);
+
+    void clear();
+    // Both return the source row of the first added row.
+    int  appendRow(const QJsonObject &row);
+    int  appendRows(const QJsonArray &rows);
+
+    void setTotalRows(int total);
+    int  loadedRows() const { return rows; }
+
+    // Shows only the given source rows, in that order. Rows appended while
+    // a filter is set stay hidden until showRow() or a new filter.
+    void setVisibleRows(const QVector<int> &sourceRows);
+    void showRow(int sourceRow);
+    void clearFilter();
+    bool isFiltered() const { return filtered; }
+    int  sourceRow(int viewRow) const;
+
+    qint64  intAt(int sourceRow, int column) const;
+    double  doubleAt(int sourceRow, int column) const;
+    QString stringAt(int sourceRow, int column) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+signals:
+    void fetchMoreRequested(int offset);
+
+private:
+    struct Column {
+        QString key;
+        QString header;
+        ColumnType type;
+        QVector<qint64>  ints;
+        QVector<double>  doubles;
+        QVector<QString> strings;
+    };
+
+    QVector<Column> columns;
+    QSet<QString> labels;
+    int  rows;
+    int  totalRows;
+    bool fetching;
+
+    bool filtered;
+    QVector<int> visible;
+
+    int decorationColumn;
+    DecorationProvider decoration;
+
+    void store(const QJsonObject &row);
+};
+
+#endif
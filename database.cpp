@@ -4,9 +4,34 @@
 #include <QJsonArray>
 #include <QFile>
 #include <QDateTime>
+#include <QUuid>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+const int MAX_PURCHASE_REPLIES = 4096;
+
+QList<const Ad *> sortedById(QList<const Ad *> list)
+{
+    std::sort(list.begin(), list.end(),
+              [](const Ad *a, const Ad *b) { return a->id < b->id; });
+    return list;
+}
+
+QString newCatalogEpoch()
+{
+    return QUuid::createUuid().toString(QUuid::Id128);
+}
+}
 
 Database::Database()
     : nextAdId(1)
+    , catalogVer(0)
+    , epoch(newCatalogEpoch())
+    , adsByStatus{}
+    , activeCarts(0)
+    , gmv(0)
+    , depositsToday(0)
 {
 }
 
@@ -28,8 +53,9 @@ bool Database::userExists(const QString &username) const
 
 bool Database::checkPassword(const QString &username, const QString &hash) const
 {
-    if (!users.contains(username)) return false;
-    return users[username].passwordHash == hash;
+    auto it = users.constFind(username);
+    if (it == users.constEnd()) return false;
+    return it->passwordHash == hash;
 }
 
 void Database::addUser(const User &user)
@@ -37,14 +63,10 @@ void Database::addUser(const User &user)
     users[user.username] = user;
 }
 
-User Database::getUser(const QString &username) const
+const User *Database::findUser(const QString &username) const
 {
-    return users.value(username);
-}
-
-void Database::updateUser(const User &user)
-{
-    users[user.username] = user;
+    auto it = users.constFind(username);
+    return it == users.constEnd() ? nullptr : &it.value();
 }
 
 int Database::addAd(const Ad &ad)
@@ -53,56 +75,112 @@ int Database::addAd(const Ad &ad)
     a.id = nextAdId++;
     a.createdAt = now();
     a.updatedAt = a.createdAt;
+    a.version = ++catalogVer;
     ads[a.id] = a;
+    adjustStatusCount(a.owner, a.status, +1);
+    indexAd(a);
     return a.id;
 }
 
-Ad Database::getAd(int id) const
+const Ad *Database::findAd(int id) const
 {
-    return ads.value(id);
+    auto it = ads.constFind(id);
+    return it == ads.constEnd() ? nullptr : &it.value();
 }
 
-void Database::updateAd(const Ad &ad)
+void Database::updateAdStatus(int adId, AdStatus status)
 {
-    Ad a = ad;
-    a.updatedAt = now();
-    ads[a.id] = a;
+    updateAd(adId, [status](Ad &a) { a.status = status; });
 }
 
-void Database::updateAdStatus(int adId, const QString &status)
+QList<const Ad *> Database::getAdsByStatus(AdStatus status, int offset, int limit) const
 {
-    if (ads.contains(adId)) {
-        ads[adId].status = status;
-        ads[adId].updatedAt = now();
-    }
+    const std::set<int> &ids = adIdsByStatus[int(status)];
+    QList<const Ad *> list;
+    if (offset >= int(ids.size()))
+        return list;
+    const int remaining = int(ids.size()) - qMax(0, offset);
+    list.reserve(limit < 0 ? remaining : qMin(remaining, limit));
+    auto it = ids.begin();
+    std::advance(it, qMax(0, offset));
+    for (; it != ids.end() && (limit < 0 || list.size() < limit); ++it)
+        list.append(&ads.find(*it).value());
+    return list;
 }
 
-QList<Ad> Database::getAdsByStatus(const QString &status) const
+QList<const Ad *> Database::getAdsByStatusAfter(AdStatus status, int afterId, int limit) const
 {
-    QList<Ad> list;
-    for (const auto &a : ads.values())
-        if (a.status == status)
-            list.append(a);
+    const std::set<int> &ids = adIdsByStatus[int(status)];
+    QList<const Ad *> list;
+    for (auto it = ids.upper_bound(afterId);
+         it != ids.end() && (limit < 0 || list.size() < limit); ++it)
+        list.append(&ads.find(*it).value());
     return list;
 }
 
-QList<Ad> Database::getUserAds(const QString &username) const
+int Database::adCount(AdStatus status) const
 {
-    QList<Ad> list;
-    for (const auto &a : ads.values())
-        if (a.owner == username)
-            list.append(a);
-    return list;
+    return adsByStatus[int(status)];
+}
+
+qint64 Database::catalogVersion() const
+{
+    return catalogVer;
+}
+
+QString Database::catalogEpoch() const
+{
+    return epoch;
 }
 
-QList<Ad> Database::getAllAds() const
+QList<const Ad *> Database::getAdsChangedSince(qint64 version) const
 {
-    return ads.values();
+    if (version < 0)
+        return getAllAds();
+    QList<const Ad *> list;
+    for (auto it = adIdsByVersion.upper_bound(version); it != adIdsByVersion.end(); ++it)
+        list.append(&ads.find(it->second).value());
+    return sortedById(list);
+}
+
+QList<const Ad *> Database::getUserAds(const QString &username) const
+{
+    QList<const Ad *> list;
+    StringId owner = strings.find(username);
+    if (owner == InvalidStringId)
+        return list;
+    for (const auto &a : ads)
+        if (a.owner == owner)
+            list.append(&a);
+    return sortedById(list);
+}
+
+QList<const Ad *> Database::getAllAds() const
+{
+    QList<const Ad *> list;
+    list.reserve(ads.size());
+    for (const auto &a : ads)
+        list.append(&a);
+    return sortedById(list);
+}
+
+qint64 Database::cartVersion(const QString &username) const
+{
+    return cartVers.value(username);
+}
+
+qint64 Database::walletVersion(const QString &username) const
+{
+    return walletVers.value(username);
 }
 
 void Database::addToCart(const QString &username, int adId)
 {
-    carts[username].append(adId);
+    QList<int> &cart = carts[username];
+    if (cart.isEmpty())
+        activeCarts++;
+    cart.append(adId);
+    ++cartVers[username];
 }
 
 QList<int> Database::getCart(const QString &username) const
@@ -112,32 +190,181 @@ QList<int> Database::getCart(const QString &username) const
 
 void Database::removeFromCart(const QString &username, int adId)
 {
-    if (!carts.contains(username)) return;
-    carts[username].removeAll(adId);
+    auto it = carts.find(username);
+    if (it == carts.end() || it->isEmpty()) return;
+    if (it->removeAll(adId) == 0) return;
+    if (it->isEmpty())
+        activeCarts--;
+    ++cartVers[username];
 }
 
 void Database::clearCart(const QString &username)
 {
-    carts[username].clear();
+    auto it = carts.find(username);
+    if (it == carts.end() || it->isEmpty()) return;
+    it->clear();
+    activeCarts--;
+    ++cartVers[username];
 }
 
-void Database::addTransaction(const Transaction &t)
+Money Database::balance(const QString &username) const
 {
-    transactions.append(t);
+    return ledger.balance(username);
 }
 
-QList<Transaction> Database::getTransactions(const QString &username) const
+bool Database::deposit(const QString &username, Money amount, Money *newBalance)
 {
-    QList<Transaction> list;
-    for (const auto &t : transactions)
-        if (t.username == username)
-            list.append(t);
-    return list;
+    if (!users.contains(username) || amount <= 0)
+        return false;
+
+    postToLedger(Ledger::ExternalAccount, username, amount, TransactionType::Deposit, now(),
+                 "Wallet deposit", "Wallet deposit");
+    *newBalance = ledger.balance(username);
+    return true;
+}
+
+bool Database::withdraw(const QString &username, Money amount, Money *newBalance)
+{
+    if (!users.contains(username) || amount <= 0 || ledger.balance(username) < amount)
+        return false;
+
+    postToLedger(username, Ledger::ExternalAccount, amount, TransactionType::Withdraw, now(),
+                 "Wallet withdraw", "Wallet withdraw");
+    *newBalance = ledger.balance(username);
+    return true;
+}
+
+QList<Transaction> Database::getTransactions(const QString &username, int offset, int limit) const
+{
+    return ledger.transactions(username, offset, limit);
+}
+
+int Database::transactionCount(const QString &username) const
+{
+    return ledger.entryCount(username);
+}
+
+Ledger::AuditSnapshot Database::ledgerSnapshot() const
+{
+    return ledger.snapshot();
+}
+
+void Database::postToLedger(const QString &debit, const QString &credit, Money amount,
+                            TransactionType type, const QString &timestamp,
+                            const QString &debitMemo, const QString &creditMemo,
+                            int relatedAdId, const QString &relatedAdTitle)
+{
+    ledger.post(debit, credit, amount, type, timestamp, debitMemo, creditMemo,
+                relatedAdId, relatedAdTitle);
+    ++walletVers[debit];
+    ++walletVers[credit];
+
+    if (type == TransactionType::Deposit) {
+        QDate day = QDate::fromString(timestamp.left(10), "yyyy-MM-dd");
+        if (day == QDate::currentDate()) {
+            if (depositsDay != day) {
+                depositsDay = day;
+                depositsToday = 0;
+            }
+            depositsToday += amount;
+        }
+    }
 }
 
 void Database::addPurchaseRecord(const PurchaseRecord &p)
 {
     purchases.append(p);
+    gmv += toMinorUnits(p.price);
+}
+
+PurchaseResult Database::purchaseCart(const QString &username, const QString &idempotencyKey)
+{
+    QString replyKey;
+    if (!idempotencyKey.isEmpty()) {
+        replyKey = username + QLatin1Char('\n') + idempotencyKey;
+        auto replay = purchaseReplies.constFind(replyKey);
+        if (replay != purchaseReplies.constEnd())
+            return replay.value();
+    }
+
+    PurchaseResult r;
+    r.status = PurchaseResult::Status::Ok;
+    r.total = 0;
+    r.newBalance = 0;
+
+    auto buyer = users.find(username);
+    if (buyer == users.end()) {
+        r.status = PurchaseResult::Status::UserNotFound;
+        return r;
+    }
+    r.newBalance = ledger.balance(username);
+
+    // A cart may list the same ad twice; it can only be bought once.
+    StringId self = strings.find(username);
+    QList<Ad *> toBuy;
+    for (int id : carts.value(username)) {
+        auto it = ads.find(id);
+        if (it == ads.end() || it->status != AdStatus::Approved
+            || it->owner == self || r.adIds.contains(id))
+            continue;
+        toBuy.append(&it.value());
+        r.adIds.append(id);
+        r.total += toMinorUnits(it->price);
+    }
+
+    if (toBuy.isEmpty()) {
+        r.status = PurchaseResult::Status::CartEmpty;
+        return r;
+    }
+
+    if (r.newBalance < r.total) {
+        r.status = PurchaseResult::Status::InsufficientBalance;
+        return r;
+    }
+
+    // Nothing below can fail, so the purchase is applied as a whole.
+    QString date = now();
+    buyer->purchasesCount += toBuy.size();
+
+    for (Ad *a : toBuy) {
+        adjustStatusCount(a->owner, a->status, -1);
+        unindexAd(*a);
+        a->status = AdStatus::Sold;
+        a->updatedAt = date;
+        a->version = ++catalogVer;
+        adjustStatusCount(a->owner, a->status, +1);
+        indexAd(*a);
+
+        const QString &sellerName = strings.str(a->owner);
+        auto seller = users.find(sellerName);
+        if (seller != users.end())
+            seller->salesCount += 1;
+
+        postToLedger(username, sellerName, toMinorUnits(a->price), TransactionType::Purchase, date,
+                     QString("Purchase ad %1").arg(a->id), QString("Sold ad %1").arg(a->id),
+                     a->id, a->title);
+
+        PurchaseRecord p;
+        p.buyer = username;
+        p.seller = sellerName;
+        p.title = a->title;
+        p.price = a->price;
+        p.date = date;
+        p.adId = a->id;
+        addPurchaseRecord(p);
+    }
+
+    clearCart(username);
+    r.newBalance = ledger.balance(username);
+
+    if (!replyKey.isEmpty()) {
+        purchaseReplies.insert(replyKey, r);
+        purchaseReplyOrder.enqueue(replyKey);
+        if (purchaseReplyOrder.size() > MAX_PURCHASE_REPLIES)
+            purchaseReplies.remove(purchaseReplyOrder.dequeue());
+    }
+
+    return r;
 }
 
 QList<PurchaseRecord> Database::getPurchases(const QString &username) const
@@ -163,36 +390,126 @@ AdminStats Database::getAdminStats() const
     AdminStats s;
     s.totalUsers = users.size();
     s.totalAds = ads.size();
-    s.pendingAds = getPendingAdsCount();
-    s.approvedAds = getApprovedAdsCount();
-    s.rejectedAds = getRejectedAdsCount();
-    s.totalTransactions = transactions.size();
+    s.pendingAds = adsByStatus[int(AdStatus::Pending)];
+    s.approvedAds = adsByStatus[int(AdStatus::Approved)];
+    s.rejectedAds = adsByStatus[int(AdStatus::Rejected)];
+    s.totalTransactions = ledger.size();
     s.totalPurchases = purchases.size();
+    s.activeCarts = activeCarts;
+    s.gmv = gmv;
+    s.depositsToday = (depositsDay == QDate::currentDate()) ? depositsToday : 0;
+    return s;
+}
+
+QMap<QString, int> Database::tableSizes() const
+{
+    int cartItems = 0;
+    for (const auto &cart : carts)
+        cartItems += cart.size();
+
+    QMap<QString, int> sizes;
+    sizes["users"] = users.size();
+    sizes["ads"] = ads.size();
+    sizes["carts"] = carts.size();
+    sizes["cart_items"] = cartItems;
+    sizes["ledger_entries"] = ledger.size();
+    sizes["purchases"] = purchases.size();
+    sizes["strings"] = strings.size();
+    sizes["purchase_replies"] = purchaseReplies.size();
+    return sizes;
+}
+
+UserSummary Database::getUserSummary(const QString &username) const
+{
+    UserSummary s{};
+    auto counts = ownerCounts.constFind(strings.find(username));
+    if (counts != ownerCounts.constEnd())
+        std::copy(std::begin(counts->adsByStatus), std::end(counts->adsByStatus), s.adsByStatus);
+    s.totalAds = 0;
+    for (int n : s.adsByStatus)
+        s.totalAds += n;
+    auto cart = carts.constFind(username);
+    s.cartItems = cart == carts.constEnd() ? 0 : cart->size();
+    s.walletBalance = ledger.balance(username);
     return s;
 }
 
-int Database::getPendingAdsCount() const
+StringId Database::intern(const QString &text)
 {
-    int c = 0;
-    for (const auto &a : ads.values())
-        if (a.status == "Pending") c++;
-    return c;
+    return strings.intern(text);
 }
 
-int Database::getApprovedAdsCount() const
+const QString &Database::str(StringId id) const
 {
-    int c = 0;
-    for (const auto &a : ads.values())
-        if (a.status == "Approved") c++;
-    return c;
+    return strings.str(id);
 }
 
-int Database::getRejectedAdsCount() const
+void Database::adjustStatusCount(StringId owner, AdStatus status, int delta)
 {
-    int c = 0;
-    for (const auto &a : ads.values())
-        if (a.status == "Rejected") c++;
-    return c;
+    adsByStatus[int(status)] += delta;
+    ownerCounts[owner].adsByStatus[int(status)] += delta;
+}
+
+void Database::indexAd(const Ad &a)
+{
+    adIdsByStatus[int(a.status)].insert(a.id);
+    if (a.version > 0)
+        adIdsByVersion[a.version] = a.id;
+}
+
+void Database::unindexAd(const Ad &a)
+{
+    adIdsByStatus[int(a.status)].erase(a.id);
+    adIdsByVersion.erase(a.version);
+}
+
+// Rebuilds the live counters and ad indexes from scratch. Only used
+// after bulk loads.
+void Database::recountStats()
+{
+    for (int &c : adsByStatus)
+        c = 0;
+    ownerCounts.clear();
+    for (auto &ids : adIdsByStatus)
+        ids.clear();
+    adIdsByVersion.clear();
+    for (const auto &a : ads) {
+        adjustStatusCount(a.owner, a.status, +1);
+        indexAd(a);
+    }
+
+    activeCarts = 0;
+    for (const auto &c : carts)
+        if (!c.isEmpty()) activeCarts++;
+
+    gmv = 0;
+    for (const auto &p : purchases)
+        gmv += toMinorUnits(p.price);
+
+    depositsDay = QDate::currentDate();
+    depositsToday = 0;
+    QString today = depositsDay.toString("yyyy-MM-dd");
+    for (const auto &e : ledger.entries())
+        if (e.type == TransactionType::Deposit && e.timestamp.startsWith(today))
+            depositsToday += e.amount;
+}
+
+void Database::clear()
+{
+    users.clear();
+    ads.clear();
+    carts.clear();
+    ledger.clear();
+    purchases.clear();
+    strings.clear();
+    purchaseReplies.clear();
+    purchaseReplyOrder.clear();
+    nextAdId = 1;
+    catalogVer = 0;
+    epoch = newCatalogEpoch();
+    cartVers.clear();
+    walletVers.clear();
+    recountStats();
 }
 
 void Database::saveToFile(const QString &path)
@@ -200,7 +517,7 @@ void Database::saveToFile(const QString &path)
     QJsonObject root;
 
     QJsonArray usersArr;
-    for (const auto &u : users.values()) {
+    for (const auto &u : users) {
         QJsonObject o;
         o["username"] = u.username;
         o["passwordHash"] = u.passwordHash;
@@ -208,7 +525,6 @@ void Database::saveToFile(const QString &path)
         o["email"] = u.email;
         o["phone"] = u.phone;
         o["joinDate"] = u.joinDate;
-        o["walletBalance"] = u.walletBalance;
         o["adsCount"] = u.adsCount;
         o["purchasesCount"] = u.purchasesCount;
         o["salesCount"] = u.salesCount;
@@ -218,16 +534,21 @@ void Database::saveToFile(const QString &path)
     root["users"] = usersArr;
 
     QJsonArray adsArr;
-    for (const auto &a : ads.values()) {
+    for (const Ad *ap : getAllAds()) {
+        const Ad &a = *ap;
         QJsonObject o;
         o["id"] = a.id;
-        o["owner"] = a.owner;
+        o["owner"] = strings.str(a.owner);
         o["title"] = a.title;
         o["description"] = a.description;
         o["price"] = a.price;
-        o["category"] = a.category;
-        o["status"] = a.status;
+        o["category"] = strings.str(a.category);
+        o["status"] = adStatusToString(a.status);
         o["imageBase64"] = a.imageBase64;
+        if (!a.imageBlobId.isEmpty())
+            o["imageBlob"] = a.imageBlobId;
+        if (!a.thumbnailBlobId.isEmpty())
+            o["thumbnailBlob"] = a.thumbnailBlobId;
         o["createdAt"] = a.createdAt;
         o["updatedAt"] = a.updatedAt;
         adsArr.append(o);
@@ -246,19 +567,22 @@ void Database::saveToFile(const QString &path)
     }
     root["carts"] = cartsArr;
 
-    QJsonArray transArr;
-    for (const auto &t : transactions) {
+    QJsonArray ledgerArr;
+    for (const auto &e : ledger.entries()) {
         QJsonObject o;
-        o["username"] = t.username;
-        o["type"] = t.type;
-        o["amount"] = t.amount;
-        o["timestamp"] = t.timestamp;
-        o["description"] = t.description;
-        o["relatedAdTitle"] = t.relatedAdTitle;
-        o["relatedAdId"] = t.relatedAdId;
-        transArr.append(o);
+        o["seq"] = double(e.seq);
+        o["debit"] = e.debit;
+        o["credit"] = e.credit;
+        o["amount"] = double(e.amount);
+        o["type"] = transactionTypeToString(e.type);
+        o["timestamp"] = e.timestamp;
+        o["debitMemo"] = e.debitMemo;
+        o["creditMemo"] = e.creditMemo;
+        o["relatedAdTitle"] = e.relatedAdTitle;
+        o["relatedAdId"] = e.relatedAdId;
+        ledgerArr.append(o);
     }
-    root["transactions"] = transArr;
+    root["ledger"] = ledgerArr;
 
     QJsonArray purArr;
     for (const auto &p : purchases) {
@@ -279,24 +603,37 @@ void Database::saveToFile(const QString &path)
         file.write(doc.toJson());
 }
 
-void Database::loadFromFile(const QString &path)
+bool Database::loadFromFile(const QString &path, QString *error)
 {
+    auto fail = [&](const QString &reason) {
+        clear();
+        if (error)
+            *error = reason;
+        return false;
+    };
+
     QFile file(path);
+    if (!file.exists()) {
+        clear();
+        return true;
+    }
     if (!file.open(QIODevice::ReadOnly))
-        return;
+        return fail(file.errorString());
 
     QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
     if (!doc.isObject())
-        return;
+        return fail(parseError.error != QJsonParseError::NoError ? parseError.errorString()
+                                                                 : QString("not a JSON object"));
 
     QJsonObject root = doc.object();
 
-    users.clear();
-    ads.clear();
-    carts.clear();
-    transactions.clear();
-    purchases.clear();
+    clear();
+
+    // Files written before the ledger existed only carry a walletBalance
+    // per user and a one-sided transaction list; both are migrated below.
+    QHash<QString, Money> legacyBalances;
 
     QJsonArray usersArr = root["users"].toArray();
     for (const auto &v : usersArr) {
@@ -308,7 +645,8 @@ void Database::loadFromFile(const QString &path)
         u.email = o["email"].toString();
         u.phone = o["phone"].toString();
         u.joinDate = o["joinDate"].toString();
-        u.walletBalance = o["walletBalance"].toDouble();
+        if (o.contains("walletBalance"))
+            legacyBalances.insert(u.username, toMinorUnits(o["walletBalance"].toDouble()));
         u.adsCount = o["adsCount"].toInt();
         u.purchasesCount = o["purchasesCount"].toInt();
         u.salesCount = o["salesCount"].toInt();
@@ -321,13 +659,17 @@ void Database::loadFromFile(const QString &path)
         QJsonObject o = v.toObject();
         Ad a;
         a.id = o["id"].toInt();
-        a.owner = o["owner"].toString();
+        a.owner = strings.intern(o["owner"].toString());
         a.title = o["title"].toString();
         a.description = o["description"].toString();
         a.price = o["price"].toDouble();
-        a.category = o["category"].toString();
-        a.status = o["status"].toString();
+        a.category = strings.intern(o["category"].toString());
+        if (!adStatusFromString(o["status"].toString(), &a.status))
+            return fail(QString("ad %1 has unknown status \"%2\"")
+                        .arg(a.id).arg(o["status"].toString()));
         a.imageBase64 = o["imageBase64"].toString();
+        a.imageBlobId = o["imageBlob"].toString();
+        a.thumbnailBlobId = o["thumbnailBlob"].toString();
         a.createdAt = o["createdAt"].toString();
         a.updatedAt = o["updatedAt"].toString();
         ads[a.id] = a;
@@ -346,18 +688,51 @@ void Database::loadFromFile(const QString &path)
         carts[user] = list;
     }
 
-    QJsonArray transArr = root["transactions"].toArray();
-    for (const auto &v : transArr) {
-        QJsonObject o = v.toObject();
-        Transaction t;
-        t.username = o["username"].toString();
-        t.type = o["type"].toString();
-        t.amount = o["amount"].toDouble();
-        t.timestamp = o["timestamp"].toString();
-        t.description = o["description"].toString();
-        t.relatedAdTitle = o["relatedAdTitle"].toString();
-        t.relatedAdId = o["relatedAdId"].toInt();
-        transactions.append(t);
+    if (root.contains("ledger")) {
+        QJsonArray ledgerArr = root["ledger"].toArray();
+        for (const auto &v : ledgerArr) {
+            QJsonObject o = v.toObject();
+            TransactionType type;
+            if (!transactionTypeFromString(o["type"].toString(), &type))
+                return fail(QString("ledger entry %1 has unknown type \"%2\"")
+                            .arg(qint64(o["seq"].toDouble())).arg(o["type"].toString()));
+            ledger.post(o["debit"].toString(), o["credit"].toString(),
+                        Money(o["amount"].toDouble()), type, o["timestamp"].toString(),
+                        o["debitMemo"].toString(), o["creditMemo"].toString(),
+                        o["relatedAdId"].toInt(), o["relatedAdTitle"].toString());
+        }
+    } else {
+        QJsonArray transArr = root["transactions"].toArray();
+        for (const auto &v : transArr) {
+            QJsonObject o = v.toObject();
+            TransactionType type;
+            if (!transactionTypeFromString(o["type"].toString(), &type))
+                return fail(QString("transaction of %1 at %2 has unknown type \"%3\"")
+                            .arg(o["username"].toString(), o["timestamp"].toString(),
+                                 o["type"].toString()));
+            QString user = o["username"].toString();
+            Money amount = toMinorUnits(o["amount"].toDouble());
+            QString memo = o["description"].toString();
+            if (amount == 0)
+                continue;
+            if (amount > 0)
+                ledger.post(Ledger::ExternalAccount, user, amount, type, o["timestamp"].toString(),
+                            memo, memo, o["relatedAdId"].toInt(), o["relatedAdTitle"].toString());
+            else
+                ledger.post(user, Ledger::ExternalAccount, -amount, type, o["timestamp"].toString(),
+                            memo, memo, o["relatedAdId"].toInt(), o["relatedAdTitle"].toString());
+        }
+
+        QString opened = now();
+        for (auto it = legacyBalances.constBegin(); it != legacyBalances.constEnd(); ++it) {
+            Money diff = it.value() - ledger.balance(it.key());
+            if (diff > 0)
+                ledger.post(Ledger::ExternalAccount, it.key(), diff, TransactionType::Deposit,
+                            opened, "Opening balance", "Opening balance");
+            else if (diff < 0)
+                ledger.post(it.key(), Ledger::ExternalAccount, -diff, TransactionType::Withdraw,
+                            opened, "Opening balance", "Opening balance");
+        }
     }
 
     QJsonArray purArr = root["purchases"].toArray();
@@ -372,4 +747,7 @@ void Database::loadFromFile(const QString &path)
         p.adId = o["adId"].toInt();
         purchases.append(p);
     }
+
+    recountStats();
+    return true;
 }
@@ -2,10 +2,19 @@
 #define DATABASE_H
 
 #include "models.h"
+#include "ledger.h"
+#include <QHash>
 #include <QMap>
 #include <QList>
 #include <QString>
+#include <QDate>
+#include <QQueue>
+#include <set>
+#include <map>
 
+// The server's in-memory data. It is not thread-safe: only the event
+// loop thread that runs ServerCore uses it, and work moved to other
+// threads (the ledger audit) takes a snapshot first.
 class Database
 {
 public:
@@ -14,46 +23,168 @@ public:
     bool userExists(const QString &username) const;
     bool checkPassword(const QString &username, const QString &hash) const;
     void addUser(const User &user);
-    User getUser(const QString &username) const;
-    void updateUser(const User &user);
+    // Returns nullptr if the user does not exist. The pointer stays valid
+    // until the next addUser()/loadFromFile().
+    const User *findUser(const QString &username) const;
+    // Applies fn(User &) in place. Returns false if the user does not exist.
+    template <typename Fn>
+    bool updateUser(const QString &username, Fn fn);
 
     int addAd(const Ad &ad);
-    Ad getAd(int id) const;
-    void updateAd(const Ad &ad);
-    void updateAdStatus(int adId, const QString &status);
-    QList<Ad> getAdsByStatus(const QString &status) const;
-    QList<Ad> getUserAds(const QString &username) const;
-    QList<Ad> getAllAds() const;
+    // Returns nullptr if the ad does not exist. The pointer stays valid
+    // until the next addAd()/loadFromFile().
+    const Ad *findAd(int id) const;
+    // Applies fn(Ad &) in place and keeps updatedAt and the status
+    // counters in step. Returns false if the ad does not exist.
+    template <typename Fn>
+    bool updateAd(int id, Fn fn);
+    void updateAdStatus(int adId, AdStatus status);
+    // Listings are ordered by ad id; limit < 0 reads to the end.
+    QList<const Ad *> getAdsByStatus(AdStatus status, int offset = 0, int limit = -1) const;
+    // Keyset paging: the first `limit` ads with an id above afterId. Unlike
+    // an offset, the page boundary does not move when earlier ads change.
+    QList<const Ad *> getAdsByStatusAfter(AdStatus status, int afterId, int limit) const;
+    int adCount(AdStatus status) const;
+    // Every ad change stamps the ad with the next catalog version. The
+    // epoch is new whenever versions start over (process start, clear(),
+    // loadFromFile()), so versions from another epoch mean nothing.
+    qint64 catalogVersion() const;
+    QString catalogEpoch() const;
+    // Ads changed after the given version, ordered by id.
+    QList<const Ad *> getAdsChangedSince(qint64 version) const;
+    QList<const Ad *> getUserAds(const QString &username) const;
+    QList<const Ad *> getAllAds() const;
+
+    // Per-user versions for conditional reads: each cart or wallet change
+    // bumps the user's counter. Like catalog versions they only mean
+    // something within one catalog epoch.
+    qint64 cartVersion(const QString &username) const;
+    qint64 walletVersion(const QString &username) const;
 
     void addToCart(const QString &username, int adId);
     QList<int> getCart(const QString &username) const;
     void removeFromCart(const QString &username, int adId);
     void clearCart(const QString &username);
 
-    void addTransaction(const Transaction &t);
-    QList<Transaction> getTransactions(const QString &username) const;
+    // Wallet money lives in the ledger; balances are cached per account.
+    Money balance(const QString &username) const;
+    // Both return false (and post nothing) for unknown users, non-positive
+    // amounts, or a withdrawal above the balance.
+    bool deposit(const QString &username, Money amount, Money *newBalance);
+    bool withdraw(const QString &username, Money amount, Money *newBalance);
+    // Oldest first; limit < 0 reads to the end.
+    QList<Transaction> getTransactions(const QString &username, int offset = 0, int limit = -1) const;
+    int transactionCount(const QString &username) const;
+    Ledger::AuditSnapshot ledgerSnapshot() const;
 
     void addPurchaseRecord(const PurchaseRecord &p);
+    // Buys every approved ad in the user's cart as one all-or-nothing
+    // step: checks the balance, moves the ads to Sold, pays the sellers,
+    // writes purchase records and ledger postings, and clears the cart.
+    // The buyer's own ads are skipped.
+    // A non-empty idempotencyKey makes retries of a successful purchase
+    // return the original result instead of buying again.
+    PurchaseResult purchaseCart(const QString &username, const QString &idempotencyKey);
     QList<PurchaseRecord> getPurchases(const QString &username) const;
     QList<PurchaseRecord> getSales(const QString &username) const;
 
     AdminStats getAdminStats() const;
+    // Read from the per-owner counters and the cached balance: a few hash
+    // lookups, whatever the number of ads.
+    UserSummary getUserSummary(const QString &username) const;
+    // Row count per in-memory table, for the metrics endpoint.
+    QMap<QString, int> tableSizes() const;
+
+    StringId intern(const QString &text);
+    const QString &str(StringId id) const;
 
+    // Drops every table; used by loadFromFile() and the benchmarks.
+    void clear();
     void saveToFile(const QString &path);
-    void loadFromFile(const QString &path);
+    // A missing file loads as an empty database. A file that cannot be
+    // read, or holds a row this build does not understand, leaves the
+    // database empty and returns false, so it is never saved over.
+    bool loadFromFile(const QString &path, QString *error = nullptr);
 
 private:
     Database();
 
-    QMap<QString, User> users;
-    QMap<int, Ad> ads;
-    QMap<QString, QList<int>> carts;
-    QList<Transaction> transactions;
+    QHash<QString, User> users;
+    QHash<int, Ad> ads;
+    QHash<QString, QList<int>> carts;
+    Ledger ledger;
     QList<PurchaseRecord> purchases;
 
     int nextAdId;
+    qint64 catalogVer;
+    QString epoch;
+    QHash<QString, qint64> cartVers;
+    QHash<QString, qint64> walletVers;
+
+    StringPool strings;
+
+    // Live counters behind getAdminStats(); every mutator keeps them in
+    // step so reading the stats never has to scan the tables.
+    int adsByStatus[AdStatusCount];
+    struct OwnerCounts {
+        int adsByStatus[AdStatusCount] = {};
+    };
+    QHash<StringId, OwnerCounts> ownerCounts;
+    // Ad ids in id order per status, and by the catalog version of their
+    // last change, so pages and deltas only touch the ads they return.
+    // Ads loaded from a file have version 0 and are not in the latter.
+    std::set<int> adIdsByStatus[AdStatusCount];
+    std::map<qint64, int> adIdsByVersion;
+    int activeCarts;
+    Money gmv;
+    Money depositsToday;
+    QDate depositsDay;
+
+    // Results of recent successful purchases, keyed by user + idempotency
+    // key, oldest first in purchaseReplyOrder.
+    QHash<QString, PurchaseResult> purchaseReplies;
+    QQueue<QString> purchaseReplyOrder;
 
     QString now() const;
+    void adjustStatusCount(StringId owner, AdStatus status, int delta);
+    void indexAd(const Ad &a);
+    void unindexAd(const Ad &a);
+    void postToLedger(const QString &debit, const QString &credit, Money amount,
+                      TransactionType type, const QString &timestamp,
+                      const QString &debitMemo, const QString &creditMemo,
+                      int relatedAdId = 0, const QString &relatedAdTitle = QString());
+    void recountStats();
 };
 
+template <typename Fn>
+bool Database::updateUser(const QString &username, Fn fn)
+{
+    auto it = users.find(username);
+    if (it == users.end())
+        return false;
+    fn(*it);
+    return true;
+}
+
+template <typename Fn>
+bool Database::updateAd(int id, Fn fn)
+{
+    auto it = ads.find(id);
+    if (it == ads.end())
+        return false;
+
+    AdStatus before = it->status;
+    StringId owner = it->owner;
+    unindexAd(*it);
+    fn(*it);
+    if (it->status != before || it->owner != owner) {
+        adjustStatusCount(owner, before, -1);
+        adjustStatusCount(it->owner, it->status, +1);
+    }
+    it->updatedAt = now();
+    it->version = ++catalogVer;
+    indexAd(*it);
+    return true;
+}
+
 #endif
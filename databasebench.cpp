@@ -0,0 +1,445 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include "database.h"
+#include "jsonhandler.h"
+#include "jsonwriter.h"
+#include "blobstore.h"
+#include "requestscanner.h"
+
+// Microbenchmarks for the server hot paths. Every benchmark that touches
+// the tables is data-driven over their size so the output shows how cost
+// grows, not a single number. Sizes above KALANET_BENCH_MAX_ROWS (default
+// 100000) are skipped; set it to 10000000 for the full sweep.
+//
+//   kalanet-bench                         all benchmarks
+//   kalanet-bench getAdsByStatus          one benchmark
+//   kalanet-bench -iterations 20 ...      usual QtTest options
+
+namespace {
+const int BENCH_SIZES[] = {1000, 10000, 100000, 1000000, 10000000};
+const int ROWS_PER_USER = 100;
+const char *CATEGORIES[] = {"Electronics", "Home", "Car", "Service", "Other"};
+// Requests that change state are timed call by call over this many calls.
+const int MUTATION_ITERATIONS = 200;
+const int UPLOAD_BYTES = 16 * 1024;
+const QString BUYER = "bench_buyer";
+
+// How handleRequest() keeps a mutating request from measuring a
+// different state on every call.
+enum RequestKind {
+    ReadOnly,   // QBENCHMARK as is
+    Undone,     // set up and undone around each timed call
+    Appends     // adds a row per call; the tables are rebuilt afterwards
+};
+
+int maxRows()
+{
+    bool ok = false;
+    int n = qEnvironmentVariableIntValue("KALANET_BENCH_MAX_ROWS", &ok);
+    return ok && n > 0 ? n : 100000;
+}
+
+void addSizeRows()
+{
+    QTest::addColumn<int>("rows");
+    for (int rows : BENCH_SIZES)
+        if (rows <= maxRows())
+            QTest::newRow(QByteArray::number(rows).constData()) << rows;
+}
+
+QString userName(int i)
+{
+    return QString("user%1").arg(i);
+}
+}
+
+class DatabaseBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void getAdsByStatus_data();
+    void getAdsByStatus();
+    void getTransactions_data();
+    void getTransactions();
+    void getAdminStats_data();
+    void getAdminStats();
+    void saveToFile_data();
+    void saveToFile();
+    void loadFromFile_data();
+    void loadFromFile();
+    void handleRequest_data();
+    void handleRequest();
+    void parseRequest_data();
+    void parseRequest();
+
+private:
+    int populatedRows = -1;
+    int serial = 0;
+    QTemporaryDir tmp;
+
+    void populate(int rows);
+    QJsonObject prepareRequest(QJsonObject req);
+    void undoRequest(const QJsonObject &req, const QJsonObject &res);
+    QString startUpload(const QString &user, bool withData);
+};
+
+void DatabaseBench::initTestCase()
+{
+    QVERIFY(BlobStore::instance().setRoot(tmp.filePath("blobs")));
+}
+
+// `rows` ads (a third each Pending/Approved/Rejected) and `rows` ledger
+// postings, spread over rows / ROWS_PER_USER users. Ad 1 carries an
+// inline image for get_ad_image.
+void DatabaseBench::populate(int rows)
+{
+    if (populatedRows == rows)
+        return;
+
+    Database &db = Database::instance();
+    db.clear();
+
+    int userCount = qMax(1, rows / ROWS_PER_USER);
+    for (int i = 0; i < userCount; ++i) {
+        User u;
+        u.username = userName(i);
+        u.passwordHash = "x";
+        u.name = u.username;
+        u.email = u.username + "@bench.local";
+        u.phone = "09000000000";
+        u.joinDate = "2026-01-01 00:00:00";
+        u.adsCount = 0;
+        u.purchasesCount = 0;
+        u.salesCount = 0;
+        u.isAdmin = false;
+        db.addUser(u);
+    }
+
+    for (int i = 0; i < rows; ++i) {
+        Ad a;
+        a.id = 0;
+        a.owner = db.intern(userName(i % userCount));
+        a.category = db.intern(CATEGORIES[i % 5]);
+        a.title = QString("Item %1").arg(i);
+        a.description = "Benchmark listing";
+        a.price = 10.0 + i % 1000;
+        a.status = AdStatus(i % 3);
+        if (i == 0)
+            a.imageBase64 = QString::fromLatin1(QByteArray(UPLOAD_BYTES, 'x').toBase64());
+        int id = db.addAd(a);
+        if (i % 10 == 0)
+            db.addToCart(userName(i % userCount), id);
+    }
+
+    Money balance = 0;
+    for (int i = 0; i < rows; ++i)
+        db.deposit(userName(i % userCount), 100 + i % 5000, &balance);
+
+    populatedRows = rows;
+}
+
+void DatabaseBench::getAdsByStatus_data()
+{
+    addSizeRows();
+}
+
+void DatabaseBench::getAdsByStatus()
+{
+    QFETCH(int, rows);
+    populate(rows);
+
+    Database &db = Database::instance();
+    QBENCHMARK {
+        QList<const Ad *> list = db.getAdsByStatus(AdStatus::Approved);
+        QVERIFY(!list.isEmpty());
+    }
+}
+
+void DatabaseBench::getTransactions_data()
+{
+    addSizeRows();
+}
+
+void DatabaseBench::getTransactions()
+{
+    QFETCH(int, rows);
+    populate(rows);
+
+    Database &db = Database::instance();
+    QBENCHMARK {
+        QList<Transaction> list = db.getTransactions(userName(0));
+        QVERIFY(!list.isEmpty());
+    }
+}
+
+void DatabaseBench::getAdminStats_data()
+{
+    addSizeRows();
+}
+
+void DatabaseBench::getAdminStats()
+{
+    QFETCH(int, rows);
+    populate(rows);
+
+    Database &db = Database::instance();
+    QBENCHMARK {
+        AdminStats s = db.getAdminStats();
+        QCOMPARE(s.totalAds, rows);
+    }
+}
+
+void DatabaseBench::saveToFile_data()
+{
+    addSizeRows();
+}
+
+void DatabaseBench::saveToFile()
+{
+    QFETCH(int, rows);
+    populate(rows);
+
+    QString path = tmp.filePath("bench_db.json");
+    QBENCHMARK {
+        Database::instance().saveToFile(path);
+    }
+}
+
+void DatabaseBench::loadFromFile_data()
+{
+    addSizeRows();
+}
+
+void DatabaseBench::loadFromFile()
+{
+    QFETCH(int, rows);
+    populate(rows);
+
+    QString path = tmp.filePath("bench_db.json");
+    Database::instance().saveToFile(path);
+    QBENCHMARK {
+        Database::instance().loadFromFile(path);
+    }
+    // The loaded copy has the same contents, so populate() can keep it.
+}
+
+void DatabaseBench::handleRequest_data()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<QJsonObject>("request");
+    QTest::addColumn<int>("kind");
+
+    // Ad 1 is Pending, ad 2 Approved and in nobody's cart.
+    const QString user = userName(0);
+    struct Row { QByteArray name; QJsonObject request; RequestKind kind; };
+    const QList<Row> requests = {
+        {"login",              QJsonObject{{"type", "login"}, {"username", user}, {"password", "x"}}, ReadOnly},
+        {"get_ads",            QJsonObject{{"type", "get_ads"}, {"status", "Approved"}}, ReadOnly},
+        {"get_ad_image",       QJsonObject{{"type", "get_ad_image"}, {"ad_id", 1}}, ReadOnly},
+        {"get_cart",           QJsonObject{{"type", "get_cart"}, {"username", user}}, ReadOnly},
+        {"get_wallet",         QJsonObject{{"type", "get_wallet"}, {"username", user}}, ReadOnly},
+        {"get_transactions",   QJsonObject{{"type", "get_transactions"}, {"username", user}}, ReadOnly},
+        {"mainmenu_init",      QJsonObject{{"type", "mainmenu_init"}, {"username", user}}, ReadOnly},
+        {"get_profile",        QJsonObject{{"type", "get_profile"}, {"username", user}}, ReadOnly},
+        {"get_user_ads",       QJsonObject{{"type", "get_user_ads"}, {"username", user}}, ReadOnly},
+        {"get_user_purchases", QJsonObject{{"type", "get_user_purchases"}, {"username", user}}, ReadOnly},
+        {"get_user_sales",     QJsonObject{{"type", "get_user_sales"}, {"username", user}}, ReadOnly},
+        {"get_pending_ads",    QJsonObject{{"type", "get_pending_ads"}}, ReadOnly},
+        {"get_approved_ads",   QJsonObject{{"type", "get_approved_ads"}}, ReadOnly},
+        {"get_rejected_ads",   QJsonObject{{"type", "get_rejected_ads"}}, ReadOnly},
+        {"get_admin_stats",    QJsonObject{{"type", "get_admin_stats"}}, ReadOnly},
+        {"get_metrics",        QJsonObject{{"type", "get_metrics"}}, ReadOnly},
+        {"add_to_cart",        QJsonObject{{"type", "add_to_cart"}, {"username", user}, {"ad_id", 2}}, Undone},
+        {"remove_from_cart",   QJsonObject{{"type", "remove_from_cart"}, {"username", user}, {"ad_id", 2}}, Undone},
+        {"approve_ad",         QJsonObject{{"type", "approve_ad"}, {"ad_id", 1}}, Undone},
+        {"reject_ad",          QJsonObject{{"type", "reject_ad"}, {"ad_id", 1}}, Undone},
+        {"begin_upload",       QJsonObject{{"type", "begin_upload"}, {"username", user}, {"size", UPLOAD_BYTES}}, Undone},
+        {"upload_chunk",       QJsonObject{{"type", "upload_chunk"}, {"username", user}}, Undone},
+        {"commit_upload",      QJsonObject{{"type", "commit_upload"}, {"username", user}}, Undone},
+        {"signup",             QJsonObject{{"type", "signup"}, {"password", "x"}, {"name", "Bench"},
+                                           {"email", "signup@bench.local"}, {"phone", "09000000000"}}, Appends},
+        {"add_ad",             QJsonObject{{"type", "add_ad"}, {"username", user}, {"title", "Bench ad"},
+                                           {"description", "Benchmark listing"}, {"price", 10.0},
+                                           {"category", "Other"}}, Appends},
+        {"purchase_cart",      QJsonObject{{"type", "purchase_cart"}, {"username", BUYER}}, Appends},
+        {"wallet_deposit",     QJsonObject{{"type", "wallet_deposit"}, {"username", user}, {"amount", 1.0}}, Appends},
+        {"wallet_withdraw",    QJsonObject{{"type", "wallet_withdraw"}, {"username", user}, {"amount", 1.0}}, Appends},
+    };
+
+    for (int rows : BENCH_SIZES) {
+        if (rows > maxRows())
+            continue;
+        for (const auto &r : requests)
+            QTest::newRow(QByteArray(r.name + "/" + QByteArray::number(rows)).constData())
+                << rows << r.request << int(r.kind);
+    }
+}
+
+// Read-only requests run under QBENCHMARK. Mutating ones are timed one
+// call at a time so the setup and undo around each call stay out of the
+// number: Undone requests always see the populated tables, and Appends
+// requests see them plus at most MUTATION_ITERATIONS rows of their own.
+void DatabaseBench::handleRequest()
+{
+    QFETCH(int, rows);
+    QFETCH(QJsonObject, request);
+    QFETCH(int, kind);
+    populate(rows);
+
+    JsonHandler handler;
+    if (kind == ReadOnly) {
+        // Row replies are measured the way the server produces them.
+        if (handler.writesReply(request.value("type").toString())) {
+            JsonWriter out;
+            QBENCHMARK {
+                out.clear();
+                handler.writeReply(request, out);
+                QVERIFY(!out.data().isEmpty());
+            }
+            return;
+        }
+        QBENCHMARK {
+            QJsonObject res = handler.handleRequest(request);
+            QVERIFY(!res.isEmpty());
+        }
+        return;
+    }
+
+    qint64 totalNs = 0;
+    for (int i = 0; i < MUTATION_ITERATIONS; ++i) {
+        const QJsonObject req = prepareRequest(request);
+        QElapsedTimer timer;
+        timer.start();
+        const QJsonObject res = handler.handleRequest(req);
+        totalNs += timer.nsecsElapsed();
+        QVERIFY2(res.value("success").toBool(), qPrintable(res.value("message").toString()));
+        undoRequest(req, res);
+    }
+    QTest::setBenchmarkResult(totalNs / 1e6 / MUTATION_ITERATIONS, QTest::WalltimeMilliseconds);
+
+    if (kind == Appends)
+        populatedRows = -1;
+}
+
+// Request lines parsed the way ServerCore parses them, by RequestScanner
+// and, for comparison, by QJsonDocument alone.
+void DatabaseBench::parseRequest_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<bool>("scanner");
+
+    const QByteArray chunk = QByteArray(UPLOAD_BYTES, 'x').toBase64();
+    const struct { QByteArray name; QByteArray line; } lines[] = {
+        {"get_cart",     R"({"type":"get_cart","username":"user0"})"},
+        {"get_ads",      R"({"if_none_match":"42-0123456789abcdef","limit":50,"offset":100,"status":"Approved","type":"get_ads"})"},
+        {"add_to_cart",  R"({"ad_id":12345,"type":"add_to_cart","username":"user0"})"},
+        {"upload_chunk", R"({"data":")" + chunk + R"(","offset":0,"type":"upload_chunk","upload_id":"u1","username":"user0"})"},
+    };
+    for (const auto &l : lines) {
+        QTest::newRow(QByteArray(l.name + "/scanner").constData()) << l.line << true;
+        QTest::newRow(QByteArray(l.name + "/QJsonDocument").constData()) << l.line << false;
+    }
+}
+
+void DatabaseBench::parseRequest()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(bool, scanner);
+
+    if (scanner) {
+        QBENCHMARK {
+            QJsonObject req;
+            QVERIFY(RequestScanner::scan(line, &req));
+        }
+        return;
+    }
+    QBENCHMARK {
+        const QJsonObject req = QJsonDocument::fromJson(line).object();
+        QVERIFY(!req.isEmpty());
+    }
+}
+
+// Everything a timed call needs that is not the call itself.
+QJsonObject DatabaseBench::prepareRequest(QJsonObject req)
+{
+    Database &db = Database::instance();
+    const QString type = req.value("type").toString();
+    const QString user = req.value("username").toString();
+
+    if (type == "signup") {
+        req["username"] = QString("signup%1").arg(serial++);
+    } else if (type == "remove_from_cart") {
+        db.addToCart(user, req.value("ad_id").toInt());
+    } else if (type == "upload_chunk") {
+        req["upload_id"] = startUpload(user, false);
+        req["offset"] = 0;
+        req["data"] = QString::fromLatin1(QByteArray(UPLOAD_BYTES, 'x').toBase64());
+    } else if (type == "commit_upload") {
+        req["upload_id"] = startUpload(user, true);
+    } else if (type == "purchase_cart") {
+        if (!db.userExists(BUYER)) {
+            User u;
+            u.username = BUYER;
+            u.passwordHash = "x";
+            u.adsCount = 0;
+            u.purchasesCount = 0;
+            u.salesCount = 0;
+            u.isAdmin = false;
+            db.addUser(u);
+            Money balance = 0;
+            db.deposit(BUYER, toMinorUnits(1e9), &balance);
+        }
+        Ad a;
+        a.id = 0;
+        a.owner = db.intern(userName(0));
+        a.category = db.intern(CATEGORIES[0]);
+        a.title = "Bench purchase";
+        a.price = 10.0;
+        a.status = AdStatus::Approved;
+        db.addToCart(BUYER, db.addAd(a));
+    }
+    return req;
+}
+
+void DatabaseBench::undoRequest(const QJsonObject &req, const QJsonObject &res)
+{
+    Database &db = Database::instance();
+    const QString type = req.value("type").toString();
+    const QString user = req.value("username").toString();
+    QString error;
+
+    if (type == "add_to_cart") {
+        db.removeFromCart(user, req.value("ad_id").toInt());
+    } else if (type == "approve_ad" || type == "reject_ad") {
+        db.updateAdStatus(req.value("ad_id").toInt(), AdStatus::Pending);
+    } else if (type == "begin_upload" || type == "upload_chunk") {
+        // Finish the upload; the blob is content-addressed, so the store
+        // keeps a single copy however often this runs.
+        const QString id = res.value("upload_id").toString();
+        qint64 received = 0;
+        if (type == "begin_upload")
+            BlobStore::instance().appendChunk(id, user, 0, QByteArray(UPLOAD_BYTES, 'x'),
+                                              &received, &error);
+        BlobStore::instance().commitUpload(id, user, QString(), &error);
+    }
+}
+
+QString DatabaseBench::startUpload(const QString &user, bool withData)
+{
+    BlobStore &store = BlobStore::instance();
+    qint64 received = 0;
+    QString error;
+    const QString id = store.beginUpload(user, UPLOAD_BYTES, QString(), &received, &error);
+    if (withData)
+        store.appendChunk(id, user, 0, QByteArray(UPLOAD_BYTES, 'x'), &received, &error);
+    return id;
+}
+
+QTEST_GUILESS_MAIN(DatabaseBench)
+
+#include "databasebench.moc"
@@ -0,0 +1,323 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "database.h"
+#include "jsonhandler.h"
+
+// The money path: purchases apply as a whole or not at all, a repeated
+// idempotency key replays the first reply, the ledger stays balanced, and
+// files from before the ledger migrate into it.
+
+namespace {
+const QString SELLER = "seller";
+const QString BUYER = "buyer";
+
+void addUser(const QString &username)
+{
+    User u;
+    u.username = username;
+    u.passwordHash = "x";
+    u.name = username;
+    u.adsCount = 0;
+    u.purchasesCount = 0;
+    u.salesCount = 0;
+    u.isAdmin = false;
+    Database::instance().addUser(u);
+}
+
+int addAd(const QString &owner, double price, AdStatus status = AdStatus::Approved)
+{
+    Database &db = Database::instance();
+    Ad a;
+    a.id = 0;
+    a.owner = db.intern(owner);
+    a.category = db.intern("Other");
+    a.title = QString("Ad for %1").arg(price);
+    a.price = price;
+    a.status = status;
+    return db.addAd(a);
+}
+
+void deposit(const QString &username, double amount)
+{
+    Money balance = 0;
+    QVERIFY(Database::instance().deposit(username, toMinorUnits(amount), &balance));
+}
+
+QStringList audit()
+{
+    return Ledger::audit(Database::instance().ledgerSnapshot());
+}
+}
+
+class DatabaseTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void purchaseMovesMoney();
+    void purchaseIsAllOrNothing();
+    void purchaseSkipsUnavailableAds();
+    void repeatedIdempotencyKeyReplays();
+    void repeatedIdempotencyKeyReplaysReply();
+    void ledgerSurvivesSaveAndLoad();
+    void legacyWalletMigrates();
+    void reservedUsernamesRejected();
+
+private:
+    QTemporaryDir tmp;
+};
+
+void DatabaseTest::init()
+{
+    Database::instance().clear();
+    addUser(SELLER);
+    addUser(BUYER);
+}
+
+void DatabaseTest::purchaseMovesMoney()
+{
+    Database &db = Database::instance();
+    const int a = addAd(SELLER, 10.25);
+    const int b = addAd(SELLER, 4.75);
+    db.addToCart(BUYER, a);
+    db.addToCart(BUYER, b);
+    deposit(BUYER, 20.0);
+
+    const PurchaseResult r = db.purchaseCart(BUYER, QString());
+    QCOMPARE(r.status, PurchaseResult::Status::Ok);
+    QCOMPARE(r.total, toMinorUnits(15.0));
+    QCOMPARE(r.adIds, QList<int>({a, b}));
+    QCOMPARE(r.newBalance, toMinorUnits(5.0));
+
+    QCOMPARE(db.balance(BUYER), toMinorUnits(5.0));
+    QCOMPARE(db.balance(SELLER), toMinorUnits(15.0));
+    QCOMPARE(db.findAd(a)->status, AdStatus::Sold);
+    QCOMPARE(db.findAd(b)->status, AdStatus::Sold);
+    QVERIFY(db.getCart(BUYER).isEmpty());
+    QCOMPARE(db.getPurchases(BUYER).size(), 2);
+    QCOMPARE(db.getSales(SELLER).size(), 2);
+    QCOMPARE(db.findUser(BUYER)->purchasesCount, 2);
+    QCOMPARE(db.findUser(SELLER)->salesCount, 2);
+    QCOMPARE(db.adCount(AdStatus::Approved), 0);
+    QCOMPARE(db.adCount(AdStatus::Sold), 2);
+    QCOMPARE(db.getAdminStats().gmv, toMinorUnits(15.0));
+    QVERIFY2(audit().isEmpty(), qPrintable(audit().join("; ")));
+}
+
+void DatabaseTest::purchaseIsAllOrNothing()
+{
+    Database &db = Database::instance();
+    const int a = addAd(SELLER, 10.0);
+    const int b = addAd(SELLER, 10.0);
+    db.addToCart(BUYER, a);
+    db.addToCart(BUYER, b);
+    deposit(BUYER, 15.0);
+
+    const qint64 version = db.catalogVersion();
+    const int entries = db.transactionCount(BUYER);
+
+    const PurchaseResult r = db.purchaseCart(BUYER, "k1");
+    QCOMPARE(r.status, PurchaseResult::Status::InsufficientBalance);
+
+    // Not even the ad the balance would have covered was bought.
+    QCOMPARE(db.balance(BUYER), toMinorUnits(15.0));
+    QCOMPARE(db.balance(SELLER), Money(0));
+    QCOMPARE(db.findAd(a)->status, AdStatus::Approved);
+    QCOMPARE(db.findAd(b)->status, AdStatus::Approved);
+    QCOMPARE(db.getCart(BUYER), QList<int>({a, b}));
+    QVERIFY(db.getPurchases(BUYER).isEmpty());
+    QCOMPARE(db.findUser(BUYER)->purchasesCount, 0);
+    QCOMPARE(db.catalogVersion(), version);
+    QCOMPARE(db.transactionCount(BUYER), entries);
+    QVERIFY(audit().isEmpty());
+
+    // A failed attempt is not remembered: the same key works once the
+    // balance is there.
+    deposit(BUYER, 5.0);
+    QCOMPARE(db.purchaseCart(BUYER, "k1").status, PurchaseResult::Status::Ok);
+    QCOMPARE(db.balance(BUYER), Money(0));
+}
+
+void DatabaseTest::purchaseSkipsUnavailableAds()
+{
+    Database &db = Database::instance();
+    const int ok = addAd(SELLER, 3.0);
+    const int pending = addAd(SELLER, 3.0, AdStatus::Pending);
+    const int own = addAd(BUYER, 3.0);
+    db.addToCart(BUYER, ok);
+    db.addToCart(BUYER, ok);
+    db.addToCart(BUYER, pending);
+    db.addToCart(BUYER, own);
+    db.addToCart(BUYER, 999);
+    deposit(BUYER, 10.0);
+
+    const PurchaseResult r = db.purchaseCart(BUYER, QString());
+    QCOMPARE(r.status, PurchaseResult::Status::Ok);
+    QCOMPARE(r.adIds, QList<int>({ok}));
+    QCOMPARE(db.balance(BUYER), toMinorUnits(7.0));
+    QCOMPARE(db.findAd(pending)->status, AdStatus::Pending);
+    QCOMPARE(db.findAd(own)->status, AdStatus::Approved);
+
+    // Nothing left that can be bought.
+    db.addToCart(BUYER, own);
+    QCOMPARE(db.purchaseCart(BUYER, QString()).status, PurchaseResult::Status::CartEmpty);
+    QCOMPARE(db.purchaseCart("nobody", QString()).status, PurchaseResult::Status::UserNotFound);
+    QVERIFY(audit().isEmpty());
+}
+
+void DatabaseTest::repeatedIdempotencyKeyReplays()
+{
+    Database &db = Database::instance();
+    const int a = addAd(SELLER, 5.0);
+    const int b = addAd(SELLER, 6.0);
+    db.addToCart(BUYER, a);
+    deposit(BUYER, 20.0);
+
+    const PurchaseResult first = db.purchaseCart(BUYER, "retry-1");
+    QCOMPARE(first.status, PurchaseResult::Status::Ok);
+
+    // A retry after a lost reply must not buy what is in the cart now.
+    db.addToCart(BUYER, b);
+    const PurchaseResult again = db.purchaseCart(BUYER, "retry-1");
+    QCOMPARE(again.status, first.status);
+    QCOMPARE(again.adIds, first.adIds);
+    QCOMPARE(again.total, first.total);
+    QCOMPARE(again.newBalance, first.newBalance);
+    QCOMPARE(db.balance(BUYER), toMinorUnits(15.0));
+    QCOMPARE(db.findAd(b)->status, AdStatus::Approved);
+    QCOMPARE(db.getCart(BUYER), QList<int>({b}));
+
+    // Keys belong to one user.
+    addUser("other");
+    db.addToCart("other", b);
+    deposit("other", 10.0);
+    QCOMPARE(db.purchaseCart("other", "retry-1").adIds, QList<int>({b}));
+
+    // A new key is a new purchase.
+    db.addToCart(BUYER, addAd(SELLER, 1.0));
+    QCOMPARE(db.purchaseCart(BUYER, "retry-2").status, PurchaseResult::Status::Ok);
+    QCOMPARE(db.balance(BUYER), toMinorUnits(14.0));
+    QVERIFY(audit().isEmpty());
+}
+
+void DatabaseTest::repeatedIdempotencyKeyReplaysReply()
+{
+    Database &db = Database::instance();
+    db.addToCart(BUYER, addAd(SELLER, 2.5));
+    deposit(BUYER, 10.0);
+
+    JsonHandler handler;
+    const QJsonObject req{{"type", "purchase_cart"}, {"username", BUYER},
+                          {"idempotency_key", "reply-1"}};
+    const QJsonObject first = handler.handleRequest(req);
+    QVERIFY(first.value("success").toBool());
+
+    db.addToCart(BUYER, addAd(SELLER, 1.0));
+    QCOMPARE(handler.handleRequest(req), first);
+    QCOMPARE(db.balance(BUYER), toMinorUnits(7.5));
+}
+
+void DatabaseTest::ledgerSurvivesSaveAndLoad()
+{
+    Database &db = Database::instance();
+    db.addToCart(BUYER, addAd(SELLER, 12.34));
+    deposit(BUYER, 50.0);
+    Money balance = 0;
+    QVERIFY(db.withdraw(BUYER, toMinorUnits(0.66), &balance));
+    QVERIFY(!db.withdraw(BUYER, toMinorUnits(1000.0), &balance));
+    QCOMPARE(db.purchaseCart(BUYER, QString()).status, PurchaseResult::Status::Ok);
+
+    const Money buyerBalance = db.balance(BUYER);
+    const Money sellerBalance = db.balance(SELLER);
+    const QList<Transaction> history = db.getTransactions(BUYER);
+
+    const QString path = tmp.filePath("ledger.json");
+    db.saveToFile(path);
+    QString error;
+    QVERIFY2(db.loadFromFile(path, &error), qPrintable(error));
+
+    QCOMPARE(db.balance(BUYER), buyerBalance);
+    QCOMPARE(db.balance(SELLER), sellerBalance);
+    QCOMPARE(db.getTransactions(BUYER).size(), history.size());
+    QCOMPARE(db.getTransactions(BUYER).last().amount, history.last().amount);
+    QVERIFY(audit().isEmpty());
+}
+
+// A file from before the ledger: balances as walletBalance and a list of
+// signed transactions. Each transaction becomes a posting against the
+// external account, and a balance the list does not explain becomes an
+// opening balance posting.
+void DatabaseTest::legacyWalletMigrates()
+{
+    auto user = [](const QString &name, double wallet) {
+        return QJsonObject{{"username", name}, {"passwordHash", "x"}, {"walletBalance", wallet}};
+    };
+    auto transaction = [](const QString &name, const QString &type, double amount) {
+        return QJsonObject{{"username", name}, {"type", type}, {"amount", amount},
+                           {"description", type}, {"timestamp", "2025-01-01 10:00:00"}};
+    };
+
+    QJsonObject root;
+    root["users"] = QJsonArray{user("alice", 50.5), user("bob", 12.0), user("carol", 5.0)};
+    root["transactions"] = QJsonArray{
+        transaction("alice", "deposit", 30.0),
+        transaction("alice", "withdraw", -10.0),
+        transaction("bob", "deposit", 12.0),
+        transaction("carol", "deposit", 8.0),
+        transaction("carol", "deposit", 0.0),
+    };
+
+    const QString path = tmp.filePath("legacy.json");
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(QJsonDocument(root).toJson());
+    file.close();
+
+    Database &db = Database::instance();
+    QString error;
+    QVERIFY2(db.loadFromFile(path, &error), qPrintable(error));
+
+    QCOMPARE(db.balance("alice"), toMinorUnits(50.5));
+    QCOMPARE(db.balance("bob"), toMinorUnits(12.0));
+    QCOMPARE(db.balance("carol"), toMinorUnits(5.0));
+
+    // alice: two postings and an opening balance of 30.50.
+    const QList<Transaction> alice = db.getTransactions("alice");
+    QCOMPARE(alice.size(), 3);
+    QCOMPARE(alice.at(0).type, TransactionType::Deposit);
+    QCOMPARE(alice.at(1).type, TransactionType::Withdraw);
+    QCOMPARE(alice.at(2).description, QString("Opening balance"));
+    // bob: the list explains the balance, so nothing is added.
+    QCOMPARE(db.transactionCount("bob"), 1);
+    // carol: the zero amount is dropped and the surplus taken back out.
+    const QList<Transaction> carol = db.getTransactions("carol");
+    QCOMPARE(carol.size(), 2);
+    QCOMPARE(carol.at(1).type, TransactionType::Withdraw);
+    QVERIFY2(audit().isEmpty(), qPrintable(audit().join("; ")));
+
+    // Once saved, the file carries the ledger and loads the same way.
+    db.saveToFile(path);
+    QVERIFY(db.loadFromFile(path, &error));
+    QCOMPARE(db.balance("alice"), toMinorUnits(50.5));
+    QCOMPARE(db.transactionCount("alice"), 3);
+}
+
+void DatabaseTest::reservedUsernamesRejected()
+{
+    JsonHandler handler;
+    const QJsonObject res = handler.handleRequest(
+        QJsonObject{{"type", "signup"}, {"username", Ledger::ExternalAccount}, {"password", "x"},
+                    {"name", "x"}, {"email", "x@test.local"}, {"phone", "0"}});
+    QVERIFY(!res.value("success").toBool());
+    QVERIFY(!Database::instance().userExists(Ledger::ExternalAccount));
+    QVERIFY(Ledger::isReservedAccount("@anything"));
+    QVERIFY(!Ledger::isReservedAccount("user@example"));
+}
+
+QTEST_GUILESS_MAIN(DatabaseTest)
+
+#include "databasetest.moc"
@@ -0,0 +1,82 @@
+#include "imagecompressor.h"
+#include <QImageReader>
+#include <QImageWriter>
+#include <QImage>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QPainter>
+
+namespace {
+const QByteArray FALLBACK_FORMAT = "jpg";
+
+bool encode(const QImage &image, const QByteArray &format, int quality,
+            QByteArray *out, QString *error)
+{
+    QBuffer buffer(out);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, format);
+    writer.setQuality(qBound(0, quality, 100));
+    writer.setOptimizedWrite(true);
+    if (writer.write(image))
+        return true;
+    *error = writer.errorString();
+    out->clear();
+    return false;
+}
+}
+
+ImageCompressor::Result ImageCompressor::compress(const QString &path, const Options &options)
+{
+    Result r;
+    r.originalBytes = QFileInfo(path).size();
+
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    r.originalSize = reader.size();
+
+    // Let the decoder scale (JPEG can decode at 1/2, 1/4, 1/8 directly),
+    // which is much cheaper than decoding full size and scaling after.
+    QSize target = r.originalSize;
+    if (target.isValid() && qMax(target.width(), target.height()) > options.maxDimension) {
+        target.scale(options.maxDimension, options.maxDimension, Qt::KeepAspectRatio);
+        // size() and setScaledSize() are both before EXIF rotation, so the
+        // longest side still ends up at maxDimension.
+        reader.setScaledSize(target);
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        r.error = reader.errorString();
+        return r;
+    }
+    if (qMax(image.width(), image.height()) > options.maxDimension)
+        image = image.scaled(options.maxDimension, options.maxDimension,
+                             Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    r.format = options.format.toLower();
+    if (!QImageWriter::supportedImageFormats().contains(r.format))
+        r.format = FALLBACK_FORMAT;
+
+    // Flatten onto white: JPEG has no alpha. Drawing into a fresh image
+    // also leaves behind any text/metadata the decoder attached.
+    QImage clean(image.size(), QImage::Format_RGB32);
+    clean.fill(Qt::white);
+    {
+        QPainter p(&clean);
+        p.drawImage(0, 0, image);
+    }
+    r.size = clean.size();
+
+    if (!encode(clean, r.format, options.quality, &r.data, &r.error))
+        return r;
+
+    const int edge = options.thumbnailDimension;
+    if (edge > 0) {
+        QImage thumb = qMax(clean.width(), clean.height()) > edge
+                       ? clean.scaled(edge, edge, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+                       : clean;
+        if (!encode(thumb, r.format, options.quality, &r.thumbnail, &r.error))
+            r.data.clear();
+    }
+    return r;
+}
@@ -0,0 +1,38 @@
+#ifndef IMAGECOMPRESSOR_H
+#define IMAGECOMPRESSOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QSize>
+
+// Decodes an image file, applies its EXIF orientation, scales it down to
+// fit maxDimension and re-encodes it, plus a thumbnail that fits
+// thumbnailDimension for list views. The output carries no metadata
+// (EXIF, comments, text chunks). compress() is reentrant and meant to be
+// run on a worker thread via QtConcurrent.
+class ImageCompressor
+{
+public:
+    struct Options {
+        int maxDimension = 1280;
+        int thumbnailDimension = 96;    // 0 skips the thumbnail
+        int quality = 80;               // 0-100
+        // JPEG decodes everywhere; formats that need an optional plugin
+        // (webp) would leave other clients unable to show the image.
+        QByteArray format = "jpg";      // falls back to jpg if unsupported
+    };
+
+    struct Result {
+        QByteArray data;
+        QByteArray thumbnail;
+        QByteArray format;
+        QSize originalSize;
+        QSize size;
+        qint64 originalBytes = 0;
+        QString error;
+    };
+
+    static Result compress(const QString &path, const Options &options);
+};
+
+#endif
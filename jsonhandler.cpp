@@ -1,9 +1,91 @@
 #include "jsonhandler.h"
 #include "database.h"
+#include "metrics.h"
+#include "blobstore.h"
+#include "jsonwriter.h"
 #include <QJsonArray>
 #include <QCryptographicHash>
 #include <QDateTime>
 
+namespace {
+// Rows of the written replies. Keys must stay in sorted order, see
+// JsonWriter.
+
+void writeAd(JsonWriter &out, const Ad &a, const Database &db)
+{
+    out.beginObject();
+    out.field("category", db.str(a.category));
+    out.field("created_at", a.createdAt);
+    out.field("description", a.description);
+    out.field("has_image", !a.imageBlobId.isEmpty() || !a.imageBase64.isEmpty());
+    out.field("id", a.id);
+    if (!a.imageBlobId.isEmpty())
+        out.field("image_blob", a.imageBlobId);
+    out.field("owner", db.str(a.owner));
+    out.field("price", a.price);
+    out.field("status", adStatusToString(a.status));
+    out.field("title", a.title);
+    out.field("updated_at", a.updatedAt);
+    out.endObject();
+}
+
+// Admin listings and cart items.
+void writeAdSummary(JsonWriter &out, const Ad &a, const Database &db)
+{
+    out.beginObject();
+    out.field("category", db.str(a.category));
+    out.field("id", a.id);
+    out.field("owner", db.str(a.owner));
+    out.field("price", a.price);
+    out.field("title", a.title);
+    out.endObject();
+}
+
+// A user's own ads, so no owner but the status.
+void writeUserAd(JsonWriter &out, const Ad &a, const Database &db)
+{
+    out.beginObject();
+    out.field("category", db.str(a.category));
+    out.field("id", a.id);
+    out.field("price", a.price);
+    out.field("status", adStatusToString(a.status));
+    out.field("title", a.title);
+    out.endObject();
+}
+
+void writeTransaction(JsonWriter &out, const Transaction &t)
+{
+    out.beginObject();
+    out.field("amount", fromMinorUnits(t.amount));
+    out.field("description", t.description);
+    out.field("related_ad_id", t.relatedAdId);
+    out.field("related_ad_title", t.relatedAdTitle);
+    out.field("timestamp", t.timestamp);
+    out.field("type", transactionTypeToString(t.type));
+    out.endObject();
+}
+
+void writePurchase(JsonWriter &out, const PurchaseRecord &p)
+{
+    out.beginObject();
+    out.field("date", p.date);
+    out.field("price", p.price);
+    out.field("seller", p.seller);
+    out.field("title", p.title);
+    out.endObject();
+}
+
+void writeSale(JsonWriter &out, const PurchaseRecord &p)
+{
+    out.beginObject();
+    out.field("buyer", p.buyer);
+    out.field("date", p.date);
+    out.field("price", p.price);
+    out.field("title", p.title);
+    out.endObject();
+}
+}
+
 JsonHandler::JsonHandler()
 {
 }
@@ -20,36 +102,68 @@ QString JsonHandler::now() const
     return QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
 }
 
+JsonHandler::ReplyWriter JsonHandler::replyWriter(const QString &type) const
+{
+    if (type == "get_ads") return &JsonHandler::writeGetAds;
+    if (type == "get_cart") return &JsonHandler::writeGetCart;
+    if (type == "get_transactions") return &JsonHandler::writeGetTransactions;
+    if (type == "get_profile") return &JsonHandler::writeGetProfile;
+    if (type == "get_user_ads") return &JsonHandler::writeGetUserAds;
+    if (type == "get_user_purchases") return &JsonHandler::writeGetUserPurchases;
+    if (type == "get_user_sales") return &JsonHandler::writeGetUserSales;
+    if (type == "get_pending_ads") return &JsonHandler::writeGetPendingAds;
+    if (type == "get_approved_ads") return &JsonHandler::writeGetApprovedAds;
+    if (type == "get_rejected_ads") return &JsonHandler::writeGetRejectedAds;
+    return nullptr;
+}
+
+bool JsonHandler::writesReply(const QString &type) const
+{
+    return replyWriter(type) != nullptr;
+}
+
+void JsonHandler::writeReply(const QJsonObject &req, JsonWriter &out)
+{
+    ReplyWriter writer = replyWriter(req.value("type").toString());
+    if (writer)
+        (this->*writer)(req, out);
+    else
+        out.rawValue(QJsonDocument(handleRequest(req)).toJson(QJsonDocument::Compact));
+}
+
 QJsonObject JsonHandler::handleRequest(const QJsonObject &req)
 {
     QString type = req.value("type").toString();
+    if (ReplyWriter writer = replyWriter(type)) {
+        JsonWriter out;
+        (this->*writer)(req, out);
+        return QJsonDocument::fromJson(out.data()).object();
+    }
+
     if (type == "login") return handleLogin(req);
     if (type == "signup") return handleSignup(req);
 
     if (type == "add_ad") return handleAddAd(req);
-    if (type == "get_ads") return handleGetAds(req);
+    if (type == "get_ad_image") return handleGetAdImage(req);
+
+    if (type == "begin_upload") return handleBeginUpload(req);
+    if (type == "upload_chunk") return handleUploadChunk(req);
+    if (type == "commit_upload") return handleCommitUpload(req);
 
     if (type == "add_to_cart") return handleAddToCart(req);
-    if (type == "get_cart") return handleGetCart(req);
     if (type == "remove_from_cart") return handleRemoveFromCart(req);
     if (type == "purchase_cart") return handlePurchaseCart(req);
 
     if (type == "get_wallet") return handleGetWallet(req);
     if (type == "wallet_deposit") return handleWalletDeposit(req);
     if (type == "wallet_withdraw") return handleWalletWithdraw(req);
-    if (type == "get_transactions") return handleGetTransactions(req);
 
-    if (type == "get_profile") return handleGetProfile(req);
-    if (type == "get_user_ads") return handleGetUserAds(req);
-    if (type == "get_user_purchases") return handleGetUserPurchases(req);
-    if (type == "get_user_sales") return handleGetUserSales(req);
+    if (type == "mainmenu_init") return handleMainMenuInit(req);
 
-    if (type == "get_pending_ads") return handleGetPendingAds(req);
-    if (type == "get_approved_ads") return handleGetApprovedAds(req);
-    if (type == "get_rejected_ads") return handleGetRejectedAds(req);
     if (type == "approve_ad") return handleApproveAd(req);
     if (type == "reject_ad") return handleRejectAd(req);
     if (type == "get_admin_stats") return handleGetAdminStats(req);
+    if (type == "get_metrics") return handleGetMetrics(req);
 
     QJsonObject res;
     res["type"] = "error";
@@ -73,10 +187,9 @@ QJsonObject JsonHandler::handleLogin(const QJsonObject &req)
         return res;
     }
 
-    User u = db.getUser(username);
     res["success"] = true;
     res["message"] = "Login successful";
-    res["is_admin"] = u.isAdmin;
+    res["is_admin"] = db.findUser(username)->isAdmin;
     return res;
 }
 
@@ -91,6 +204,12 @@ QJsonObject JsonHandler::handleSignup(const QJsonObject &req)
     QString email    = req.value("email").toString();
     QString phone    = req.value("phone").toString();
 
+    if (Ledger::isReservedAccount(username)) {
+        res["success"] = false;
+        res["message"] = "Username may not start with '@'";
+        return res;
+    }
+
     Database &db = Database::instance();
     if (db.userExists(username)) {
         res["success"] = false;
@@ -105,7 +224,6 @@ QJsonObject JsonHandler::handleSignup(const QJsonObject &req)
     u.email = email;
     u.phone = phone;
     u.joinDate = now();
-    u.walletBalance = 0.0;
     u.adsCount = 0;
     u.purchasesCount = 0;
     u.salesCount = 0;
@@ -128,7 +246,8 @@ QJsonObject JsonHandler::handleAddAd(const QJsonObject &req)
     QString description= req.value("description").toString();
     double price       = req.value("price").toDouble();
     QString category   = req.value("category").toString();
-    QString imageBase64= req.value("image_base64").toString();
+    QString imageBlob  = req.value("image_blob").toString();
+    QString thumbBlob  = req.value("thumbnail_blob").toString();
 
     Database &db = Database::instance();
     if (!db.userExists(username)) {
@@ -137,23 +256,41 @@ QJsonObject JsonHandler::handleAddAd(const QJsonObject &req)
         return res;
     }
 
+    // Images arrive through begin_upload/upload_chunk only, so no request
+    // line has to hold a whole photo.
+    if (req.contains("image_base64")) {
+        res["success"] = false;
+        res["message"] = "Inline images are not accepted; upload the image first";
+        return res;
+    }
+
+    if ((!imageBlob.isEmpty() && !BlobStore::instance().exists(imageBlob))
+        || (!thumbBlob.isEmpty() && !BlobStore::instance().exists(thumbBlob))) {
+        res["success"] = false;
+        res["message"] = "Image upload not found";
+        return res;
+    }
+
     Ad ad;
     ad.id = 0;
-    ad.owner = username;
+    ad.owner = db.intern(username);
     ad.title = title;
     ad.description = description;
     ad.price = price;
-    ad.category = category;
-    ad.status = "Pending";
-    ad.imageBase64 = imageBase64;
+    ad.category = db.intern(category);
+    ad.status = AdStatus::Pending;
+    ad.imageBlobId = imageBlob;
+    ad.thumbnailBlobId = thumbBlob;
     ad.createdAt = now();
     ad.updatedAt = ad.createdAt;
 
     int id = db.addAd(ad);
+    if (!imageBlob.isEmpty())
+        BlobStore::instance().claim(imageBlob);
+    if (!thumbBlob.isEmpty())
+        BlobStore::instance().claim(thumbBlob);
 
-    User u = db.getUser(username);
-    u.adsCount += 1;
-    db.updateUser(u);
+    db.updateUser(username, [](User &u) { u.adsCount += 1; });
 
     res["success"] = true;
     res["message"] = "Ad submitted";
@@ -161,33 +298,233 @@ QJsonObject JsonHandler::handleAddAd(const QJsonObject &req)
     return res;
 }
 
-QJsonObject JsonHandler::handleGetAds(const QJsonObject &req)
+QString JsonHandler::etag(const QJsonObject &req) const
+{
+    Database &db = Database::instance();
+    const QString type = req.value("type").toString();
+
+    QString versions;
+    if (type == "get_ads" || type == "get_pending_ads"
+        || type == "get_approved_ads" || type == "get_rejected_ads") {
+        versions = QString::number(db.catalogVersion());
+    } else if (type == "get_cart") {
+        // Titles, prices and availability come from the ads, so the
+        // catalog version is part of the tag too.
+        versions = QString("%1.%2").arg(db.catalogVersion())
+                                   .arg(db.cartVersion(req.value("username").toString()));
+    } else if (type == "get_transactions") {
+        versions = QString::number(db.walletVersion(req.value("username").toString()));
+    } else {
+        return QString();
+    }
+
+    QJsonObject params = req;
+    params.remove("if_none_match");
+
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    h.addData(db.catalogEpoch().toUtf8());
+    h.addData(QJsonDocument(params).toJson(QJsonDocument::Compact));
+    return versions + QLatin1Char('-') + QString::fromLatin1(h.result().toHex().left(16));
+}
+
+void JsonHandler::writeNotModified(JsonWriter &out, const QString &type, const QString &etag) const
+{
+    out.beginObject();
+    out.field("etag", etag);
+    out.field("not_modified", true);
+    out.field("type", type);
+    out.endObject();
+}
+
+// With since_version and a matching catalog_epoch the reply is a delta:
+// "ads" holds the listed ads changed after that version and "removed" the
+// ids of changed ads that left the listing. Otherwise it is a (paged)
+// full listing, by after_id (ads with a larger id) or by offset. Either
+// way catalog_version is the version to ask from next time.
+void JsonHandler::writeGetAds(const QJsonObject &req, JsonWriter &out)
+{
+    AdStatus status;
+    if (!adStatusFromString(req.value("status").toString("Approved"), &status)) {
+        out.beginObject();
+        out.key("ads");
+        out.beginArray();
+        out.endArray();
+        out.field("type", "get_ads_response");
+        out.endObject();
+        return;
+    }
+
+    Database &db = Database::instance();
+    // Read before listing: a change racing with the listing is then sent
+    // again in the next delta rather than missed.
+    const qint64 version = db.catalogVersion();
+    const QString tag = etag(req);
+    if (req.value("if_none_match").toString() == tag) {
+        writeNotModified(out, "get_ads_response", tag);
+        return;
+    }
+
+    const bool delta = req.contains("since_version")
+                       && req.value("catalog_epoch").toString() == db.catalogEpoch();
+    const bool keyset = !delta && req.contains("after_id");
+    int offset = 0;
+    QList<const Ad *> list;
+    if (delta) {
+        list = db.getAdsChangedSince(qint64(req.value("since_version").toDouble()));
+    } else if (keyset) {
+        list = db.getAdsByStatusAfter(status, req.value("after_id").toInt(),
+                                      req.value("limit").toInt(-1));
+    } else {
+        offset = req.value("offset").toInt(0);
+        list = db.getAdsByStatus(status, offset, req.value("limit").toInt(-1));
+    }
+
+    out.beginObject();
+    out.key("ads");
+    out.beginArray();
+    for (const Ad *ap : list)
+        if (ap->status == status)
+            writeAd(out, *ap, db);
+    out.endArray();
+    if (keyset)
+        out.field("after_id", req.value("after_id").toInt());
+    out.field("catalog_epoch", db.catalogEpoch());
+    out.field("catalog_version", version);
+    if (delta)
+        out.field("delta", true);
+    out.field("etag", tag);
+    if (delta) {
+        out.key("removed");
+        out.beginArray();
+        for (const Ad *ap : list)
+            if (ap->status != status)
+                out.value(ap->id);
+        out.endArray();
+    } else if (!keyset) {
+        out.field("offset", offset);
+    }
+    out.field("total", db.adCount(status));
+    out.field("type", "get_ads_response");
+    out.endObject();
+}
+
+// One ad's image, so clients can fetch images for the rows they show
+// instead of with the listing. updated_at lets them key their caches.
+// With "thumbnail": true the small copy uploaded next to the image is
+// sent where there is one; the reply's "thumbnail" says which was sent.
+QJsonObject JsonHandler::handleGetAdImage(const QJsonObject &req)
 {
     QJsonObject res;
-    res["type"] = "get_ads_response";
+    res["type"] = "get_ad_image_response";
 
-    QString status = req.value("status").toString("Approved");
+    int adId = req.value("ad_id").toInt();
+    res["ad_id"] = adId;
 
     Database &db = Database::instance();
-    QList<Ad> list = db.getAdsByStatus(status);
-
-    QJsonArray arr;
-    for (const auto &a : list) {
-        QJsonObject o;
-        o["id"] = a.id;
-        o["owner"] = a.owner;
-        o["title"] = a.title;
-        o["description"] = a.description;
-        o["price"] = a.price;
-        o["category"] = a.category;
-        o["status"] = a.status;
-        o["image_base64"] = a.imageBase64;
-        o["created_at"] = a.createdAt;
-        o["updated_at"] = a.updatedAt;
-        arr.append(o);
+    const Ad *a = db.findAd(adId);
+    if (!a) {
+        res["success"] = false;
+        res["message"] = "Ad not found";
+        return res;
+    }
+
+    const bool thumbnail = req.value("thumbnail").toBool() && !a->thumbnailBlobId.isEmpty();
+    const QString blobId = thumbnail ? a->thumbnailBlobId : a->imageBlobId;
+
+    QByteArray data;
+    if (!blobId.isEmpty()) {
+        QFile file(BlobStore::instance().blobPath(blobId));
+        if (file.open(QIODevice::ReadOnly))
+            data = file.readAll();
+    } else {
+        data = QByteArray::fromBase64(a->imageBase64.toLatin1());
+    }
+
+    if (data.isEmpty()) {
+        res["success"] = false;
+        res["message"] = "Ad has no image";
+        return res;
+    }
+
+    res["success"] = true;
+    res["thumbnail"] = thumbnail;
+    res["updated_at"] = a->updatedAt;
+    res["image_base64"] = QString::fromLatin1(data.toBase64());
+    return res;
+}
+
+QJsonObject JsonHandler::handleBeginUpload(const QJsonObject &req)
+{
+    QJsonObject res;
+    res["type"] = "begin_upload_response";
+
+    QString username = req.value("username").toString();
+    qint64 size = qint64(req.value("size").toDouble());
+    QString resumeId = req.value("upload_id").toString();
+
+    if (!Database::instance().userExists(username)) {
+        res["success"] = false;
+        res["message"] = "User not found";
+        return res;
+    }
+
+    qint64 received = 0;
+    QString error;
+    QString id = BlobStore::instance().beginUpload(username, size, resumeId, &received, &error);
+    if (id.isEmpty()) {
+        res["success"] = false;
+        res["message"] = error;
+        return res;
+    }
+
+    res["success"] = true;
+    res["upload_id"] = id;
+    res["received"] = received;
+    res["chunk_size"] = BlobStore::CHUNK_BYTES;
+    return res;
+}
+
+QJsonObject JsonHandler::handleUploadChunk(const QJsonObject &req)
+{
+    QJsonObject res;
+    res["type"] = "upload_chunk_response";
+
+    QString username = req.value("username").toString();
+    QString id = req.value("upload_id").toString();
+    qint64 offset = qint64(req.value("offset").toDouble());
+    QByteArray data = QByteArray::fromBase64(req.value("data").toString().toLatin1());
+
+    qint64 received = 0;
+    QString error;
+    bool ok = BlobStore::instance().appendChunk(id, username, offset, data, &received, &error);
+
+    res["success"] = ok;
+    res["upload_id"] = id;
+    res["received"] = received;
+    if (!ok)
+        res["message"] = error;
+    return res;
+}
+
+QJsonObject JsonHandler::handleCommitUpload(const QJsonObject &req)
+{
+    QJsonObject res;
+    res["type"] = "commit_upload_response";
+
+    QString username = req.value("username").toString();
+    QString id = req.value("upload_id").toString();
+    QString sha256 = req.value("sha256").toString();
+
+    QString error;
+    QString blobId = BlobStore::instance().commitUpload(id, username, sha256, &error);
+    if (blobId.isEmpty()) {
+        res["success"] = false;
+        res["message"] = error;
+        return res;
     }
 
-    res["ads"] = arr;
+    res["success"] = true;
+    res["blob_id"] = blobId;
     return res;
 }
 
@@ -206,8 +543,8 @@ QJsonObject JsonHandler::handleAddToCart(const QJsonObject &req)
         return res;
     }
 
-    Ad ad = db.getAd(adId);
-    if (ad.id == 0 || ad.status != "Approved") {
+    const Ad *ad = db.findAd(adId);
+    if (!ad || ad->status != AdStatus::Approved) {
         res["success"] = false;
         res["message"] = "Ad not available";
         return res;
@@ -220,35 +557,35 @@ QJsonObject JsonHandler::handleAddToCart(const QJsonObject &req)
     return res;
 }
 
-QJsonObject JsonHandler::handleGetCart(const QJsonObject &req)
+void JsonHandler::writeGetCart(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_cart_response";
-
     QString username = req.value("username").toString();
     Database &db = Database::instance();
 
+    const QString tag = etag(req);
+    if (req.value("if_none_match").toString() == tag) {
+        writeNotModified(out, "get_cart_response", tag);
+        return;
+    }
+
     QList<int> ids = db.getCart(username);
-    QJsonArray arr;
     double total = 0.0;
 
+    out.beginObject();
+    out.field("etag", tag);
+    out.key("items");
+    out.beginArray();
     for (int id : ids) {
-        Ad a = db.getAd(id);
-        if (a.id == 0 || a.status != "Approved")
+        const Ad *a = db.findAd(id);
+        if (!a || a->status != AdStatus::Approved)
             continue;
-        QJsonObject o;
-        o["id"] = a.id;
-        o["title"] = a.title;
-        o["price"] = a.price;
-        o["category"] = a.category;
-        o["owner"] = a.owner;
-        arr.append(o);
-        total += a.price;
+        writeAdSummary(out, *a, db);
+        total += a->price;
     }
-
-    res["items"] = arr;
-    res["total_price"] = total;
-    return res;
+    out.endArray();
+    out.field("total_price", total);
+    out.field("type", "get_cart_response");
+    out.endObject();
 }
 
 QJsonObject JsonHandler::handleRemoveFromCart(const QJsonObject &req)
@@ -273,84 +610,36 @@ QJsonObject JsonHandler::handlePurchaseCart(const QJsonObject &req)
     res["type"] = "purchase_cart_response";
 
     QString username = req.value("username").toString();
-    Database &db = Database::instance();
+    QString idempotencyKey = req.value("idempotency_key").toString();
 
-    if (!db.userExists(username)) {
+    PurchaseResult r = Database::instance().purchaseCart(username, idempotencyKey);
+
+    switch (r.status) {
+    case PurchaseResult::Status::UserNotFound:
         res["success"] = false;
         res["message"] = "User not found";
         return res;
-    }
-
-    User buyer = db.getUser(username);
-    QList<int> ids = db.getCart(username);
-
-    double total = 0.0;
-    QList<Ad> adsToBuy;
-    for (int id : ids) {
-        Ad a = db.getAd(id);
-        if (a.id == 0 || a.status != "Approved")
-            continue;
-        adsToBuy.append(a);
-        total += a.price;
-    }
-
-    if (adsToBuy.isEmpty()) {
+    case PurchaseResult::Status::CartEmpty:
         res["success"] = false;
         res["message"] = "Cart is empty";
         return res;
-    }
-
-    if (buyer.walletBalance < total) {
+    case PurchaseResult::Status::InsufficientBalance:
         res["success"] = false;
         res["message"] = "Insufficient balance";
         return res;
+    case PurchaseResult::Status::Ok:
+        break;
     }
 
-    buyer.walletBalance -= total;
-    buyer.purchasesCount += adsToBuy.size();
-    db.updateUser(buyer);
-
-    for (const auto &a : adsToBuy) {
-        User seller = db.getUser(a.owner);
-        seller.walletBalance += a.price;
-        seller.salesCount += 1;
-        db.updateUser(seller);
-
-        PurchaseRecord p;
-        p.buyer = buyer.username;
-        p.seller = seller.username;
-        p.title = a.title;
-        p.price = a.price;
-        p.date = now();
-        p.adId = a.id;
-        db.addPurchaseRecord(p);
-
-        Transaction tb;
-        tb.username = buyer.username;
-        tb.type = "purchase";
-        tb.amount = -a.price;
-        tb.timestamp = p.date;
-        tb.description = QString("Purchase ad %1").arg(a.id);
-        tb.relatedAdTitle = a.title;
-        tb.relatedAdId = a.id;
-        db.addTransaction(tb);
-
-        Transaction ts;
-        ts.username = seller.username;
-        ts.type = "sale";
-        ts.amount = a.price;
-        ts.timestamp = p.date;
-        ts.description = QString("Sold ad %1").arg(a.id);
-        ts.relatedAdTitle = a.title;
-        ts.relatedAdId = a.id;
-        db.addTransaction(ts);
-    }
-
-    db.clearCart(username);
+    QJsonArray bought;
+    for (int id : r.adIds)
+        bought.append(id);
 
     res["success"] = true;
     res["message"] = "Purchase successful";
-    res["new_balance"] = buyer.walletBalance;
+    res["new_balance"] = fromMinorUnits(r.newBalance);
+    res["total_price"] = fromMinorUnits(r.total);
+    res["ad_ids"] = bought;
     return res;
 }
 
@@ -362,13 +651,7 @@ QJsonObject JsonHandler::handleGetWallet(const QJsonObject &req)
     QString username = req.value("username").toString();
     Database &db = Database::instance();
 
-    if (!db.userExists(username)) {
-        res["balance"] = 0.0;
-        return res;
-    }
-
-    User u = db.getUser(username);
-    res["balance"] = u.walletBalance;
+    res["balance"] = fromMinorUnits(db.balance(username));
     return res;
 }
 
@@ -378,32 +661,19 @@ QJsonObject JsonHandler::handleWalletDeposit(const QJsonObject &req)
     res["type"] = "wallet_deposit_response";
 
     QString username = req.value("username").toString();
-    double amount = req.value("amount").toDouble();
+    Money amount = toMinorUnits(req.value("amount").toDouble());
 
     Database &db = Database::instance();
-    if (!db.userExists(username) || amount <= 0) {
+    Money newBalance = 0;
+    if (!db.deposit(username, amount, &newBalance)) {
         res["success"] = false;
         res["message"] = "Invalid request";
         return res;
     }
 
-    User u = db.getUser(username);
-    u.walletBalance += amount;
-    db.updateUser(u);
-
-    Transaction t;
-    t.username = username;
-    t.type = "deposit";
-    t.amount = amount;
-    t.timestamp = now();
-    t.description = "Wallet deposit";
-    t.relatedAdTitle = "";
-    t.relatedAdId = 0;
-    db.addTransaction(t);
-
     res["success"] = true;
     res["message"] = "Deposit successful";
-    res["new_balance"] = u.walletBalance;
+    res["new_balance"] = fromMinorUnits(newBalance);
     return res;
 }
 
@@ -413,7 +683,7 @@ QJsonObject JsonHandler::handleWalletWithdraw(const QJsonObject &req)
     res["type"] = "wallet_withdraw_response";
 
     QString username = req.value("username").toString();
-    double amount = req.value("amount").toDouble();
+    Money amount = toMinorUnits(req.value("amount").toDouble());
 
     Database &db = Database::instance();
     if (!db.userExists(username) || amount <= 0) {
@@ -422,224 +692,180 @@ QJsonObject JsonHandler::handleWalletWithdraw(const QJsonObject &req)
         return res;
     }
 
-    User u = db.getUser(username);
-    if (u.walletBalance < amount) {
+    Money newBalance = 0;
+    if (!db.withdraw(username, amount, &newBalance)) {
         res["success"] = false;
         res["message"] = "Insufficient balance";
         return res;
     }
 
-    u.walletBalance -= amount;
-    db.updateUser(u);
-
-    Transaction t;
-    t.username = username;
-    t.type = "withdraw";
-    t.amount = -amount;
-    t.timestamp = now();
-    t.description = "Wallet withdraw";
-    t.relatedAdTitle = "";
-    t.relatedAdId = 0;
-    db.addTransaction(t);
-
     res["success"] = true;
     res["message"] = "Withdraw successful";
-    res["new_balance"] = u.walletBalance;
+    res["new_balance"] = fromMinorUnits(newBalance);
     return res;
 }
 
-QJsonObject JsonHandler::handleGetTransactions(const QJsonObject &req)
+void JsonHandler::writeGetTransactions(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_transactions_response";
-
     QString username = req.value("username").toString();
+    int offset = req.value("offset").toInt(0);
+    int limit = req.value("limit").toInt(-1);
     Database &db = Database::instance();
 
-    QList<Transaction> list = db.getTransactions(username);
-    QJsonArray arr;
-    for (const auto &t : list) {
-        QJsonObject o;
-        o["type"] = t.type;
-        o["amount"] = t.amount;
-        o["timestamp"] = t.timestamp;
-        o["description"] = t.description;
-        o["related_ad_title"] = t.relatedAdTitle;
-        o["related_ad_id"] = t.relatedAdId;
-        arr.append(o);
+    const QString tag = etag(req);
+    if (req.value("if_none_match").toString() == tag) {
+        writeNotModified(out, "get_transactions_response", tag);
+        return;
     }
 
-    res["transactions"] = arr;
-    return res;
+    QList<Transaction> list = db.getTransactions(username, offset, limit);
+
+    out.beginObject();
+    out.field("etag", tag);
+    out.field("offset", offset);
+    out.field("total", db.transactionCount(username));
+    out.key("transactions");
+    out.beginArray();
+    for (const auto &t : list)
+        writeTransaction(out, t);
+    out.endArray();
+    out.field("type", "get_transactions_response");
+    out.endObject();
 }
 
-QJsonObject JsonHandler::handleGetProfile(const QJsonObject &req)
+QJsonObject JsonHandler::handleMainMenuInit(const QJsonObject &req)
 {
     QJsonObject res;
-    res["type"] = "get_profile_response";
+    res["type"] = "mainmenu_init_response";
 
     QString username = req.value("username").toString();
     Database &db = Database::instance();
-
     if (!db.userExists(username)) {
-        res["name"] = "";
-        res["email"] = "";
-        res["phone"] = "";
-        res["join_date"] = "";
-        res["ads_count"] = 0;
-        res["purchases"] = 0;
-        res["sales"] = 0;
+        res["success"] = false;
+        res["message"] = "User not found";
         return res;
     }
 
-    User u = db.getUser(username);
-    res["name"] = u.name;
-    res["email"] = u.email;
-    res["phone"] = u.phone;
-    res["join_date"] = u.joinDate;
-    res["ads_count"] = u.adsCount;
-    res["purchases"] = u.purchasesCount;
-    res["sales"] = u.salesCount;
+    UserSummary s = db.getUserSummary(username);
+    AdminStats stats = db.getAdminStats();
+
+    res["success"] = true;
+    res["total_ads"] = stats.approvedAds;
+    res["pending_ads"] = stats.pendingAds;
+    res["user_ads"] = s.totalAds;
+    res["user_pending_ads"] = s.adsByStatus[int(AdStatus::Pending)];
+    res["user_approved_ads"] = s.adsByStatus[int(AdStatus::Approved)];
+    res["user_sold_ads"] = s.adsByStatus[int(AdStatus::Sold)];
+    res["cart_items"] = s.cartItems;
+    res["wallet_balance"] = fromMinorUnits(s.walletBalance);
     return res;
 }
 
-QJsonObject JsonHandler::handleGetUserAds(const QJsonObject &req)
+void JsonHandler::writeGetProfile(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_user_ads_response";
-
     QString username = req.value("username").toString();
     Database &db = Database::instance();
 
-    QList<Ad> list = db.getUserAds(username);
-    QJsonArray arr;
-    for (const auto &a : list) {
-        QJsonObject o;
-        o["id"] = a.id;
-        o["title"] = a.title;
-        o["price"] = a.price;
-        o["category"] = a.category;
-        o["status"] = a.status;
-        arr.append(o);
-    }
-
-    res["ads"] = arr;
-    return res;
+    // An unknown user gets an empty profile.
+    const User *u = db.findUser(username);
+    out.beginObject();
+    out.field("ads_count", u ? u->adsCount : 0);
+    out.field("email", u ? u->email : QString());
+    out.field("join_date", u ? u->joinDate : QString());
+    out.field("name", u ? u->name : QString());
+    out.field("phone", u ? u->phone : QString());
+    out.field("purchases", u ? u->purchasesCount : 0);
+    out.field("sales", u ? u->salesCount : 0);
+    out.field("type", "get_profile_response");
+    out.endObject();
 }
 
-QJsonObject JsonHandler::handleGetUserPurchases(const QJsonObject &req)
+void JsonHandler::writeGetUserAds(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_user_purchases_response";
-
     QString username = req.value("username").toString();
     Database &db = Database::instance();
 
-    QList<PurchaseRecord> list = db.getPurchases(username);
-    QJsonArray arr;
-    for (const auto &p : list) {
-        QJsonObject o;
-        o["title"] = p.title;
-        o["price"] = p.price;
-        o["date"] = p.date;
-        o["seller"] = p.seller;
-        arr.append(o);
-    }
-
-    res["purchases"] = arr;
-    return res;
+    out.beginObject();
+    out.key("ads");
+    out.beginArray();
+    for (const Ad *ap : db.getUserAds(username))
+        writeUserAd(out, *ap, db);
+    out.endArray();
+    out.field("type", "get_user_ads_response");
+    out.endObject();
 }
 
-QJsonObject JsonHandler::handleGetUserSales(const QJsonObject &req)
+void JsonHandler::writeGetUserPurchases(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_user_sales_response";
-
     QString username = req.value("username").toString();
     Database &db = Database::instance();
 
-    QList<PurchaseRecord> list = db.getSales(username);
-    QJsonArray arr;
-    for (const auto &p : list) {
-        QJsonObject o;
-        o["title"] = p.title;
-        o["price"] = p.price;
-        o["date"] = p.date;
-        o["buyer"] = p.buyer;
-        arr.append(o);
-    }
-
-    res["sales"] = arr;
-    return res;
+    QList<PurchaseRecord> list = db.getPurchases(username);
+    out.beginObject();
+    out.key("purchases");
+    out.beginArray();
+    for (const auto &p : list)
+        writePurchase(out, p);
+    out.endArray();
+    out.field("type", "get_user_purchases_response");
+    out.endObject();
 }
 
-QJsonObject JsonHandler::handleGetPendingAds(const QJsonObject &)
+void JsonHandler::writeGetUserSales(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_pending_ads_response";
-
+    QString username = req.value("username").toString();
     Database &db = Database::instance();
-    QList<Ad> list = db.getAdsByStatus("Pending");
-
-    QJsonArray arr;
-    for (const auto &a : list) {
-        QJsonObject o;
-        o["id"] = a.id;
-        o["title"] = a.title;
-        o["price"] = a.price;
-        o["category"] = a.category;
-        o["owner"] = a.owner;
-        arr.append(o);
-    }
 
-    res["ads"] = arr;
-    return res;
+    QList<PurchaseRecord> list = db.getSales(username);
+    out.beginObject();
+    out.key("sales");
+    out.beginArray();
+    for (const auto &p : list)
+        writeSale(out, p);
+    out.endArray();
+    out.field("type", "get_user_sales_response");
+    out.endObject();
 }
 
-QJsonObject JsonHandler::handleGetApprovedAds(const QJsonObject &)
+void JsonHandler::writeGetPendingAds(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_approved_ads_response";
+    writeStatusListing(req, out, AdStatus::Pending, "get_pending_ads_response");
+}
 
+void JsonHandler::writeStatusListing(const QJsonObject &req, JsonWriter &out,
+                                     AdStatus status, const QString &type)
+{
+    int offset = req.value("offset").toInt(0);
+    int limit = req.value("limit").toInt(-1);
     Database &db = Database::instance();
-    QList<Ad> list = db.getAdsByStatus("Approved");
-
-    QJsonArray arr;
-    for (const auto &a : list) {
-        QJsonObject o;
-        o["id"] = a.id;
-        o["title"] = a.title;
-        o["price"] = a.price;
-        o["category"] = a.category;
-        o["owner"] = a.owner;
-        arr.append(o);
+
+    const QString tag = etag(req);
+    if (req.value("if_none_match").toString() == tag) {
+        writeNotModified(out, type, tag);
+        return;
     }
 
-    res["ads"] = arr;
-    return res;
+    out.beginObject();
+    out.key("ads");
+    out.beginArray();
+    for (const Ad *ap : db.getAdsByStatus(status, offset, limit))
+        writeAdSummary(out, *ap, db);
+    out.endArray();
+    out.field("etag", tag);
+    out.field("offset", offset);
+    out.field("total", db.adCount(status));
+    out.field("type", type);
+    out.endObject();
 }
 
-QJsonObject JsonHandler::handleGetRejectedAds(const QJsonObject &)
+void JsonHandler::writeGetApprovedAds(const QJsonObject &req, JsonWriter &out)
 {
-    QJsonObject res;
-    res["type"] = "get_rejected_ads_response";
-
-    Database &db = Database::instance();
-    QList<Ad> list = db.getAdsByStatus("Rejected");
-
-    QJsonArray arr;
-    for (const auto &a : list) {
-        QJsonObject o;
-        o["id"] = a.id;
-        o["title"] = a.title;
-        o["price"] = a.price;
-        o["category"] = a.category;
-        o["owner"] = a.owner;
-        arr.append(o);
-    }
+    writeStatusListing(req, out, AdStatus::Approved, "get_approved_ads_response");
+}
 
-    res["ads"] = arr;
-    return res;
+void JsonHandler::writeGetRejectedAds(const QJsonObject &req, JsonWriter &out)
+{
+    writeStatusListing(req, out, AdStatus::Rejected, "get_rejected_ads_response");
 }
 
 QJsonObject JsonHandler::handleApproveAd(const QJsonObject &req)
@@ -650,14 +876,13 @@ QJsonObject JsonHandler::handleApproveAd(const QJsonObject &req)
     int adId = req.value("ad_id").toInt();
     Database &db = Database::instance();
 
-    Ad a = db.getAd(adId);
-    if (a.id == 0) {
+    if (!db.findAd(adId)) {
         res["success"] = false;
         res["message"] = "Ad not found";
         return res;
     }
 
-    db.updateAdStatus(adId, "Approved");
+    db.updateAdStatus(adId, AdStatus::Approved);
 
     res["success"] = true;
     res["message"] = "Ad approved";
@@ -672,14 +897,13 @@ QJsonObject JsonHandler::handleRejectAd(const QJsonObject &req)
     int adId = req.value("ad_id").toInt();
     Database &db = Database::instance();
 
-    Ad a = db.getAd(adId);
-    if (a.id == 0) {
+    if (!db.findAd(adId)) {
         res["success"] = false;
         res["message"] = "Ad not found";
         return res;
     }
 
-    db.updateAdStatus(adId, "Rejected");
+    db.updateAdStatus(adId, AdStatus::Rejected);
 
     res["success"] = true;
     res["message"] = "Ad rejected";
@@ -701,6 +925,16 @@ QJsonObject JsonHandler::handleGetAdminStats(const QJsonObject &)
     res["rejected_ads"] = s.rejectedAds;
     res["total_transactions"] = s.totalTransactions;
     res["total_purchases"] = s.totalPurchases;
+    res["active_carts"] = s.activeCarts;
+    res["gmv"] = fromMinorUnits(s.gmv);
+    res["deposits_today"] = fromMinorUnits(s.depositsToday);
+
+    return res;
+}
 
+QJsonObject JsonHandler::handleGetMetrics(const QJsonObject &)
+{
+    QJsonObject res = Metrics::instance().toJson();
+    res["type"] = "get_metrics_response";
     return res;
 }
@@ -4,6 +4,9 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QString>
+#include "models.h"
+
+class JsonWriter;
 
 class JsonHandler
 {
@@ -11,36 +14,62 @@ public:
     JsonHandler();
 
     QJsonObject handleRequest(const QJsonObject &req);
+    // Replies made of rows (listings, cart, transactions, profile) are
+    // written field by field into a JsonWriter rather than built as a
+    // QJsonObject; writeReply() emits exactly the bytes QJsonDocument
+    // would. handleRequest() answers those types too, by parsing what
+    // was written; that costs a second pass, so callers that only need
+    // the bytes (the server, replayer and bench) use writeReply().
+    bool writesReply(const QString &type) const;
+    void writeReply(const QJsonObject &req, JsonWriter &out);
+    // Conditional reads: list replies carry an etag made of the versions
+    // they are built from and a digest of the request; a request whose
+    // if_none_match equals it gets a not_modified reply instead.
+    // Empty for requests whose replies have no etag.
+    QString etag(const QJsonObject &req) const;
 
 private:
+    using ReplyWriter = void (JsonHandler::*)(const QJsonObject &req, JsonWriter &out);
+    ReplyWriter replyWriter(const QString &type) const;
+
     QJsonObject handleLogin(const QJsonObject &req);
     QJsonObject handleSignup(const QJsonObject &req);
 
     QJsonObject handleAddAd(const QJsonObject &req);
-    QJsonObject handleGetAds(const QJsonObject &req);
+    void writeGetAds(const QJsonObject &req, JsonWriter &out);
+    QJsonObject handleGetAdImage(const QJsonObject &req);
+
+    QJsonObject handleBeginUpload(const QJsonObject &req);
+    QJsonObject handleUploadChunk(const QJsonObject &req);
+    QJsonObject handleCommitUpload(const QJsonObject &req);
 
     QJsonObject handleAddToCart(const QJsonObject &req);
-    QJsonObject handleGetCart(const QJsonObject &req);
+    void writeGetCart(const QJsonObject &req, JsonWriter &out);
     QJsonObject handleRemoveFromCart(const QJsonObject &req);
     QJsonObject handlePurchaseCart(const QJsonObject &req);
 
     QJsonObject handleGetWallet(const QJsonObject &req);
     QJsonObject handleWalletDeposit(const QJsonObject &req);
     QJsonObject handleWalletWithdraw(const QJsonObject &req);
-    QJsonObject handleGetTransactions(const QJsonObject &req);
+    void writeGetTransactions(const QJsonObject &req, JsonWriter &out);
 
-    QJsonObject handleGetProfile(const QJsonObject &req);
-    QJsonObject handleGetUserAds(const QJsonObject &req);
-    QJsonObject handleGetUserPurchases(const QJsonObject &req);
-    QJsonObject handleGetUserSales(const QJsonObject &req);
+    QJsonObject handleMainMenuInit(const QJsonObject &req);
+    void writeGetProfile(const QJsonObject &req, JsonWriter &out);
+    void writeGetUserAds(const QJsonObject &req, JsonWriter &out);
+    void writeGetUserPurchases(const QJsonObject &req, JsonWriter &out);
+    void writeGetUserSales(const QJsonObject &req, JsonWriter &out);
 
-    QJsonObject handleGetPendingAds(const QJsonObject &req);
-    QJsonObject handleGetApprovedAds(const QJsonObject &req);
-    QJsonObject handleGetRejectedAds(const QJsonObject &req);
+    void writeGetPendingAds(const QJsonObject &req, JsonWriter &out);
+    void writeGetApprovedAds(const QJsonObject &req, JsonWriter &out);
+    void writeGetRejectedAds(const QJsonObject &req, JsonWriter &out);
+    void writeStatusListing(const QJsonObject &req, JsonWriter &out,
+                            AdStatus status, const QString &type);
     QJsonObject handleApproveAd(const QJsonObject &req);
     QJsonObject handleRejectAd(const QJsonObject &req);
     QJsonObject handleGetAdminStats(const QJsonObject &req);
+    QJsonObject handleGetMetrics(const QJsonObject &req);
 
+    void writeNotModified(JsonWriter &out, const QString &type, const QString &etag) const;
     QString hashPassword(const QString &plain) const;
     QString now() const;
 };
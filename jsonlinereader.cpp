@@ -0,0 +1,193 @@
+#include "jsonlinereader.h"
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+JsonLineReader::JsonLineReader(QObject *parent)
+    : QObject(parent)
+{
+    reset();
+}
+
+void JsonLineReader::streamArray(const QString &key)
+{
+    if (keys.contains(key))
+        return;
+    keys.append(key);
+    prefixes.append("{\"" + key.toUtf8() + "\":[");
+}
+
+void JsonLineReader::reset()
+{
+    buffer.clear();
+    mode         = Mode::LineStart;
+    scanPos      = 0;
+    streamIndex  = -1;
+    depth        = 0;
+    elementStart = -1;
+    inString     = false;
+    escaped      = false;
+}
+
+void JsonLineReader::feed(const QByteArray &data)
+{
+    buffer.append(data);
+
+    bool progressed = true;
+    while (progressed) {
+        switch (mode) {
+        case Mode::LineStart:  progressed = startLine();      break;
+        case Mode::Line:       progressed = readLine();       break;
+        case Mode::Array:      progressed = readArray();      break;
+        case Mode::AfterArray: progressed = readAfterArray(); break;
+        }
+    }
+}
+
+bool JsonLineReader::startLine()
+{
+    int skip = 0;
+    while (skip < buffer.size() && (buffer[skip] == '\n' || buffer[skip] == '\r' || buffer[skip] == ' '))
+        ++skip;
+    buffer.remove(0, skip);
+    if (buffer.isEmpty())
+        return false;
+
+    for (int i = 0; i < prefixes.size(); ++i) {
+        const QByteArray &prefix = prefixes[i];
+        if (buffer.startsWith(prefix)) {
+            mode         = Mode::Array;
+            streamIndex  = i;
+            scanPos      = prefix.size();
+            depth        = 0;
+            elementStart = -1;
+            inString     = false;
+            escaped      = false;
+            emit arrayStarted(keys[i]);
+            return true;
+        }
+        // Too short to tell yet.
+        if (buffer.size() < prefix.size() && prefix.startsWith(buffer))
+            return false;
+    }
+
+    mode    = Mode::Line;
+    scanPos = 0;
+    return true;
+}
+
+bool JsonLineReader::readLine()
+{
+    int end = buffer.indexOf('\n', scanPos);
+    if (end < 0) {
+        scanPos = buffer.size();
+        return false;
+    }
+
+    QByteArray line = buffer.left(end);
+    buffer.remove(0, end + 1);
+    mode    = Mode::LineStart;
+    scanPos = 0;
+    emitMessage(line);
+    return true;
+}
+
+bool JsonLineReader::readArray()
+{
+    const QString key = keys[streamIndex];
+
+    for (int i = scanPos; i < buffer.size(); ++i) {
+        const char c = buffer.at(i);
+
+        if (inString) {
+            if (escaped)
+                escaped = false;
+            else if (c == '\\')
+                escaped = true;
+            else if (c == '"')
+                inString = false;
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            inString = true;
+            break;
+        case '{':
+        case '[':
+            if (depth == 0)
+                elementStart = i;
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (depth == 0) {
+                // End of the streamed array; keep "]..." for the splice.
+                buffer.remove(0, i);
+                mode    = Mode::AfterArray;
+                scanPos = 0;
+                return true;
+            }
+            if (--depth == 0 && elementStart >= 0) {
+                QJsonParseError err;
+                QJsonDocument doc = QJsonDocument::fromJson(
+                    buffer.mid(elementStart, i + 1 - elementStart), &err);
+                elementStart = -1;
+                if (err.error == QJsonParseError::NoError && doc.isObject()) {
+                    emit rowReceived(key, doc.object());
+                    if (mode != Mode::Array)    // reset() from a slot
+                        return true;
+                }
+            }
+            break;
+        case '\n':
+            // The line ended inside the array: malformed, drop it.
+            buffer.remove(0, i + 1);
+            mode    = Mode::LineStart;
+            scanPos = 0;
+            return true;
+        default:
+            break;
+        }
+    }
+
+    // Only the element in progress needs to stay buffered.
+    if (elementStart >= 0) {
+        buffer.remove(0, elementStart);
+        scanPos      = buffer.size();
+        elementStart = 0;
+    } else {
+        buffer.clear();
+        scanPos = 0;
+    }
+    return false;
+}
+
+bool JsonLineReader::readAfterArray()
+{
+    int end = buffer.indexOf('\n', scanPos);
+    if (end < 0) {
+        scanPos = buffer.size();
+        return false;
+    }
+
+    QByteArray line = prefixes[streamIndex] + buffer.left(end);
+    buffer.remove(0, end + 1);
+    mode    = Mode::LineStart;
+    scanPos = 0;
+    emitMessage(line);
+    return true;
+}
+
+void JsonLineReader::emitMessage(const QByteArray &line)
+{
+    QByteArray msg = line.trimmed();
+    if (msg.isEmpty())
+        return;
+
+    QJsonParseError err;
+    QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
+    if (err.error != QJsonParseError::NoError || !doc.isObject())
+        return;
+
+    emit messageReceived(doc.object());
+}
@@ -0,0 +1,58 @@
+#ifndef JSONLINEREADER_H
+#define JSONLINEREADER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QStringList>
+
+// Client-side framing for the line-delimited JSON protocol. Bytes from
+// any number of reads are fed in; a message is emitted once its '\n'
+// arrives, however many reads it took.
+//
+// A response whose first key is a registered array key (the server
+// writes keys in sorted order, e.g. {"ads":[...],"type":...}) is parsed
+// incrementally instead: each array element is emitted as soon as it is
+// complete, and only the current partial element stays buffered. The
+// final messageReceived() then carries the response with that array
+// left empty, so rows are never parsed twice.
+class JsonLineReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JsonLineReader(QObject *parent = nullptr);
+
+    void streamArray(const QString &key);
+    void feed(const QByteArray &data);
+    // Drops any partial message, e.g. after the socket was aborted.
+    void reset();
+
+signals:
+    void messageReceived(const QJsonObject &obj);
+    void arrayStarted(const QString &key);
+    void rowReceived(const QString &key, const QJsonObject &row);
+
+private:
+    enum class Mode { LineStart, Line, Array, AfterArray };
+
+    QList<QByteArray> prefixes;     // {"<key>":[
+    QStringList keys;
+
+    QByteArray buffer;
+    Mode  mode;
+    int   scanPos;
+    int   streamIndex;
+    int   depth;
+    int   elementStart;
+    bool  inString;
+    bool  escaped;
+
+    bool startLine();
+    bool readLine();
+    bool readArray();
+    bool readAfterArray();
+    void emitMessage(const QByteArray &line);
+};
+
+#endif
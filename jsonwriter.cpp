@@ -0,0 +1,177 @@
+#include "jsonwriter.h"
+#include <QLocale>
+#include <cmath>
+
+namespace {
+const int INITIAL_CAPACITY = 64 * 1024;
+
+inline char hexDigit(uint u)
+{
+    return char(u < 10 ? '0' + u : 'a' + u - 10);
+}
+}
+
+JsonWriter::JsonWriter()
+    : needComma(false)
+{
+    // reserve() also keeps Qt 5 from freeing the buffer on resize(0).
+    buf.reserve(INITIAL_CAPACITY);
+}
+
+void JsonWriter::clear()
+{
+    buf.resize(0);
+    // A reply still shared with a caller (e.g. cached) makes resize()
+    // detach into a fresh, small buffer.
+    if (buf.capacity() < INITIAL_CAPACITY)
+        buf.reserve(INITIAL_CAPACITY);
+    needComma = false;
+}
+
+void JsonWriter::beginObject()
+{
+    separate();
+    buf.append('{');
+    needComma = false;
+}
+
+void JsonWriter::endObject()
+{
+    buf.append('}');
+    needComma = true;
+}
+
+void JsonWriter::beginArray()
+{
+    separate();
+    buf.append('[');
+    needComma = false;
+}
+
+void JsonWriter::endArray()
+{
+    buf.append(']');
+    needComma = true;
+}
+
+void JsonWriter::endLine()
+{
+    buf.append('\n');
+    needComma = false;
+}
+
+void JsonWriter::value(const QString &s)
+{
+    separate();
+    appendString(s);
+    needComma = true;
+}
+
+void JsonWriter::value(int v)
+{
+    separate();
+    buf.append(QByteArray::number(v));
+    needComma = true;
+}
+
+void JsonWriter::value(qint64 v)
+{
+    separate();
+    buf.append(QByteArray::number(v));
+    needComma = true;
+}
+
+// QJsonDocument writes non-finite doubles as null.
+void JsonWriter::value(double v)
+{
+    separate();
+    if (std::isfinite(v))
+        buf.append(QByteArray::number(v, 'g', QLocale::FloatingPointShortest));
+    else
+        buf.append("null", 4);
+    needComma = true;
+}
+
+void JsonWriter::value(bool v)
+{
+    separate();
+    if (v)
+        buf.append("true", 4);
+    else
+        buf.append("false", 5);
+    needComma = true;
+}
+
+void JsonWriter::rawValue(const QByteArray &json)
+{
+    separate();
+    buf.append(json);
+    needComma = true;
+}
+
+// Same escaping as QJsonDocument: quote, backslash and control characters
+// are escaped, everything else is written as UTF-8, and an unpaired
+// surrogate becomes a \u escape. Written through a raw pointer into room
+// reserved for the worst case (6 bytes per UTF-16 unit), then trimmed.
+void JsonWriter::appendString(const QString &s)
+{
+    const int start = buf.size();
+    buf.resize(start + 6 * int(s.size()) + 2);
+    char *out = buf.data() + start;
+
+    *out++ = '"';
+    const QChar *p = s.constData();
+    const QChar *end = p + s.size();
+    while (p != end) {
+        const uint u = p->unicode();
+        ++p;
+
+        if (u < 0x80) {
+            if (u >= 0x20 && u != '"' && u != '\\') {
+                *out++ = char(u);
+                continue;
+            }
+            *out++ = '\\';
+            switch (u) {
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '\b': *out++ = 'b';  break;
+            case '\f': *out++ = 'f';  break;
+            case '\n': *out++ = 'n';  break;
+            case '\r': *out++ = 'r';  break;
+            case '\t': *out++ = 't';  break;
+            default:
+                *out++ = 'u';
+                *out++ = '0';
+                *out++ = '0';
+                *out++ = hexDigit(u >> 4);
+                *out++ = hexDigit(u & 0xf);
+                break;
+            }
+        } else if (u < 0x800) {
+            *out++ = char(0xc0 | (u >> 6));
+            *out++ = char(0x80 | (u & 0x3f));
+        } else if (!QChar::isSurrogate(u)) {
+            *out++ = char(0xe0 | (u >> 12));
+            *out++ = char(0x80 | ((u >> 6) & 0x3f));
+            *out++ = char(0x80 | (u & 0x3f));
+        } else if (QChar::isHighSurrogate(u) && p != end && p->isLowSurrogate()) {
+            const uint c = QChar::surrogateToUcs4(p[-1], p[0]);
+            ++p;
+            *out++ = char(0xf0 | (c >> 18));
+            *out++ = char(0x80 | ((c >> 12) & 0x3f));
+            *out++ = char(0x80 | ((c >> 6) & 0x3f));
+            *out++ = char(0x80 | (c & 0x3f));
+        } else {
+            *out++ = '\\';
+            *out++ = 'u';
+            *out++ = hexDigit(u >> 12);
+            *out++ = hexDigit((u >> 8) & 0xf);
+            *out++ = hexDigit((u >> 4) & 0xf);
+            *out++ = hexDigit(u & 0xf);
+        }
+    }
+    *out++ = '"';
+
+    buf.resize(int(out - buf.constData()));
+}
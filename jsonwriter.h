@@ -0,0 +1,75 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QByteArray>
+#include <QString>
+
+// Streams compact JSON into a reusable buffer, for replies that are
+// written straight from the database rows instead of being built as a
+// QJsonObject first. The output matches QJsonDocument::Compact byte for
+// byte as long as the caller writes keys in sorted order (QJsonObject
+// keeps them sorted): same string escaping, integers as integers and
+// doubles in their shortest round-trip form.
+//
+// Keys are string literals, so their quoted form is put together at
+// compile time and never escaped.
+class JsonWriter
+{
+public:
+    JsonWriter();
+
+    // Empties the buffer but keeps its memory for the next reply.
+    void clear();
+    const QByteArray &data() const { return buf; }
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    // Ends the reply line.
+    void endLine();
+
+    template <int N>
+    void key(const char (&name)[N])
+    {
+        separate();
+        buf.append('"').append(name, N - 1).append("\":", 2);
+        needComma = false;
+    }
+
+    void value(const QString &s);
+    // A literal that needs no escaping, e.g. a reply type.
+    template <int N>
+    void value(const char (&s)[N])
+    {
+        separate();
+        buf.append('"').append(s, N - 1).append('"');
+        needComma = true;
+    }
+    void value(int v);
+    void value(qint64 v);
+    void value(double v);
+    void value(bool v);
+    // An already encoded JSON value.
+    void rawValue(const QByteArray &json);
+
+    template <int N, typename T>
+    void field(const char (&name)[N], const T &v)
+    {
+        key(name);
+        value(v);
+    }
+
+private:
+    QByteArray buf;
+    bool needComma;
+
+    void separate()
+    {
+        if (needComma)
+            buf.append(',');
+    }
+    void appendString(const QString &s);
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "database.h"
+#include "jsonhandler.h"
+#include "jsonwriter.h"
+
+// Checks that every reply JsonHandler writes through a JsonWriter is
+// byte for byte what QJsonDocument::Compact makes of the same reply, so
+// clients (and the etags and response cache built on those bytes) cannot
+// tell the two paths apart. The data is chosen to hit the encoder's edge
+// cases: escapes, control characters, non-ASCII text and doubles that
+// print in exponent form or need all their digits.
+
+namespace {
+const QString SELLER = QString::fromUtf8("s\xc3\xa9ller \"q\"");
+const QString BUYER = QString::fromUtf8("\xd8\xae\xd8\xb1\xdb\x8c\xd8\xaf\xd8\xa7\xd8\xb1");
+const QString EMPTY_USER = "nobody";
+
+void addUser(const QString &username, const QString &name)
+{
+    User u;
+    u.username = username;
+    u.passwordHash = "x";
+    u.name = name;
+    u.email = username + "@test.local";
+    u.phone = "+98 (912) 000-0000";
+    u.joinDate = "2026-01-01 00:00:00";
+    u.adsCount = 0;
+    u.purchasesCount = 0;
+    u.salesCount = 0;
+    u.isAdmin = false;
+    Database::instance().addUser(u);
+}
+
+int addAd(const QString &title, const QString &description, double price, AdStatus status)
+{
+    Database &db = Database::instance();
+    Ad a;
+    a.id = 0;
+    a.owner = db.intern(SELLER);
+    a.category = db.intern(QString::fromUtf8("Home & Garden/\xc3\xbc" "ber"));
+    a.title = title;
+    a.description = description;
+    a.price = price;
+    a.status = status;
+    return db.addAd(a);
+}
+}
+
+class JsonWriterTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void writeReply_data();
+    void writeReply();
+    void notModified();
+};
+
+void JsonWriterTest::initTestCase()
+{
+    Database &db = Database::instance();
+    db.clear();
+    addUser(SELLER, QString::fromUtf8("Tab\there, line\nbreak, back\\slash"));
+    addUser(BUYER, QString::fromUtf8("\xf0\x9f\x98\x80 emoji and \xe2\x80\x8f marks"));
+
+    const struct {
+        const char *title;
+        double price;
+        AdStatus status;
+    } ads[] = {
+        {"plain", 10.0, AdStatus::Approved},
+        {"quote \" and slash / and \\", 0.1, AdStatus::Approved},
+        {"controls \x01\x08\x0c\x1f\x7f end", 19.99, AdStatus::Approved},
+        {"\xd8\xaa\xd9\x84\xd9\x88\xdb\x8c\xd8\xb2\xdb\x8c\xd9\x88\xd9\x86", 1e21, AdStatus::Approved},
+        {"tiny", 1e-7, AdStatus::Pending},
+        {"digits", 1234567.8912345, AdStatus::Pending},
+        {"big integer", 9007199254740993.0, AdStatus::Rejected},
+        {"</script>", 0.0, AdStatus::Rejected},
+    };
+    for (const auto &a : ads)
+        addAd(QString::fromUtf8(a.title), QString::fromUtf8("desc \xe2\x80\xa8 \xc2\xa0 \t"), a.price, a.status);
+
+    db.addToCart(BUYER, 1);
+    db.addToCart(BUYER, 2);
+    db.addToCart(BUYER, 5);     // pending: left out of the cart reply
+
+    Money balance = 0;
+    db.deposit(BUYER, toMinorUnits(12345.67), &balance);
+    db.deposit(BUYER, 1, &balance);
+    db.withdraw(BUYER, toMinorUnits(0.3), &balance);
+    QVERIFY(db.purchaseCart(BUYER, "writer-test").status == PurchaseResult::Status::Ok);
+    db.addToCart(BUYER, 3);
+}
+
+void JsonWriterTest::writeReply_data()
+{
+    QTest::addColumn<QJsonObject>("request");
+
+    const struct {
+        const char *name;
+        QJsonObject request;
+    } rows[] = {
+        {"get_ads",                  {{"type", "get_ads"}}},
+        {"get_ads/pending",          {{"type", "get_ads"}, {"status", "Pending"}}},
+        {"get_ads/bad status",       {{"type", "get_ads"}, {"status", "Nope"}}},
+        {"get_ads/offset",           {{"type", "get_ads"}, {"offset", 1}, {"limit", 2}}},
+        {"get_ads/after_id",         {{"type", "get_ads"}, {"after_id", 3}, {"limit", 5}}},
+        {"get_ads/delta",            {{"type", "get_ads"}, {"since_version", 2},
+                                      {"catalog_epoch", Database::instance().catalogEpoch()}}},
+        {"get_cart",                 {{"type", "get_cart"}, {"username", BUYER}}},
+        {"get_cart/empty",           {{"type", "get_cart"}, {"username", EMPTY_USER}}},
+        {"get_transactions",         {{"type", "get_transactions"}, {"username", BUYER}}},
+        {"get_transactions/paged",   {{"type", "get_transactions"}, {"username", BUYER},
+                                      {"offset", 1}, {"limit", 1}}},
+        {"get_profile",              {{"type", "get_profile"}, {"username", SELLER}}},
+        {"get_profile/unknown",      {{"type", "get_profile"}, {"username", EMPTY_USER}}},
+        {"get_user_ads",             {{"type", "get_user_ads"}, {"username", SELLER}}},
+        {"get_user_purchases",       {{"type", "get_user_purchases"}, {"username", BUYER}}},
+        {"get_user_sales",           {{"type", "get_user_sales"}, {"username", SELLER}}},
+        {"get_pending_ads",          {{"type", "get_pending_ads"}}},
+        {"get_approved_ads",         {{"type", "get_approved_ads"}, {"offset", 1}}},
+        {"get_rejected_ads",         {{"type", "get_rejected_ads"}, {"limit", 1}}},
+    };
+    for (const auto &r : rows)
+        QTest::newRow(r.name) << r.request;
+}
+
+void JsonWriterTest::writeReply()
+{
+    QFETCH(QJsonObject, request);
+
+    JsonHandler handler;
+    QVERIFY(handler.writesReply(request.value("type").toString()));
+
+    JsonWriter out;
+    handler.writeReply(request, out);
+
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(out.data(), &error);
+    QVERIFY2(error.error == QJsonParseError::NoError, qPrintable(error.errorString()));
+    QVERIFY(doc.isObject());
+    QCOMPARE(out.data(), doc.toJson(QJsonDocument::Compact));
+    QCOMPARE(QJsonDocument(handler.handleRequest(request)).toJson(QJsonDocument::Compact),
+             out.data());
+}
+
+void JsonWriterTest::notModified()
+{
+    JsonHandler handler;
+    QJsonObject request{{"type", "get_cart"}, {"username", BUYER}};
+    request["if_none_match"] = handler.etag(request);
+
+    JsonWriter out;
+    handler.writeReply(request, out);
+    QCOMPARE(out.data(), QJsonDocument(handler.handleRequest(request)).toJson(QJsonDocument::Compact));
+    QVERIFY(out.data().contains("\"not_modified\":true"));
+}
+
+QTEST_GUILESS_MAIN(JsonWriterTest)
+
+#include "jsonwritertest.moc"
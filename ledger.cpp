@@ -0,0 +1,138 @@
+#include "ledger.h"
+
+const QString Ledger::ExternalAccount = QStringLiteral("@external");
+
+bool Ledger::isReservedAccount(const QString &name)
+{
+    return name.startsWith(QLatin1Char('@'));
+}
+
+const LedgerEntry &Ledger::post(const QString &debit, const QString &credit, Money amount,
+                                TransactionType type, const QString &timestamp,
+                                const QString &debitMemo, const QString &creditMemo,
+                                int relatedAdId, const QString &relatedAdTitle)
+{
+    LedgerEntry e;
+    e.seq = quint64(journal.size()) + 1;
+    e.amount = amount;
+    e.type = type;
+    e.relatedAdId = relatedAdId;
+    e.debit = debit;
+    e.credit = credit;
+    e.timestamp = timestamp;
+    e.debitMemo = debitMemo;
+    e.creditMemo = creditMemo;
+    e.relatedAdTitle = relatedAdTitle;
+
+    int index = journal.size();
+    journal.append(e);
+
+    Account &from = accounts[debit];
+    from.entries.append(index);
+    from.balance -= amount;
+
+    Account &to = accounts[credit];
+    to.entries.append(index);
+    to.balance += amount;
+
+    return journal.last();
+}
+
+Money Ledger::balance(const QString &account) const
+{
+    auto it = accounts.constFind(account);
+    return it == accounts.constEnd() ? 0 : it->balance;
+}
+
+int Ledger::entryCount(const QString &account) const
+{
+    auto it = accounts.constFind(account);
+    return it == accounts.constEnd() ? 0 : it->entries.size();
+}
+
+QList<Transaction> Ledger::transactions(const QString &account, int offset, int limit) const
+{
+    QList<Transaction> list;
+    auto it = accounts.constFind(account);
+    if (it == accounts.constEnd())
+        return list;
+
+    const QVector<int> &segment = it->entries;
+    int begin = qBound(0, offset, int(segment.size()));
+    int end = limit < 0 ? int(segment.size()) : qMin(int(segment.size()), begin + limit);
+
+    list.reserve(end - begin);
+    for (int i = begin; i < end; ++i)
+        list.append(view(journal.at(segment.at(i)), account));
+    return list;
+}
+
+int Ledger::size() const
+{
+    return journal.size();
+}
+
+const QVector<LedgerEntry> &Ledger::entries() const
+{
+    return journal;
+}
+
+void Ledger::clear()
+{
+    journal.clear();
+    accounts.clear();
+}
+
+Ledger::AuditSnapshot Ledger::snapshot() const
+{
+    AuditSnapshot s;
+    s.entries = journal;
+    s.balances.reserve(accounts.size());
+    for (auto it = accounts.constBegin(); it != accounts.constEnd(); ++it)
+        s.balances.insert(it.key(), it->balance);
+    return s;
+}
+
+QStringList Ledger::audit(const AuditSnapshot &snapshot)
+{
+    QStringList problems;
+    QHash<QString, Money> sums;
+
+    for (const auto &e : snapshot.entries) {
+        if (e.amount <= 0 || e.debit == e.credit)
+            problems.append(QString("entry %1 is malformed").arg(e.seq));
+        sums[e.debit] -= e.amount;
+        sums[e.credit] += e.amount;
+    }
+
+    Money total = 0;
+    for (auto it = snapshot.balances.constBegin(); it != snapshot.balances.constEnd(); ++it) {
+        Money expected = sums.value(it.key());
+        if (expected != it.value())
+            problems.append(QString("account %1: cached %2, journal %3")
+                                .arg(it.key()).arg(it.value()).arg(expected));
+        total += it.value();
+    }
+
+    if (total != 0)
+        problems.append(QString("ledger does not balance: %1").arg(total));
+
+    return problems;
+}
+
+Transaction Ledger::view(const LedgerEntry &e, const QString &account) const
+{
+    bool incoming = (e.credit == account);
+
+    Transaction t;
+    t.username = account;
+    t.type = e.type;
+    if (incoming && e.type == TransactionType::Purchase)
+        t.type = TransactionType::Sale;
+    t.relatedAdId = e.relatedAdId;
+    t.amount = incoming ? e.amount : -e.amount;
+    t.timestamp = e.timestamp;
+    t.description = incoming ? e.creditMemo : e.debitMemo;
+    t.relatedAdTitle = e.relatedAdTitle;
+    return t;
+}
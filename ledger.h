@@ -0,0 +1,76 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include "models.h"
+#include <QHash>
+#include <QVector>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// One posting moves `amount` from the debit account to the credit account.
+// Each side carries its own memo so the buyer and the seller of a purchase
+// see their own description.
+struct LedgerEntry {
+    quint64 seq;
+    Money amount;
+    TransactionType type;
+    int relatedAdId;
+    QString debit;
+    QString credit;
+    QString timestamp;
+    QString debitMemo;
+    QString creditMemo;
+    QString relatedAdTitle;
+};
+
+// Append-only double-entry journal for wallet money. Every account keeps
+// the indices of its own postings (its segment) and a cached running
+// balance, so balance lookups are O(1) and history reads are a slice of
+// the segment.
+class Ledger
+{
+public:
+    // Counter-account for money entering or leaving the marketplace.
+    static const QString ExternalAccount;
+    // Names starting with '@' belong to the ledger, never to a user.
+    static bool isReservedAccount(const QString &name);
+
+    struct AuditSnapshot {
+        QVector<LedgerEntry> entries;
+        QHash<QString, Money> balances;
+    };
+
+    const LedgerEntry &post(const QString &debit, const QString &credit, Money amount,
+                            TransactionType type, const QString &timestamp,
+                            const QString &debitMemo, const QString &creditMemo,
+                            int relatedAdId = 0, const QString &relatedAdTitle = QString());
+
+    Money balance(const QString &account) const;
+    int entryCount(const QString &account) const;
+    // Oldest first; limit < 0 reads to the end of the segment.
+    QList<Transaction> transactions(const QString &account, int offset, int limit) const;
+
+    int size() const;
+    const QVector<LedgerEntry> &entries() const;
+    void clear();
+
+    // Cheap to take (implicitly shared); audit() can then run on any thread.
+    AuditSnapshot snapshot() const;
+    // Re-sums the journal and returns the accounts whose cached balance
+    // disagrees with it, plus any entry that does not balance.
+    static QStringList audit(const AuditSnapshot &snapshot);
+
+private:
+    struct Account {
+        QVector<int> entries;
+        Money balance = 0;
+    };
+
+    QVector<LedgerEntry> journal;
+    QHash<QString, Account> accounts;
+
+    Transaction view(const LedgerEntry &e, const QString &account) const;
+};
+
+#endif
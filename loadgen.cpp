@@ -0,0 +1,484 @@
+#include "loadgen.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QRandomGenerator>
+#include <QUuid>
+#include <QTextStream>
+#include <QtMath>
+#include <algorithm>
+#include <utility>
+
+namespace {
+const QString LOADGEN_PASSWORD = "loadgen-password";
+const int     TICK_INTERVAL_MS = 1;
+const int     SETUP_TIMEOUT_MS = 10000;
+const int     DRAIN_TIMEOUT_MS = 5000;
+const double  SEED_DEPOSIT     = 1000000.0;
+
+double percentileMs(const QVector<qint64> &sorted, double p)
+{
+    if (sorted.isEmpty())
+        return 0.0;
+    int idx = qBound(0, int(qCeil(p * sorted.size())) - 1, int(sorted.size()) - 1);
+    return sorted.at(idx) / 1e6;
+}
+}
+
+LoadGenerator::LoadGenerator(const Options &opts, QObject *parent)
+    : QObject(parent)
+    , options(opts)
+    , measureStartNs(0)
+    , measureEndNs(0)
+    , sent(0)
+    , missed(0)
+    , nextConn(0)
+    , totalWeight(0)
+    , measuring(false)
+    , draining(false)
+    , done(false)
+{
+    if (options.mix.isEmpty())
+        options.mix = defaultMix();
+    for (int w : std::as_const(options.mix))
+        totalWeight += w;
+
+    tickTimer.setTimerType(Qt::PreciseTimer);
+    connect(&tickTimer, &QTimer::timeout, this, &LoadGenerator::onTick);
+
+    setupTimer.setSingleShot(true);
+    connect(&setupTimer, &QTimer::timeout, this, &LoadGenerator::onSetupTimeout);
+}
+
+QMap<QString, int> LoadGenerator::defaultMix()
+{
+    return {
+        {"login", 10},
+        {"get_ads", 40},
+        {"add_to_cart", 20},
+        {"purchase_cart", 5},
+        {"wallet_deposit", 15},
+        {"get_admin_stats", 5},
+        {"get_pending_ads", 5},
+    };
+}
+
+QStringList LoadGenerator::supportedTypes()
+{
+    return defaultMix().keys();
+}
+
+void LoadGenerator::start()
+{
+    clock.start();
+    conns.resize(options.connections);
+
+    for (int i = 0; i < conns.size(); ++i) {
+        Connection &c = conns[i];
+        c.socket = new QTcpSocket(this);
+        c.username = QString("loadgen_%1").arg(i);
+        c.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        connect(c.socket, &QTcpSocket::connected, this, [this, i]() { onConnected(i); });
+        connect(c.socket, &QTcpSocket::readyRead, this, [this, i]() { onReadyRead(i); });
+        connect(c.socket, &QTcpSocket::errorOccurred, this, [this, i]() { onSocketError(i); });
+
+        c.socket->connectToHost(options.host, options.port);
+    }
+
+    setupTimer.start(SETUP_TIMEOUT_MS);
+}
+
+int LoadGenerator::exitCode() const
+{
+    for (const auto &c : conns)
+        if (c.failed)
+            return 1;
+    for (const auto &s : stats)
+        if (s.rateLimited > 0)
+            return 1;
+    for (const auto &s : stats)
+        if (!s.latenciesNs.isEmpty())
+            return 0;
+    return 1;
+}
+
+void LoadGenerator::onConnected(int index)
+{
+    sendSetup(index);
+}
+
+// Every connection registers its own user, funds the wallet and lists one
+// approved ad so that add_to_cart and purchase_cart have something to hit.
+// None of this is measured.
+void LoadGenerator::sendSetup(int index)
+{
+    Connection &c = conns[index];
+    c.setupLeft = 3;
+
+    QJsonObject signup;
+    signup["type"] = "signup";
+    signup["username"] = c.username;
+    signup["password"] = LOADGEN_PASSWORD;
+    signup["name"] = c.username;
+    signup["email"] = c.username + "@loadgen.local";
+    signup["phone"] = "09000000000";
+    send(index, signup, false);
+
+    QJsonObject deposit;
+    deposit["type"] = "wallet_deposit";
+    deposit["username"] = c.username;
+    deposit["amount"] = SEED_DEPOSIT;
+    send(index, deposit, false);
+
+    replenishAd(index);
+}
+
+void LoadGenerator::replenishAd(int index)
+{
+    QJsonObject ad;
+    ad["type"] = "add_ad";
+    ad["username"] = conns[index].username;
+    ad["title"] = QString("Loadgen item %1").arg(QRandomGenerator::global()->bounded(1000000));
+    ad["description"] = "Synthetic listing created by kalanet-loadgen";
+    ad["price"] = 10.0;
+    ad["category"] = "Other";
+    send(index, ad, false);
+}
+
+void LoadGenerator::send(int index, const QJsonObject &req, bool measured, int adId)
+{
+    Connection &c = conns[index];
+
+    QByteArray data = QJsonDocument(req).toJson(QJsonDocument::Compact);
+    data.append('\n');
+
+    Pending p;
+    p.type = req.value("type").toString();
+    p.sentNs = clock.nsecsElapsed();
+    p.measured = measured;
+    p.adId = adId;
+    c.inFlight.enqueue(p);
+
+    c.socket->write(data);
+}
+
+void LoadGenerator::onReadyRead(int index)
+{
+    Connection &c = conns[index];
+    c.buffer.append(c.socket->readAll());
+
+    while (true) {
+        int idx = c.buffer.indexOf('\n');
+        if (idx < 0)
+            break;
+
+        QByteArray line = c.buffer.left(idx);
+        c.buffer.remove(0, idx + 1);
+        if (line.trimmed().isEmpty())
+            continue;
+
+        QJsonParseError err;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &err);
+        handleResponse(index, doc.isObject() ? doc.object() : QJsonObject());
+    }
+}
+
+// The server answers requests on one connection strictly in order, so the
+// oldest in-flight request is the one this response belongs to.
+void LoadGenerator::handleResponse(int index, const QJsonObject &res)
+{
+    Connection &c = conns[index];
+    if (c.inFlight.isEmpty())
+        return;
+
+    Pending p = c.inFlight.dequeue();
+    qint64 now = clock.nsecsElapsed();
+
+    bool ok = !res.isEmpty()
+              && res.value("type").toString() != "error"
+              && res.value("success").toBool(true);
+    bool limited = res.value("code").toString() == "rate_limited";
+
+    if (p.measured) {
+        TypeStats &s = stats[p.type];
+        if (limited) {
+            s.rateLimited++;
+        } else {
+            s.latenciesNs.append(now - p.sentNs);
+            if (!ok)
+                s.errors++;
+        }
+    }
+
+    if (p.type == "add_ad" && ok) {
+        int adId = res.value("ad_id").toInt();
+        QJsonObject approve;
+        approve["type"] = "approve_ad";
+        approve["ad_id"] = adId;
+        if (!c.ready)
+            c.setupLeft++;
+        send(index, approve, false, adId);
+    } else if (p.type == "approve_ad" && ok) {
+        adPool.append(p.adId);
+    } else if (p.type == "get_ads" && ok && adPool.isEmpty()) {
+        for (const auto &v : res.value("ads").toArray())
+            adPool.append(v.toObject().value("id").toInt());
+    } else if (p.type == "purchase_cart" && ok) {
+        for (const auto &v : res.value("ad_ids").toArray()) {
+            adPool.removeAll(v.toInt());
+            replenishAd(index);
+        }
+    }
+
+    if (!c.ready && !p.measured) {
+        c.setupLeft--;
+        if (c.setupLeft <= 0) {
+            c.ready = true;
+            maybeStartMeasuring();
+        }
+    }
+
+    if (draining)
+        checkDrained();
+}
+
+void LoadGenerator::checkDrained()
+{
+    for (const auto &c : std::as_const(conns))
+        if (c.ready && !c.inFlight.isEmpty())
+            return;
+    finish();
+}
+
+void LoadGenerator::onSocketError(int index)
+{
+    Connection &c = conns[index];
+    if (c.failed)
+        return;
+
+    c.failed = true;
+    c.ready = false;
+    QTextStream(stderr) << "connection " << index << ": " << c.socket->errorString() << "\n";
+    maybeStartMeasuring();
+}
+
+void LoadGenerator::onSetupTimeout()
+{
+    if (measuring)
+        return;
+
+    QTextStream(stderr) << "setup did not finish in time; measuring with the ready connections\n";
+    for (auto &c : conns)
+        if (!c.ready)
+            c.failed = true;
+    maybeStartMeasuring();
+}
+
+void LoadGenerator::maybeStartMeasuring()
+{
+    if (measuring)
+        return;
+
+    int ready = 0;
+    for (const auto &c : std::as_const(conns)) {
+        if (!c.ready && !c.failed)
+            return;
+        if (c.ready)
+            ready++;
+    }
+
+    if (ready == 0) {
+        finish();
+        return;
+    }
+
+    setupTimer.stop();
+    measuring = true;
+    measureStartNs = clock.nsecsElapsed();
+    tickTimer.start(TICK_INTERVAL_MS);
+}
+
+// Open-loop pacing: issue however many requests the target rate says
+// should have been sent by now, spread round-robin over the connections.
+// A connection with too many unanswered requests is skipped; if all are
+// saturated the request is counted as missed instead of queued.
+void LoadGenerator::onTick()
+{
+    qint64 now = clock.nsecsElapsed();
+    qint64 elapsed = now - measureStartNs;
+
+    if (elapsed >= qint64(options.durationSec) * 1000000000LL) {
+        tickTimer.stop();
+        measureEndNs = now;
+        measuring = false;
+        draining = true;
+        QTimer::singleShot(DRAIN_TIMEOUT_MS, this, &LoadGenerator::finish);
+        checkDrained();
+        return;
+    }
+
+    qint64 due = qint64(options.rate * (elapsed / 1e9));
+    while (sent + missed < due) {
+        int chosen = -1;
+        for (int n = 0; n < conns.size(); ++n) {
+            int i = (nextConn + n) % conns.size();
+            if (conns[i].ready && conns[i].inFlight.size() < options.maxInFlight) {
+                chosen = i;
+                break;
+            }
+        }
+
+        if (chosen < 0) {
+            missed++;
+            continue;
+        }
+
+        nextConn = (chosen + 1) % conns.size();
+        send(chosen, buildRequest(chosen, pickType()), true);
+        sent++;
+    }
+
+    for (auto &c : conns)
+        if (c.socket && c.socket->bytesToWrite() > 0)
+            c.socket->flush();
+}
+
+QString LoadGenerator::pickType() const
+{
+    int r = QRandomGenerator::global()->bounded(qMax(totalWeight, 1));
+    for (auto it = options.mix.constBegin(); it != options.mix.constEnd(); ++it) {
+        if (r < it.value())
+            return it.key();
+        r -= it.value();
+    }
+    return "get_ads";
+}
+
+QJsonObject LoadGenerator::buildRequest(int index, const QString &type)
+{
+    const QString &user = conns[index].username;
+
+    QJsonObject req;
+    req["type"] = type;
+
+    if (type == "login") {
+        req["username"] = user;
+        req["password"] = LOADGEN_PASSWORD;
+    } else if (type == "get_ads") {
+        req["status"] = "Approved";
+    } else if (type == "add_to_cart") {
+        req["username"] = user;
+        if (!adPool.isEmpty())
+            req["ad_id"] = adPool.at(QRandomGenerator::global()->bounded(int(adPool.size())));
+    } else if (type == "purchase_cart") {
+        req["username"] = user;
+        req["idempotency_key"] = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    } else if (type == "wallet_deposit") {
+        req["username"] = user;
+        req["amount"] = 100.0;
+    } else {
+        req["username"] = user;
+    }
+
+    return req;
+}
+
+void LoadGenerator::finish()
+{
+    if (done)
+        return;
+    done = true;
+    if (measureEndNs == 0)
+        measureEndNs = clock.nsecsElapsed();
+
+    draining = false;
+    tickTimer.stop();
+    setupTimer.stop();
+
+    for (auto &c : conns)
+        if (c.socket)
+            c.socket->disconnect(this);
+
+    report();
+    emit finished();
+}
+
+void LoadGenerator::report() const
+{
+    QTextStream out(stdout);
+    double seconds = qMax(1e-9, (measureEndNs - measureStartNs) / 1e9);
+
+    if (options.jsonReport) {
+        QJsonObject root;
+        root["duration_s"] = seconds;
+        root["sent"] = double(sent);
+        root["missed"] = double(missed);
+        QJsonObject types;
+        for (auto it = stats.constBegin(); it != stats.constEnd(); ++it) {
+            QVector<qint64> sorted = it->latenciesNs;
+            std::sort(sorted.begin(), sorted.end());
+            QJsonObject t;
+            t["count"] = sorted.size();
+            t["errors"] = double(it->errors);
+            t["rate_limited"] = double(it->rateLimited);
+            t["throughput_rps"] = sorted.size() / seconds;
+            t["p50_ms"] = percentileMs(sorted, 0.50);
+            t["p99_ms"] = percentileMs(sorted, 0.99);
+            t["p999_ms"] = percentileMs(sorted, 0.999);
+            t["max_ms"] = sorted.isEmpty() ? 0.0 : sorted.last() / 1e6;
+            types[it.key()] = t;
+        }
+        root["types"] = types;
+        out << QJsonDocument(root).toJson(QJsonDocument::Indented);
+        reportRateLimited();
+        return;
+    }
+
+    out << QString("duration %1 s, sent %2, missed %3 (all connections saturated)\n")
+               .arg(seconds, 0, 'f', 2).arg(sent).arg(missed);
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n")
+               .arg("type", -18).arg("count", 9).arg("errors", 7).arg("limited", 8)
+               .arg("req/s", 10).arg("p50 ms", 9).arg("p99 ms", 9).arg("p999 ms", 9)
+               .arg("max ms", 9);
+
+    QVector<qint64> all;
+    qint64 allErrors = 0;
+    qint64 allLimited = 0;
+    for (auto it = stats.constBegin(); it != stats.constEnd(); ++it) {
+        QVector<qint64> sorted = it->latenciesNs;
+        std::sort(sorted.begin(), sorted.end());
+        all += sorted;
+        allErrors += it->errors;
+        allLimited += it->rateLimited;
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n")
+                   .arg(it.key(), -18).arg(sorted.size(), 9).arg(it->errors, 7)
+                   .arg(it->rateLimited, 8)
+                   .arg(sorted.size() / seconds, 10, 'f', 1)
+                   .arg(percentileMs(sorted, 0.50), 9, 'f', 3)
+                   .arg(percentileMs(sorted, 0.99), 9, 'f', 3)
+                   .arg(percentileMs(sorted, 0.999), 9, 'f', 3)
+                   .arg(sorted.isEmpty() ? 0.0 : sorted.last() / 1e6, 9, 'f', 3);
+    }
+
+    std::sort(all.begin(), all.end());
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n")
+               .arg("total", -18).arg(all.size(), 9).arg(allErrors, 7).arg(allLimited, 8)
+               .arg(all.size() / seconds, 10, 'f', 1)
+               .arg(percentileMs(all, 0.50), 9, 'f', 3)
+               .arg(percentileMs(all, 0.99), 9, 'f', 3)
+               .arg(percentileMs(all, 0.999), 9, 'f', 3)
+               .arg(all.isEmpty() ? 0.0 : all.last() / 1e6, 9, 'f', 3);
+    reportRateLimited();
+}
+
+void LoadGenerator::reportRateLimited() const
+{
+    qint64 limited = 0;
+    for (const auto &s : stats)
+        limited += s.rateLimited;
+    if (limited == 0)
+        return;
+    QTextStream(stderr) << limited << " requests were rate limited; start the server with "
+                           "--no-rate-limits and higher --rate-per-connection/--rate-per-ip "
+                           "to measure throughput\n";
+}
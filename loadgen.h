@@ -0,0 +1,113 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QMap>
+#include <QVector>
+#include <QList>
+#include <QJsonObject>
+
+// Drives a running ServerCore over its line-delimited JSON protocol with
+// a fixed number of connections and an open-loop target request rate,
+// then reports throughput and latency percentiles per request type.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString host = "127.0.0.1";
+        quint16 port = 4545;
+        int connections = 16;
+        double rate = 1000.0;         // requests per second, all connections
+        int durationSec = 30;
+        int maxInFlight = 64;         // per connection
+        QMap<QString, int> mix;       // request type -> weight
+        bool jsonReport = false;
+    };
+
+    explicit LoadGenerator(const Options &options, QObject *parent = nullptr);
+
+    void start();
+    // Non-zero if connections failed, the server rate limited any
+    // measured request, or nothing was measured.
+    int exitCode() const;
+
+    static QMap<QString, int> defaultMix();
+    static QStringList supportedTypes();
+
+signals:
+    void finished();
+
+private slots:
+    void onTick();
+    void onSetupTimeout();
+
+private:
+    struct Pending {
+        QString type;
+        qint64  sentNs;
+        bool    measured;
+        int     adId;
+    };
+
+    struct Connection {
+        QTcpSocket     *socket = nullptr;
+        QByteArray      buffer;
+        QQueue<Pending> inFlight;
+        QString         username;
+        int             setupLeft = 0;
+        bool            ready = false;
+        bool            failed = false;
+    };
+
+    // Rate-limited replies are counted apart and left out of the
+    // latencies: they measure the limiter, not the request.
+    struct TypeStats {
+        QVector<qint64> latenciesNs;
+        qint64 errors = 0;
+        qint64 rateLimited = 0;
+    };
+
+    Options options;
+    QVector<Connection> conns;
+    QList<int> adPool;
+
+    QTimer tickTimer;
+    QTimer setupTimer;
+    QElapsedTimer clock;
+    qint64 measureStartNs;
+    qint64 measureEndNs;
+    qint64 sent;
+    qint64 missed;
+    int nextConn;
+    int totalWeight;
+    bool measuring;
+    bool draining;
+    bool done;
+
+    QMap<QString, TypeStats> stats;
+
+    void onConnected(int index);
+    void onReadyRead(int index);
+    void onSocketError(int index);
+    void handleResponse(int index, const QJsonObject &res);
+
+    void send(int index, const QJsonObject &req, bool measured, int adId = 0);
+    void sendSetup(int index);
+    void replenishAd(int index);
+    QJsonObject buildRequest(int index, const QString &type);
+    QString pickType() const;
+
+    void maybeStartMeasuring();
+    void checkDrained();
+    void finish();
+    void report() const;
+    void reportRateLimited() const;
+};
+
+#endif
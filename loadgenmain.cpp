@@ -0,0 +1,84 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include "loadgen.h"
+
+namespace {
+// "get_ads=40,login=10" -> {get_ads: 40, login: 10}
+bool parseMix(const QString &text, QMap<QString, int> *mix, QString *error)
+{
+    const QStringList known = LoadGenerator::supportedTypes();
+    for (const QString &part : text.split(',', Qt::SkipEmptyParts)) {
+        QStringList kv = part.split('=');
+        bool ok = false;
+        int weight = kv.size() == 2 ? kv.at(1).toInt(&ok) : 0;
+        QString type = kv.value(0).trimmed();
+        if (!ok || weight < 0 || !known.contains(type)) {
+            *error = QString("invalid mix entry '%1' (types: %2)").arg(part, known.join(", "));
+            return false;
+        }
+        if (weight > 0)
+            mix->insert(type, weight);
+    }
+    return true;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("kalanet-loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Replays a request mix against a KalaNet server and reports throughput and latency "
+        "per request type.\n\n"
+        "The server's default limits throttle this load (token buckets on get_ads and other "
+        "expensive types, 100 req/s per connection, 500 req/s per address). Start it with "
+        "--no-rate-limits and higher --rate-per-connection/--rate-per-ip when measuring; "
+        "rate-limited replies are reported in their own column and fail the run.");
+    parser.addHelpOption();
+
+    LoadGenerator::Options defaults;
+    QCommandLineOption hostOption("host", "Server address.", "host", defaults.host);
+    QCommandLineOption portOption({"p", "port"}, "Server port.", "port",
+                                  QString::number(defaults.port));
+    QCommandLineOption connOption({"c", "connections"}, "Concurrent connections.", "n",
+                                  QString::number(defaults.connections));
+    QCommandLineOption rateOption({"r", "rate"}, "Target requests per second.", "rps",
+                                  QString::number(defaults.rate));
+    QCommandLineOption durationOption({"d", "duration"}, "Measurement time in seconds.", "s",
+                                      QString::number(defaults.durationSec));
+    QCommandLineOption inFlightOption("max-in-flight", "Unanswered requests per connection.",
+                                      "n", QString::number(defaults.maxInFlight));
+    QCommandLineOption mixOption("mix", "Weighted request mix, e.g. get_ads=40,login=10.", "mix");
+    QCommandLineOption jsonOption("json", "Print the report as JSON.");
+    parser.addOptions({hostOption, portOption, connOption, rateOption, durationOption,
+                       inFlightOption, mixOption, jsonOption});
+    parser.process(a);
+
+    LoadGenerator::Options options;
+    options.host = parser.value(hostOption);
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.connections = qMax(1, parser.value(connOption).toInt());
+    options.rate = qMax(1.0, parser.value(rateOption).toDouble());
+    options.durationSec = qMax(1, parser.value(durationOption).toInt());
+    options.maxInFlight = qMax(1, parser.value(inFlightOption).toInt());
+    options.jsonReport = parser.isSet(jsonOption);
+
+    if (parser.isSet(mixOption)) {
+        QString error;
+        if (!parseMix(parser.value(mixOption), &options.mix, &error)) {
+            QTextStream(stderr) << error << "\n";
+            return 2;
+        }
+    }
+
+    LoadGenerator gen(options);
+    QObject::connect(&gen, &LoadGenerator::finished, &a, [&a, &gen]() {
+        a.exit(gen.exitCode());
+    });
+    gen.start();
+
+    return a.exec();
+}
@@ -0,0 +1,228 @@
+#include "logger.h"
+#include <QDateTime>
+#include <QDebug>
+#include <cstdio>
+
+namespace {
+const int WRITER_IDLE_MS = 5;
+const int WRITE_BATCH_BYTES = 64 * 1024;
+const char *LEVEL_NAMES[] = {"debug", "info", "warning", "error"};
+
+void appendJsonString(QByteArray &out, const QString &s)
+{
+    out += '"';
+    const QByteArray utf8 = s.toUtf8();
+    for (char c : utf8) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (uchar(c) < 0x20) {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", uchar(c));
+                out += esc;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+}
+
+Logger &Logger::instance()
+{
+    static Logger l;
+    return l;
+}
+
+Logger::Logger()
+    : running(false)
+    , minLevel(Info)
+    , accessEnabled(false)
+    , droppedCount(0)
+    , writer(nullptr)
+    , reportedDrops(0)
+{
+}
+
+Logger::~Logger()
+{
+    stop();
+}
+
+bool Logger::start(const Options &options)
+{
+    stop();
+
+    bool opened;
+    if (options.path.isEmpty()) {
+        opened = out.open(stderr, QIODevice::WriteOnly);
+    } else {
+        out.setFileName(options.path);
+        opened = out.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+    if (!opened)
+        return false;
+
+    ring.reset(new MpmcRing<Record>(options.queueCapacity));
+    minLevel = options.level;
+    accessEnabled = options.accessLog;
+    droppedCount = 0;
+    reportedDrops = 0;
+    running = true;
+
+    writer = QThread::create([this]() { writerLoop(); });
+    writer->setObjectName("kalanet-logger");
+    writer->start(QThread::LowPriority);
+    return true;
+}
+
+void Logger::stop()
+{
+    if (!writer)
+        return;
+
+    running = false;
+    writer->wait();
+    delete writer;
+    writer = nullptr;
+
+    drain();
+    out.close();
+}
+
+bool Logger::isEnabled(Level level) const
+{
+    return level >= minLevel.load(std::memory_order_relaxed);
+}
+
+bool Logger::accessLogEnabled() const
+{
+    return accessEnabled.load(std::memory_order_relaxed) && running.load(std::memory_order_relaxed);
+}
+
+void Logger::log(Level level, const QString &msg)
+{
+    if (!isEnabled(level))
+        return;
+
+    if (!running.load(std::memory_order_acquire)) {
+        qDebug().noquote() << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << msg;
+        return;
+    }
+
+    Record r;
+    r.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    r.level = level;
+    r.text = msg;
+    enqueue(std::move(r));
+}
+
+void Logger::access(quint64 connectionId, const QString &type, qint64 latencyNs,
+                    qint64 bytesIn, qint64 bytesOut, const QString &result)
+{
+    if (!accessLogEnabled())
+        return;
+
+    Record r;
+    r.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    r.isAccess = true;
+    r.text = type;
+    r.result = result;
+    r.connectionId = connectionId;
+    r.latencyNs = latencyNs;
+    r.bytesIn = bytesIn;
+    r.bytesOut = bytesOut;
+    enqueue(std::move(r));
+}
+
+qint64 Logger::dropped() const
+{
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+bool Logger::levelFromString(const QString &name, Level *level)
+{
+    for (int i = 0; i <= Error; ++i) {
+        if (name.compare(QLatin1String(LEVEL_NAMES[i]), Qt::CaseInsensitive) == 0) {
+            *level = Level(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::enqueue(Record &&record)
+{
+    if (!ring->push(std::move(record)))
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::writerLoop()
+{
+    while (running.load(std::memory_order_acquire)) {
+        if (drain() == 0)
+            QThread::msleep(WRITER_IDLE_MS);
+    }
+}
+
+// Formats and writes everything currently queued; returns the count.
+int Logger::drain()
+{
+    QByteArray batch;
+    Record r;
+    int n = 0;
+    while (ring->pop(r)) {
+        format(r, batch);
+        ++n;
+        if (batch.size() >= WRITE_BATCH_BYTES) {
+            out.write(batch);
+            batch.clear();
+        }
+    }
+
+    const qint64 drops = dropped();
+    if (drops != reportedDrops) {
+        Record note;
+        note.timestampMs = QDateTime::currentMSecsSinceEpoch();
+        note.level = Warning;
+        note.text = QString("Log queue full, dropped %1 records").arg(drops - reportedDrops);
+        format(note, batch);
+        reportedDrops = drops;
+    }
+
+    if (!batch.isEmpty()) {
+        out.write(batch);
+        out.flush();
+    }
+    return n;
+}
+
+void Logger::format(const Record &r, QByteArray &line)
+{
+    line += "{\"ts\":";
+    appendJsonString(line, QDateTime::fromMSecsSinceEpoch(r.timestampMs, Qt::UTC)
+                               .toString(Qt::ISODateWithMs));
+    line += ",\"level\":\"";
+    line += LEVEL_NAMES[r.level];
+    line += '"';
+
+    if (r.isAccess) {
+        line += ",\"event\":\"access\",\"conn\":" + QByteArray::number(r.connectionId);
+        line += ",\"type\":";
+        appendJsonString(line, r.text);
+        line += ",\"latency_us\":" + QByteArray::number(r.latencyNs / 1000.0, 'f', 1);
+        line += ",\"bytes_in\":" + QByteArray::number(r.bytesIn);
+        line += ",\"bytes_out\":" + QByteArray::number(r.bytesOut);
+        line += ",\"result\":";
+        appendJsonString(line, r.result);
+    } else {
+        line += ",\"msg\":";
+        appendJsonString(line, r.text);
+    }
+    line += "}\n";
+}
@@ -0,0 +1,159 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QThread>
+#include <atomic>
+#include <memory>
+
+// Bounded multi-producer/multi-consumer ring (Vyukov). push() and pop()
+// never take a lock; push() fails instead of blocking when the ring is full.
+template <typename T>
+class MpmcRing
+{
+public:
+    explicit MpmcRing(int capacity);
+
+    bool push(T &&value);
+    bool pop(T &value);
+
+private:
+    struct Slot {
+        std::atomic<quint64> seq;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    quint64 mask;
+    alignas(64) std::atomic<quint64> head;
+    alignas(64) std::atomic<quint64> tail;
+};
+
+// Structured JSON-lines logger. Callers only fill a record and push it
+// onto the ring; formatting and I/O happen on a background writer thread.
+// When the ring is full records are dropped and counted, so logging can
+// never stall request handling.
+class Logger
+{
+public:
+    enum Level { Debug, Info, Warning, Error };
+
+    struct Options {
+        QString path;                 // empty writes to stderr
+        Level level = Info;
+        bool accessLog = false;       // one line per handled request
+        int queueCapacity = 65536;    // rounded up to a power of two
+    };
+
+    static Logger &instance();
+
+    bool start(const Options &options);
+    // Writes out everything still queued and stops the writer thread.
+    void stop();
+
+    bool isEnabled(Level level) const;
+    bool accessLogEnabled() const;
+
+    // Before start() messages go straight to qDebug, as they used to.
+    void log(Level level, const QString &msg);
+    void access(quint64 connectionId, const QString &type, qint64 latencyNs,
+                qint64 bytesIn, qint64 bytesOut, const QString &result);
+
+    qint64 dropped() const;
+
+    static bool levelFromString(const QString &name, Level *level);
+
+private:
+    Logger();
+    ~Logger();
+
+    struct Record {
+        qint64  timestampMs = 0;
+        Level   level = Info;
+        bool    isAccess = false;
+        QString text;                 // message, or request type for access
+        QString result;
+        quint64 connectionId = 0;
+        qint64  latencyNs = 0;
+        qint64  bytesIn = 0;
+        qint64  bytesOut = 0;
+    };
+
+    std::unique_ptr<MpmcRing<Record>> ring;
+    std::atomic<bool> running;
+    std::atomic<int> minLevel;
+    std::atomic<bool> accessEnabled;
+    std::atomic<qint64> droppedCount;
+    QThread *writer;
+    QFile out;
+    qint64 reportedDrops;             // writer thread only
+
+    void enqueue(Record &&record);
+    void writerLoop();
+    int drain();
+    static void format(const Record &r, QByteArray &line);
+};
+
+template <typename T>
+MpmcRing<T>::MpmcRing(int capacity)
+    : head(0)
+    , tail(0)
+{
+    quint64 size = 2;
+    while (size < quint64(capacity))
+        size <<= 1;
+    slots.reset(new Slot[size]);
+    for (quint64 i = 0; i < size; ++i)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    mask = size - 1;
+}
+
+template <typename T>
+bool MpmcRing<T>::push(T &&value)
+{
+    quint64 pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        quint64 seq = slot->seq.load(std::memory_order_acquire);
+        qint64 diff = qint64(seq) - qint64(pos);
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->value = std::move(value);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool MpmcRing<T>::pop(T &value)
+{
+    quint64 pos = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        quint64 seq = slot->seq.load(std::memory_order_acquire);
+        qint64 diff = qint64(seq) - qint64(pos + 1);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    value = std::move(slot->value);
+    slot->seq.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+#endif
@@ -24,6 +24,7 @@ LoginWindow::LoginWindow(QWidget *parent)
     , ui(new Ui::LoginWindow)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
 {
     ui->setupUi(this);
     setWindowTitle("KalaNet - Login");
@@ -43,6 +44,7 @@ LoginWindow::LoginWindow(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &LoginWindow::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &LoginWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &LoginWindow::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &LoginWindow::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -116,6 +118,7 @@ void LoginWindow::connectToServer()
         socket->abort();
     }
 
+    reader->reset();
     socket->connectToHost(QHostAddress(SERVER_IP), SERVER_PORT);
     connectionTimer->start(CONNECTION_TIMEOUT_MS);
 }
@@ -199,47 +202,36 @@ void LoginWindow::onDisconnected()
 
 void LoginWindow::onReadyRead()
 {
+    reader->feed(socket->readAll());
+}
 
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (QByteArray msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
-
-        QJsonObject obj = doc.object();
-        const QString type = obj.value("type").toString();
+void LoginWindow::onMessage(const QJsonObject &obj)
+{
+    const QString type = obj.value("type").toString();
 
-        if (type == "login_response") {
-            bool success       = obj.value("success").toBool(false);
-            QString message    = obj.value("message").toString();
-            QString username   = ui->usernameLineEdit->text().trimmed();
+    if (type == "login_response") {
+        bool success       = obj.value("success").toBool(false);
+        QString message    = obj.value("message").toString();
+        QString username   = ui->usernameLineEdit->text().trimmed();
 
-            if (success) {
-                if (message.isEmpty())
-                    message = "Login successful!";
+        if (success) {
+            if (message.isEmpty())
+                message = "Login successful!";
 
-                QMessageBox::information(this, "Login", message);
+            QMessageBox::information(this, "Login", message);
 
 
-                emit loginSuccessful(username);
+            emit loginSuccessful(username);
 
 
-                close();
-            } else {
-                if (message.isEmpty())
-                    message = "Invalid username or password.";
+            close();
+        } else {
+            if (message.isEmpty())
+                message = "Invalid username or password.";
 
-                QMessageBox::critical(this, "Login failed", message);
-                generateCaptcha();
-                ui->captchaLineEdit->clear();
-            }
+            QMessageBox::critical(this, "Login failed", message);
+            generateCaptcha();
+            ui->captchaLineEdit->clear();
         }
     }
 }
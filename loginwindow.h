@@ -4,6 +4,7 @@
 #include <QMainWindow>
 #include <QTcpSocket>
 #include <QTimer>
+#include "jsonlinereader.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class LoginWindow; }
@@ -36,6 +37,7 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
 
 private:
     Ui::LoginWindow *ui;
@@ -47,6 +49,7 @@ private:
     // Network
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
 
     QString serverIp;
     quint16 serverPort;
@@ -20,6 +20,7 @@ MainMenu::MainMenu(QWidget *parent)
     , ui(new Ui::MainMenu)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
     , currentRole(UserRole::NormalUser)
@@ -35,6 +36,7 @@ MainMenu::MainMenu(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &MainMenu::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &MainMenu::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &MainMenu::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &MainMenu::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -126,7 +128,7 @@ bool MainMenu::isAdmin() const
 
 void MainMenu::updateStatsOnUi()
 {
-    ui->walletButton->setText(QString("Wallet (%1 T)").arg(stats.walletBalance));
+    ui->walletButton->setText(QString("Wallet (%1 T)").arg(stats.walletBalance, 0, 'f', 2));
     ui->cartButton->setText(QString("Cart (%1)").arg(stats.cartItems));
     ui->browseAdsButton->setText(QString("Browse Ads (%1)").arg(stats.totalAds));
 
@@ -141,6 +143,7 @@ void MainMenu::updateStatsOnUi()
 void MainMenu::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
@@ -164,7 +167,7 @@ void MainMenu::handleInitResponse(const QJsonObject &obj)
     stats.totalAds           = obj.value("total_ads").toInt();
     stats.userAds            = obj.value("user_ads").toInt();
     stats.cartItems          = obj.value("cart_items").toInt();
-    stats.walletBalance      = obj.value("wallet_balance").toInt();
+    stats.walletBalance      = obj.value("wallet_balance").toDouble();
     stats.pendingApprovalAds = obj.value("pending_ads").toInt();
 
     updateStatsOnUi();
@@ -217,6 +220,7 @@ void MainMenu::on_logoutButton_clicked()
 
 void MainMenu::onConnected()
 {
+    connectionTimer->stop();
     sendInitialRequest();
 }
 
@@ -227,25 +231,15 @@ void MainMenu::onDisconnected()
 
 void MainMenu::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
+    reader->feed(socket->readAll());
+}
 
-        QJsonObject obj = doc.object();
-        QString type = obj["type"].toString();
+void MainMenu::onMessage(const QJsonObject &obj)
+{
+    QString type = obj["type"].toString();
 
-        if (type == "mainmenu_init_response") {
-            handleInitResponse(obj);
-        }
+    if (type == "mainmenu_init_response") {
+        handleInitResponse(obj);
     }
 }
 
@@ -5,6 +5,7 @@
 #include <QTcpSocket>
 #include <QTimer>
 #include <QMap>
+#include "jsonlinereader.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainMenu; }
@@ -21,7 +22,7 @@ struct MainMenuStats
     int totalAds            = 0;
     int userAds             = 0;
     int cartItems           = 0;
-    int walletBalance       = 0;
+    double walletBalance    = 0.0;
     int pendingApprovalAds  = 0;
 };
 
@@ -70,6 +71,7 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
 
 private:
     Ui::MainMenu *ui;
@@ -82,6 +84,7 @@ private:
     // Network
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
     QString     serverIp;
     quint16     serverPort;
 
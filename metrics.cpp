@@ -0,0 +1,289 @@
+#include "metrics.h"
+#include "database.h"
+#include <QtAlgorithms>
+#include <cmath>
+
+namespace {
+const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+const char *PHASE_NAMES[] = {"parse", "handle", "serialize"};
+const QString OTHER_REQUEST_TYPE = "other";
+
+double toMicros(qint64 ns)
+{
+    return ns / 1000.0;
+}
+
+QByteArray promNumber(double v)
+{
+    return QByteArray::number(v, 'g', 12);
+}
+
+QByteArray promLabel(const QString &value)
+{
+    QByteArray v = value.toUtf8();
+    v.replace('\\', "\\\\");
+    v.replace('"', "\\\"");
+    v.replace('\n', "\\n");
+    return v;
+}
+
+void promHeader(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+    out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+}
+}
+
+void LatencyHistogram::record(qint64 ns)
+{
+    if (counts.isEmpty())
+        counts.fill(0, BUCKETS);
+    if (ns < 0)
+        ns = 0;
+
+    counts[bucketFor(ns)]++;
+    total++;
+    sum += ns;
+    if (ns > max)
+        max = ns;
+}
+
+void LatencyHistogram::clear()
+{
+    counts.clear();
+    total = 0;
+    sum = 0;
+    max = 0;
+}
+
+qint64 LatencyHistogram::count() const
+{
+    return total;
+}
+
+qint64 LatencyHistogram::sumNs() const
+{
+    return sum;
+}
+
+qint64 LatencyHistogram::maxNs() const
+{
+    return max;
+}
+
+qint64 LatencyHistogram::percentileNs(double q) const
+{
+    if (total == 0)
+        return 0;
+
+    qint64 rank = qMax<qint64>(1, qint64(std::ceil(q * total)));
+    qint64 seen = 0;
+    for (int i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return qMin(bucketUpper(i), max);
+    }
+    return max;
+}
+
+int LatencyHistogram::bucketFor(qint64 ns)
+{
+    if (ns < SUB_BUCKETS)
+        return int(ns);
+
+    int exponent = 63 - qCountLeadingZeroBits(quint64(ns));
+    if (exponent > MAX_EXPONENT)
+        return BUCKETS - 1;
+    int sub = int((ns >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    return (exponent - 3) * SUB_BUCKETS + sub;
+}
+
+qint64 LatencyHistogram::bucketUpper(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    int exponent = index / SUB_BUCKETS + 3;
+    int sub = index % SUB_BUCKETS;
+    return (qint64(SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics m;
+    return m;
+}
+
+Metrics::Metrics()
+    : badRequests(0)
+    , responseCacheHits(0)
+    , responseCacheMisses(0)
+    , connectionsOpen(0)
+    , connectionsTotal(0)
+    , bufferedBytes(0)
+{
+    uptime.start();
+}
+
+void Metrics::recordRequest(const QString &type, qint64 parseNs, qint64 handleNs,
+                            qint64 serializeNs, qint64 responseBytes)
+{
+    QString key = type;
+    if (!requests.contains(key) && requests.size() >= MAX_REQUEST_TYPES)
+        key = OTHER_REQUEST_TYPE;
+
+    RequestStats &stats = requests[key];
+    stats.count++;
+    stats.responseBytes += responseBytes;
+    stats.phases[Parse].record(parseNs);
+    stats.phases[Handle].record(handleNs);
+    stats.phases[Serialize].record(serializeNs);
+}
+
+void Metrics::recordBadRequest()
+{
+    badRequests++;
+}
+
+void Metrics::recordRejected(const QString &reason)
+{
+    rejected[reason]++;
+}
+
+void Metrics::recordResponseCache(bool hit)
+{
+    if (hit)
+        responseCacheHits++;
+    else
+        responseCacheMisses++;
+}
+
+void Metrics::connectionOpened()
+{
+    connectionsOpen++;
+    connectionsTotal++;
+}
+
+void Metrics::connectionClosed()
+{
+    connectionsOpen--;
+}
+
+void Metrics::addBufferedBytes(qint64 delta)
+{
+    bufferedBytes += delta;
+}
+
+QJsonObject Metrics::toJson() const
+{
+    QJsonObject res;
+    res["uptime_sec"] = uptime.elapsed() / 1000;
+    res["connections_open"] = connectionsOpen;
+    res["connections_total"] = connectionsTotal;
+    res["buffered_bytes"] = bufferedBytes;
+    res["bad_requests"] = badRequests;
+
+    QJsonObject rej;
+    for (auto it = rejected.cbegin(); it != rejected.cend(); ++it)
+        rej[it.key()] = it.value();
+    res["rejected"] = rej;
+
+    QJsonObject cache;
+    cache["hits"] = responseCacheHits;
+    cache["misses"] = responseCacheMisses;
+    res["response_cache"] = cache;
+
+    QJsonObject reqs;
+    for (auto it = requests.cbegin(); it != requests.cend(); ++it) {
+        QJsonObject r;
+        r["count"] = it->count;
+        r["response_bytes"] = it->responseBytes;
+        for (int p = 0; p < PhaseCount; ++p) {
+            const LatencyHistogram &h = it->phases[p];
+            QJsonObject ph;
+            ph["mean_us"] = h.count() ? toMicros(h.sumNs()) / h.count() : 0.0;
+            ph["p50_us"] = toMicros(h.percentileNs(0.5));
+            ph["p90_us"] = toMicros(h.percentileNs(0.9));
+            ph["p99_us"] = toMicros(h.percentileNs(0.99));
+            ph["p999_us"] = toMicros(h.percentileNs(0.999));
+            ph["max_us"] = toMicros(h.maxNs());
+            r[PHASE_NAMES[p]] = ph;
+        }
+        reqs[it.key()] = r;
+    }
+    res["requests"] = reqs;
+
+    QJsonObject tables;
+    const QMap<QString, int> sizes = Database::instance().tableSizes();
+    for (auto it = sizes.cbegin(); it != sizes.cend(); ++it)
+        tables[it.key()] = it.value();
+    res["tables"] = tables;
+
+    return res;
+}
+
+QByteArray Metrics::toPrometheus() const
+{
+    QByteArray out;
+
+    promHeader(out, "kalanet_uptime_seconds", "gauge", "Seconds since the server started.");
+    out += "kalanet_uptime_seconds " + QByteArray::number(uptime.elapsed() / 1000) + '\n';
+
+    promHeader(out, "kalanet_connections_open", "gauge", "Currently open client connections.");
+    out += "kalanet_connections_open " + QByteArray::number(connectionsOpen) + '\n';
+
+    promHeader(out, "kalanet_connections_total", "counter", "Client connections accepted.");
+    out += "kalanet_connections_total " + QByteArray::number(connectionsTotal) + '\n';
+
+    promHeader(out, "kalanet_buffered_bytes", "gauge",
+               "Bytes held in read buffers waiting for a complete line.");
+    out += "kalanet_buffered_bytes " + QByteArray::number(bufferedBytes) + '\n';
+
+    promHeader(out, "kalanet_bad_requests_total", "counter", "Lines that were not a JSON object.");
+    out += "kalanet_bad_requests_total " + QByteArray::number(badRequests) + '\n';
+
+    promHeader(out, "kalanet_rejected_total", "counter",
+               "Connections and requests refused by a server limit, by reason.");
+    for (auto it = rejected.cbegin(); it != rejected.cend(); ++it)
+        out += "kalanet_rejected_total{reason=\"" + promLabel(it.key()) + "\"} "
+             + QByteArray::number(it.value()) + '\n';
+
+    promHeader(out, "kalanet_response_cache_total", "counter",
+               "List requests looked up in the encoded response cache, by result.");
+    out += "kalanet_response_cache_total{result=\"hit\"} " + QByteArray::number(responseCacheHits) + '\n';
+    out += "kalanet_response_cache_total{result=\"miss\"} " + QByteArray::number(responseCacheMisses) + '\n';
+
+    promHeader(out, "kalanet_requests_total", "counter", "Requests handled, by type.");
+    for (auto it = requests.cbegin(); it != requests.cend(); ++it)
+        out += "kalanet_requests_total{type=\"" + promLabel(it.key()) + "\"} "
+             + QByteArray::number(it->count) + '\n';
+
+    promHeader(out, "kalanet_response_bytes_total", "counter", "Response bytes written, by type.");
+    for (auto it = requests.cbegin(); it != requests.cend(); ++it)
+        out += "kalanet_response_bytes_total{type=\"" + promLabel(it.key()) + "\"} "
+             + QByteArray::number(it->responseBytes) + '\n';
+
+    promHeader(out, "kalanet_request_duration_seconds", "summary",
+               "Time spent per request, by type and phase.");
+    for (auto it = requests.cbegin(); it != requests.cend(); ++it) {
+        for (int p = 0; p < PhaseCount; ++p) {
+            const LatencyHistogram &h = it->phases[p];
+            QByteArray labels = "type=\"" + promLabel(it.key()) + "\",phase=\"" + PHASE_NAMES[p] + '"';
+            for (double q : QUANTILES)
+                out += "kalanet_request_duration_seconds{" + labels + ",quantile=\""
+                     + promNumber(q) + "\"} " + promNumber(h.percentileNs(q) / 1e9) + '\n';
+            out += "kalanet_request_duration_seconds_sum{" + labels + "} "
+                 + promNumber(h.sumNs() / 1e9) + '\n';
+            out += "kalanet_request_duration_seconds_count{" + labels + "} "
+                 + QByteArray::number(h.count()) + '\n';
+        }
+    }
+
+    promHeader(out, "kalanet_db_rows", "gauge", "Rows per in-memory database table.");
+    const QMap<QString, int> sizes = Database::instance().tableSizes();
+    for (auto it = sizes.cbegin(); it != sizes.cend(); ++it)
+        out += "kalanet_db_rows{table=\"" + promLabel(it.key()) + "\"} "
+             + QByteArray::number(it.value()) + '\n';
+
+    return out;
+}
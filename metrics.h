@@ -0,0 +1,92 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+#include <QJsonObject>
+#include <QElapsedTimer>
+
+// HDR-style latency histogram: exact below 16 ns, then 16 linear
+// sub-buckets per power of two (about 6% relative error) up to ~550 s.
+// Buckets are allocated on the first record().
+class LatencyHistogram
+{
+public:
+    void record(qint64 ns);
+    void clear();
+
+    qint64 count() const;
+    qint64 sumNs() const;
+    qint64 maxNs() const;
+    // Upper bound of the bucket holding the q-th value, 0 <= q <= 1.
+    qint64 percentileNs(double q) const;
+
+private:
+    static const int SUB_BUCKETS = 16;
+    static const int MAX_EXPONENT = 39;
+    static const int BUCKETS = (MAX_EXPONENT - 2) * SUB_BUCKETS;
+
+    QVector<qint64> counts;
+    qint64 total = 0;
+    qint64 sum = 0;
+    qint64 max = 0;
+
+    static int bucketFor(qint64 ns);
+    static qint64 bucketUpper(int index);
+};
+
+// Server-wide counters and per-request-type latency, split into the
+// parse, handle and serialize phases of ServerCore::processBuffer().
+// Owned by the server's event-loop thread; not thread-safe.
+class Metrics
+{
+public:
+    enum Phase { Parse, Handle, Serialize, PhaseCount };
+
+    static Metrics &instance();
+
+    void recordRequest(const QString &type, qint64 parseNs, qint64 handleNs,
+                       qint64 serializeNs, qint64 responseBytes);
+    // A line that was not a JSON object.
+    void recordBadRequest();
+    // A connection or request refused by a server limit, by reason code.
+    void recordRejected(const QString &reason);
+    // A list request looked up in the server's encoded response cache.
+    void recordResponseCache(bool hit);
+
+    void connectionOpened();
+    void connectionClosed();
+    // Bytes sitting in per-connection read buffers waiting for a '\n'.
+    void addBufferedBytes(qint64 delta);
+
+    // Body of the get_metrics response (without "type").
+    QJsonObject toJson() const;
+    // Prometheus text exposition format, version 0.0.4.
+    QByteArray toPrometheus() const;
+
+private:
+    Metrics();
+
+    struct RequestStats {
+        qint64 count = 0;
+        qint64 responseBytes = 0;
+        LatencyHistogram phases[PhaseCount];
+    };
+
+    // Request types come from clients, so cap how many get their own row.
+    static const int MAX_REQUEST_TYPES = 64;
+
+    QMap<QString, RequestStats> requests;
+    QMap<QString, qint64> rejected;
+    qint64 badRequests;
+    qint64 responseCacheHits;
+    qint64 responseCacheMisses;
+    qint64 connectionsOpen;
+    qint64 connectionsTotal;
+    qint64 bufferedBytes;
+    QElapsedTimer uptime;
+};
+
+#endif
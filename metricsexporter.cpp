@@ -0,0 +1,60 @@
+#include "metricsexporter.h"
+#include "metrics.h"
+
+namespace {
+const int MAX_REQUEST_HEADER = 8 * 1024;
+}
+
+MetricsExporter::MetricsExporter(QObject *parent)
+    : QObject(parent)
+{
+}
+
+bool MetricsExporter::start(quint16 port)
+{
+    if (!server.listen(QHostAddress::LocalHost, port))
+        return false;
+
+    connect(&server, &QTcpServer::newConnection, this, &MetricsExporter::onNewConnection);
+    return true;
+}
+
+void MetricsExporter::onNewConnection()
+{
+    while (server.hasPendingConnections()) {
+        QTcpSocket *socket = server.nextPendingConnection();
+        requests.insert(socket, QByteArray());
+
+        connect(socket, &QTcpSocket::readyRead, this, &MetricsExporter::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            requests.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+// The request itself is ignored; once its header is complete the socket
+// gets the current metrics and is closed.
+void MetricsExporter::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) return;
+
+    QByteArray &req = requests[socket];
+    req.append(socket->readAll());
+    if (req.size() > MAX_REQUEST_HEADER) {
+        socket->abort();
+        return;
+    }
+    if (!req.contains("\r\n\r\n") && !req.contains("\n\n"))
+        return;
+
+    QByteArray body = Metrics::instance().toPrometheus();
+    QByteArray reply = "HTTP/1.0 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                       "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                       "Connection: close\r\n"
+                       "\r\n";
+    socket->write(reply + body);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,29 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include <QByteArray>
+
+// Minimal HTTP endpoint on localhost that answers every request with
+// Metrics::toPrometheus(), for scraping by Prometheus or plain curl.
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsExporter(QObject *parent = nullptr);
+    bool start(quint16 port);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    QTcpServer server;
+    QHash<QTcpSocket*, QByteArray> requests;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "models.h"
+
+QString adStatusToString(AdStatus status)
+{
+    switch (status) {
+    case AdStatus::Pending:  return QStringLiteral("Pending");
+    case AdStatus::Approved: return QStringLiteral("Approved");
+    case AdStatus::Rejected: return QStringLiteral("Rejected");
+    case AdStatus::Sold:     return QStringLiteral("Sold");
+    }
+    return QString();
+}
+
+bool adStatusFromString(const QString &text, AdStatus *status)
+{
+    if (text == QLatin1String("Pending"))       *status = AdStatus::Pending;
+    else if (text == QLatin1String("Approved")) *status = AdStatus::Approved;
+    else if (text == QLatin1String("Rejected")) *status = AdStatus::Rejected;
+    else if (text == QLatin1String("Sold"))     *status = AdStatus::Sold;
+    else return false;
+    return true;
+}
+
+QString transactionTypeToString(TransactionType type)
+{
+    switch (type) {
+    case TransactionType::Deposit:  return QStringLiteral("deposit");
+    case TransactionType::Withdraw: return QStringLiteral("withdraw");
+    case TransactionType::Purchase: return QStringLiteral("purchase");
+    case TransactionType::Sale:     return QStringLiteral("sale");
+    }
+    return QString();
+}
+
+bool transactionTypeFromString(const QString &text, TransactionType *type)
+{
+    if (text == QLatin1String("deposit"))       *type = TransactionType::Deposit;
+    else if (text == QLatin1String("withdraw")) *type = TransactionType::Withdraw;
+    else if (text == QLatin1String("purchase")) *type = TransactionType::Purchase;
+    else if (text == QLatin1String("sale"))     *type = TransactionType::Sale;
+    else return false;
+    return true;
+}
+
+StringPool::StringPool()
+{
+    clear();
+}
+
+StringId StringPool::intern(const QString &text)
+{
+    auto it = ids.constFind(text);
+    if (it != ids.constEnd())
+        return it.value();
+
+    StringId id = StringId(strings.size());
+    strings.append(text);
+    ids.insert(text, id);
+    return id;
+}
+
+StringId StringPool::find(const QString &text) const
+{
+    return ids.value(text, InvalidStringId);
+}
+
+const QString &StringPool::str(StringId id) const
+{
+    if (id >= StringId(strings.size()))
+        return strings.first();
+    return strings.at(id);
+}
+
+int StringPool::size() const
+{
+    return strings.size();
+}
+
+void StringPool::clear()
+{
+    ids.clear();
+    strings.clear();
+    strings.append(QString());
+    ids.insert(QString(), 0);
+}
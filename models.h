@@ -3,7 +3,68 @@
 
 #include <QString>
 #include <QList>
+#include <QVector>
+#include <QHash>
 #include <QDateTime>
+#include <QtMath>
+
+// Enums are stored in the structs and only turned into their wire/file
+// strings at the JSON boundary (see the *ToString / *FromString helpers).
+enum class AdStatus : quint8 {
+    Pending,
+    Approved,
+    Rejected,
+    Sold
+};
+constexpr int AdStatusCount = 4;
+
+enum class TransactionType : quint8 {
+    Deposit,
+    Withdraw,
+    Purchase,
+    Sale
+};
+
+QString adStatusToString(AdStatus status);
+bool adStatusFromString(const QString &text, AdStatus *status);
+QString transactionTypeToString(TransactionType type);
+bool transactionTypeFromString(const QString &text, TransactionType *type);
+
+// Wallet amounts in minor units (1/100 of the currency unit). Doubles are
+// only used on the wire and for ad prices.
+using Money = qint64;
+
+inline Money toMinorUnits(double amount)
+{
+    return qRound64(amount * 100.0);
+}
+
+inline double fromMinorUnits(Money amount)
+{
+    return double(amount) / 100.0;
+}
+
+// Ids handed out by StringPool. Id 0 is always the empty string.
+using StringId = quint32;
+constexpr StringId InvalidStringId = 0xffffffffu;
+
+// Interns strings that repeat across many records (ad owners, categories)
+// so each record carries a 4-byte id and filters compare integers.
+class StringPool
+{
+public:
+    StringPool();
+
+    StringId intern(const QString &text);
+    StringId find(const QString &text) const;
+    const QString &str(StringId id) const;
+    int size() const;
+    void clear();
+
+private:
+    QHash<QString, StringId> ids;
+    QVector<QString> strings;
+};
 
 struct User {
     QString username;
@@ -12,7 +73,6 @@ struct User {
     QString email;
     QString phone;
     QString joinDate;
-    double walletBalance;
     int adsCount;
     int purchasesCount;
     int salesCount;
@@ -21,25 +81,29 @@ struct User {
 
 struct Ad {
     int id;
-    QString owner;
+    AdStatus status;
+    StringId owner;
+    StringId category;
+    double price;
     QString title;
     QString description;
-    double price;
-    QString category;
-    QString status;
-    QString imageBase64;
+    QString imageBase64;        // legacy inline image
+    QString imageBlobId;        // image uploaded through BlobStore
+    QString thumbnailBlobId;    // small copy of it for list views
     QString createdAt;
     QString updatedAt;
+    qint64 version = 0;         // catalog version of the last change
 };
 
+// A ledger posting as seen from one account (see Ledger).
 struct Transaction {
     QString username;
-    QString type;
-    double amount;
+    TransactionType type;
+    int relatedAdId;
+    Money amount;
     QString timestamp;
     QString description;
     QString relatedAdTitle;
-    int relatedAdId;
 };
 
 struct PurchaseRecord {
@@ -51,6 +115,28 @@ struct PurchaseRecord {
     int adId;
 };
 
+struct PurchaseResult {
+    enum class Status {
+        Ok,
+        UserNotFound,
+        CartEmpty,
+        InsufficientBalance
+    };
+
+    Status status;
+    Money total;
+    Money newBalance;
+    QList<int> adIds;
+};
+
+// Dashboard numbers for one user, see Database::getUserSummary().
+struct UserSummary {
+    int adsByStatus[AdStatusCount];
+    int totalAds;
+    int cartItems;
+    Money walletBalance;
+};
+
 struct AdminStats {
     int totalUsers;
     int totalAds;
@@ -59,6 +145,9 @@ struct AdminStats {
     int rejectedAds;
     int totalTransactions;
     int totalPurchases;
+    int activeCarts;
+    Money gmv;
+    Money depositsToday;
 };
 
 #endif
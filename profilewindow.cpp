@@ -18,6 +18,7 @@ ProfileWindow::ProfileWindow(QWidget *parent)
     , ui(new Ui::ProfileWindow)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
     , userAdsModel(new QStandardItemModel(this))
@@ -35,6 +36,7 @@ ProfileWindow::ProfileWindow(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &ProfileWindow::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &ProfileWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &ProfileWindow::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &ProfileWindow::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -120,6 +122,7 @@ void ProfileWindow::setupModels()
 void ProfileWindow::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
@@ -291,31 +294,21 @@ void ProfileWindow::onDisconnected()
 
 void ProfileWindow::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
-
-        QJsonObject obj = doc.object();
-        QString type = obj.value("type").toString();
-
-        if (type == "get_profile_response") {
-            handleProfileResponse(obj);
-        } else if (type == "get_user_ads_response") {
-            handleUserAdsResponse(obj);
-        } else if (type == "get_user_purchases_response") {
-            handlePurchasesResponse(obj);
-        } else if (type == "get_user_sales_response") {
-            handleSalesResponse(obj);
-        }
+    reader->feed(socket->readAll());
+}
+
+void ProfileWindow::onMessage(const QJsonObject &obj)
+{
+    QString type = obj.value("type").toString();
+
+    if (type == "get_profile_response") {
+        handleProfileResponse(obj);
+    } else if (type == "get_user_ads_response") {
+        handleUserAdsResponse(obj);
+    } else if (type == "get_user_purchases_response") {
+        handlePurchasesResponse(obj);
+    } else if (type == "get_user_sales_response") {
+        handleSalesResponse(obj);
     }
 
     pendingRequest = PendingRequest::None;
@@ -0,0 +1,134 @@
+#include "ratelimiter.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+const int MIN_PRUNE_AT = 4096;
+}
+
+RateLimiter::RateLimiter()
+    : pruneAt(MIN_PRUNE_AT)
+{
+    clock.start();
+
+    // The expensive calls: a full catalogue, image uploads (each one is
+    // disk until it expires or an ad claims it; a 20 MB image is 80
+    // default-sized chunks) and a checkout. Everything else is left to
+    // the per-connection limits.
+    setRule("get_ads", {20.0, 40.0});
+    setRule("begin_upload", {1.0, 5.0});
+    setRule("upload_chunk", {40.0, 100.0});
+    setRule("purchase_cart", {2.0, 5.0});
+}
+
+bool RateLimiter::parseRule(const QJsonValue &v, Rule *rule)
+{
+    if (!v.isObject())
+        return false;
+    QJsonObject o = v.toObject();
+    rule->rate = o.value("rate").toDouble(0.0);
+    rule->burst = qMax(1.0, o.value("burst").toDouble(1.0));
+    return rule->rate >= 0.0;
+}
+
+bool RateLimiter::loadConfig(const QString &path, QString *error)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        *error = f.errorString();
+        return false;
+    }
+
+    QJsonParseError err;
+    QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &err);
+    if (err.error != QJsonParseError::NoError || !doc.isObject()) {
+        *error = err.errorString();
+        return false;
+    }
+    QJsonObject root = doc.object();
+
+    Rule def;
+    if (root.contains("default") && !parseRule(root.value("default"), &def)) {
+        *error = "invalid \"default\" rule";
+        return false;
+    }
+
+    QHash<QString, Rule> parsed;
+    QJsonObject types = root.value("types").toObject();
+    for (auto it = types.begin(); it != types.end(); ++it) {
+        Rule r;
+        if (!parseRule(it.value(), &r)) {
+            *error = "invalid rule for " + it.key();
+            return false;
+        }
+        parsed.insert(it.key(), r);
+    }
+
+    rules = parsed;
+    defaultRule = def;
+    buckets.clear();
+    return true;
+}
+
+void RateLimiter::setRule(const QString &type, const Rule &rule)
+{
+    rules.insert(type, rule);
+}
+
+void RateLimiter::setDefaultRule(const Rule &rule)
+{
+    defaultRule = rule;
+}
+
+void RateLimiter::clearRules()
+{
+    rules.clear();
+    defaultRule = Rule();
+    buckets.clear();
+}
+
+bool RateLimiter::allow(const QString &key, const QString &type, qint64 *retryAfterMs)
+{
+    auto r = rules.constFind(type);
+    const Rule &rule = r != rules.cend() ? *r : defaultRule;
+    if (rule.rate <= 0.0)
+        return true;
+
+    const qint64 now = clock.nsecsElapsed() / 1000;
+    const qint64 interval = qint64(1e6 / rule.rate);
+    const qint64 tolerance = qint64(interval * (rule.burst - 1.0));
+
+    QString bucketKey = type;
+    bucketKey += QLatin1Char('\n');
+    bucketKey += key;
+
+    auto it = buckets.find(bucketKey);
+    if (it == buckets.end()) {
+        if (buckets.size() >= pruneAt) {
+            prune(now);
+            pruneAt = qMax(MIN_PRUNE_AT, int(buckets.size()) * 2);
+        }
+        it = buckets.insert(bucketKey, now);
+    }
+
+    const qint64 tat = qMax(*it, now);
+    if (tat - now > tolerance) {
+        *retryAfterMs = (tat - now - tolerance + 999) / 1000;
+        return false;
+    }
+    *it = tat + interval;
+    return true;
+}
+
+// A bucket whose arrival time has passed is full again, and so is the
+// same as no bucket at all.
+void RateLimiter::prune(qint64 nowUs)
+{
+    for (auto it = buckets.begin(); it != buckets.end();) {
+        if (*it <= nowUs)
+            it = buckets.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QHash>
+#include <QString>
+#include <QElapsedTimer>
+#include <QJsonValue>
+
+// Token buckets keyed by (request type, connection), run as GCRA:
+// each bucket is a single "theoretical arrival time", so a check is one
+// hash lookup and a compare, with no refill loop and no lock. Types with
+// no rule, or a rule with rate 0, are not limited.
+//
+// Config file (JSON):
+//   { "default": {"rate": 0},
+//     "types": { "get_ads": {"rate": 20, "burst": 40}, ... } }
+// rate is requests per second, burst the bucket size.
+class RateLimiter
+{
+public:
+    struct Rule {
+        double rate = 0.0;
+        double burst = 1.0;
+    };
+
+    RateLimiter();
+
+    // Replaces the built-in rules; on failure they are left untouched.
+    bool loadConfig(const QString &path, QString *error);
+    void setRule(const QString &type, const Rule &rule);
+    void setDefaultRule(const Rule &rule);
+    void clearRules();
+
+    // `key` identifies the caller (the connection id). Returns false
+    // and sets retryAfterMs when the request should be refused.
+    bool allow(const QString &key, const QString &type, qint64 *retryAfterMs);
+
+private:
+    QHash<QString, Rule> rules;
+    Rule defaultRule;
+    QHash<QString, qint64> buckets;     // type + '\n' + key -> arrival time, us
+    int pruneAt;
+    QElapsedTimer clock;
+
+    void prune(qint64 nowUs);
+    static bool parseRule(const QJsonValue &v, Rule *rule);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QTemporaryDir>
+#include "database.h"
+#include "blobstore.h"
+#include "trafficreplayer.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("kalanet-replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays captured KalaNet traffic against a database snapshot.");
+    parser.addHelpOption();
+    QCommandLineOption snapshotOption({"s", "snapshot"}, "Database snapshot to start from.", "path");
+    QCommandLineOption speedOption("speed", "Replay speed: 1 = original timing, 0 = as fast as possible.",
+                                   "factor", "1");
+    QCommandLineOption outputOption({"o", "output"}, "Write the resulting database here.", "path");
+    QCommandLineOption blobsOption("blobs",
+                                   "Directory for uploaded images (default: a temporary one).", "dir");
+    parser.addOptions({snapshotOption, speedOption, outputOption, blobsOption});
+    parser.addPositionalArgument("captures", "Capture files, oldest first.", "<capture>...");
+    parser.process(a);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty()) {
+        err << "no capture files given\n";
+        return 2;
+    }
+
+    // Without a snapshot the replay starts from an empty database.
+    if (parser.isSet(snapshotOption)) {
+        QString loadError;
+        if (!Database::instance().loadFromFile(parser.value(snapshotOption), &loadError)) {
+            err << "cannot load snapshot: " << loadError << "\n";
+            return 1;
+        }
+    }
+
+    // Captured uploads have to land somewhere, or every add_ad that
+    // refers to one fails and the ad ids drift from the capture.
+    QTemporaryDir tmpBlobs;
+    const QString blobsDir = parser.isSet(blobsOption) ? parser.value(blobsOption) : tmpBlobs.path();
+    if (blobsDir.isEmpty() || !BlobStore::instance().setRoot(blobsDir)) {
+        err << "cannot use blob directory " << blobsDir << "\n";
+        return 1;
+    }
+
+    TrafficReplayer replayer;
+    QString error;
+    if (!replayer.load(files, &error)) {
+        err << error << "\n";
+        return 1;
+    }
+
+    replayer.run(qMax(0.0, parser.value(speedOption).toDouble()));
+    replayer.report(out);
+
+    if (parser.isSet(outputOption))
+        Database::instance().saveToFile(parser.value(outputOption));
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "requestscanner.h"
+#include <QString>
+#include <QJsonValue>
+#include <QtAlgorithms>
+#include <QtNumeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KALANET_SCAN_SSE2
+#endif
+
+namespace {
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline const char *skipSpace(const char *p, const char *end)
+{
+    while (p != end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// First byte that ends a plain string run: '"', '\\' or a control
+// character. Also reports whether the run had any non-ASCII byte.
+const char *findStringEnd(const char *p, const char *end, bool *nonAscii)
+{
+#ifdef KALANET_SCAN_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i ctrl  = _mm_set1_epi8(0x1f);
+    while (end - p >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));     // v <= 0x1f
+        const int mask = _mm_movemask_epi8(hit);
+        const int high = _mm_movemask_epi8(v);
+        if (mask) {
+            const int n = int(qCountTrailingZeroBits(uint(mask)));
+            if (high & ((1 << n) - 1))
+                *nonAscii = true;
+            return p + n;
+        }
+        if (high)
+            *nonAscii = true;
+        p += 16;
+    }
+#endif
+    for (; p != end; ++p) {
+        const uchar c = uchar(*p);
+        if (c == '"' || c == '\\' || c < 0x20)
+            return p;
+        if (c >= 0x80)
+            *nonAscii = true;
+    }
+    return p;
+}
+
+// Strict UTF-8, as QJsonDocument requires: no overlong forms, no
+// surrogates, nothing above U+10FFFF.
+bool isValidUtf8(const uchar *p, const uchar *end)
+{
+    while (p != end) {
+        const uchar c = *p++;
+        if (c < 0x80)
+            continue;
+
+        int extra;
+        uint cp;
+        if (c >= 0xc2 && c <= 0xdf)      { extra = 1; cp = c & 0x1f; }
+        else if (c >= 0xe0 && c <= 0xef) { extra = 2; cp = c & 0x0f; }
+        else if (c >= 0xf0 && c <= 0xf4) { extra = 3; cp = c & 0x07; }
+        else return false;
+
+        if (end - p < extra)
+            return false;
+        for (int i = 0; i < extra; ++i) {
+            if ((p[i] & 0xc0) != 0x80)
+                return false;
+            cp = (cp << 6) | (p[i] & 0x3f);
+        }
+        p += extra;
+
+        if ((extra == 2 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff)))
+            || (extra == 3 && (cp < 0x10000 || cp > 0x10ffff)))
+            return false;
+    }
+    return true;
+}
+
+// p is just past the opening quote; on success it is left just past the
+// closing one.
+bool scanString(const char *&p, const char *end, QString *out)
+{
+    bool nonAscii = false;
+    const char *stop = findStringEnd(p, end, &nonAscii);
+    if (stop == end || *stop != '"')
+        return false;       // escape, control character or unterminated
+    const int len = int(stop - p);
+    if (nonAscii) {
+        if (!isValidUtf8(reinterpret_cast<const uchar *>(p), reinterpret_cast<const uchar *>(stop)))
+            return false;
+        *out = QString::fromUtf8(p, len);
+    } else {
+        *out = QString::fromLatin1(p, len);
+    }
+    p = stop + 1;
+    return true;
+}
+
+// JSON number grammar. Integer literals that fit are kept as integers,
+// the way QJsonDocument reads them.
+bool scanNumber(const char *&p, const char *end, QJsonValue *out)
+{
+    const char *start = p;
+    bool integer = true;
+
+    if (p != end && *p == '-')
+        ++p;
+    if (p == end || !isDigit(*p))
+        return false;
+    if (*p == '0')
+        ++p;
+    else
+        while (p != end && isDigit(*p))
+            ++p;
+
+    if (p != end && *p == '.') {
+        integer = false;
+        ++p;
+        if (p == end || !isDigit(*p))
+            return false;
+        while (p != end && isDigit(*p))
+            ++p;
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        integer = false;
+        ++p;
+        if (p != end && (*p == '+' || *p == '-'))
+            ++p;
+        if (p == end || !isDigit(*p))
+            return false;
+        while (p != end && isDigit(*p))
+            ++p;
+    }
+
+    const QByteArray text = QByteArray::fromRawData(start, int(p - start));
+    bool ok = false;
+    if (integer) {
+        const qint64 v = text.toLongLong(&ok);
+        // -0 is left to QJsonDocument: whether it stays negative depends
+        // on the Qt version.
+        if (ok && v == 0 && *start == '-')
+            return false;
+        if (ok) {
+            *out = QJsonValue(v);
+            return true;
+        }
+    }
+    // Out of range values are left to QJsonDocument as well.
+    const double d = text.toDouble(&ok);
+    if (!ok || !qIsFinite(d))
+        return false;
+    *out = QJsonValue(d);
+    return true;
+}
+
+bool scanLiteral(const char *&p, const char *end, const char *word, int len)
+{
+    if (end - p < len || qstrncmp(p, word, uint(len)) != 0)
+        return false;
+    p += len;
+    return true;
+}
+
+}
+
+bool RequestScanner::scan(const QByteArray &line, QJsonObject *req)
+{
+    const char *p = line.constData();
+    const char *end = p + line.size();
+
+    p = skipSpace(p, end);
+    if (p == end || *p++ != '{')
+        return false;
+
+    QJsonObject obj;
+    p = skipSpace(p, end);
+    if (p != end && *p == '}') {
+        ++p;
+    } else {
+        for (;;) {
+            QString key;
+            if (p == end || *p++ != '"' || !scanString(p, end, &key))
+                return false;
+            p = skipSpace(p, end);
+            if (p == end || *p++ != ':')
+                return false;
+            p = skipSpace(p, end);
+            if (p == end)
+                return false;
+
+            QJsonValue value;
+            switch (*p) {
+            case '"': {
+                QString s;
+                ++p;
+                if (!scanString(p, end, &s))
+                    return false;
+                value = s;
+                break;
+            }
+            case 't':
+                if (!scanLiteral(p, end, "true", 4))
+                    return false;
+                value = true;
+                break;
+            case 'f':
+                if (!scanLiteral(p, end, "false", 5))
+                    return false;
+                value = false;
+                break;
+            case 'n':
+                if (!scanLiteral(p, end, "null", 4))
+                    return false;
+                value = QJsonValue(QJsonValue::Null);
+                break;
+            default:
+                // Objects and arrays are left to QJsonDocument.
+                if (!scanNumber(p, end, &value))
+                    return false;
+                break;
+            }
+
+            if (obj.contains(key))
+                return false;
+            obj.insert(key, value);
+
+            p = skipSpace(p, end);
+            if (p == end)
+                return false;
+            if (*p == '}') {
+                ++p;
+                break;
+            }
+            if (*p++ != ',')
+                return false;
+            p = skipSpace(p, end);
+        }
+    }
+
+    if (skipSpace(p, end) != end)
+        return false;
+    *req = obj;
+    return true;
+}
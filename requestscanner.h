@@ -0,0 +1,23 @@
+#ifndef REQUESTSCANNER_H
+#define REQUESTSCANNER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+
+// Fast path for parsing request lines. Requests are flat objects of
+// string, number, boolean and null values ({"type":"get_cart",
+// "username":"..."}), and the bulk of their bytes sits in a few long
+// strings (add_ad and upload_chunk carry base64 data). scan() reads that
+// shape directly into a QJsonObject, finding the end of each string
+// 16 bytes at a time with SSE2 where available.
+//
+// Anything else -- nested values, escape sequences, duplicate keys,
+// malformed input -- makes scan() return false without touching req;
+// the caller then parses with QJsonDocument, which also reports errors.
+class RequestScanner
+{
+public:
+    static bool scan(const QByteArray &line, QJsonObject *req);
+};
+
+#endif
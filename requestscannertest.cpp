@@ -0,0 +1,139 @@
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "requestscanner.h"
+
+// Checks RequestScanner against QJsonDocument::fromJson: whatever the
+// scanner accepts must parse to the same object with the same value
+// types, and whatever it turns down is left untouched for QJsonDocument.
+// "fast" says which of the two a line is expected to take.
+
+namespace {
+QByteArray uploadChunkLine()
+{
+    return "{\"data\":\"" + QByteArray(192 * 1024, 'x').toBase64()
+           + "\",\"offset\":0,\"type\":\"upload_chunk\",\"upload_id\":\"u1\"}";
+}
+}
+
+class RequestScannerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void scan_data();
+    void scan();
+};
+
+void RequestScannerTest::scan_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<bool>("fast");
+
+    const struct {
+        const char *name;
+        QByteArray line;
+        bool fast;
+    } rows[] = {
+        // Typical requests.
+        {"get_cart",            R"({"type":"get_cart","username":"ali"})", true},
+        {"spaces",              " { \"type\" : \"get_ads\" ,\t\"offset\" : 20 }\r", true},
+        {"empty object",        "{}", true},
+        {"empty key",           R"({"":1})", true},
+        {"literals",            R"({"a":true,"b":false,"c":null})", true},
+        {"upload_chunk",        uploadChunkLine(), true},
+
+        // Strings.
+        {"escaped quote",       R"({"a":"x\"y"})", false},
+        {"escaped unicode",     R"({"a":"\u0633\u0644\u0627\u0645"})", false},
+        {"escaped surrogates",  R"({"a":"\ud83d\ude00"})", false},
+        {"raw tab",             "{\"a\":\"x\ty\"}", false},
+        {"non-ASCII",           "{\"a\":\"\xd8\xb3\xd9\x84\xd8\xa7\xd9\x85\"}", true},
+        {"non-ASCII key",       "{\"\xd0\xba\xd0\xbb\xd1\x8e\xd1\x87\":1}", true},
+        {"4-byte UTF-8",        "{\"a\":\"\xf0\x9f\x98\x80 smile\"}", true},
+        {"long non-ASCII",      "{\"a\":\"0123456789abcdef\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9"
+                                "0123456789abcdef\"}", true},
+        {"invalid UTF-8",       "{\"a\":\"\xff\"}", false},
+        {"overlong UTF-8",      "{\"a\":\"\xc0\xaf\"}", false},
+        {"UTF-8 surrogate",     "{\"a\":\"\xed\xa0\x80\"}", false},
+        {"cut UTF-8",           "{\"a\":\"\xe2\x82\"}", false},
+
+        // Numbers.
+        {"zero",                R"({"a":0})", true},
+        {"negative zero",       R"({"a":-0})", false},
+        {"negative",            R"({"a":-42})", true},
+        {"fraction",            R"({"a":0.1})", true},
+        {"integral double",     R"({"a":1.0})", true},
+        {"exponent",            R"({"a":1e5})", true},
+        {"signed exponent",     R"({"a":-2.5E-3})", true},
+        {"2^53 + 1",            R"({"a":9007199254740993})", true},
+        {"int64 max",           R"({"a":9223372036854775807})", true},
+        {"int64 min",           R"({"a":-9223372036854775808})", true},
+        {"past int64",          R"({"a":9223372036854775808})", true},
+        {"out of range",        R"({"a":1e400})", false},
+        {"leading zero",        R"({"a":01})", false},
+        {"leading plus",        R"({"a":+1})", false},
+        {"bare point",          R"({"a":.5})", false},
+        {"trailing point",      R"({"a":1.})", false},
+        {"bare exponent",       R"({"a":1e})", false},
+
+        // Shapes the scanner leaves to QJsonDocument.
+        {"duplicate key",       R"({"a":1,"a":2})", false},
+        {"array value",         R"({"a":[1,2]})", false},
+        {"object value",        R"({"a":{"b":1}})", false},
+        {"top-level array",     "[1]", false},
+        {"trailing comma",      R"({"a":1,})", false},
+        {"garbage after",       R"({"a":1}x)", false},
+        {"two objects",         R"({"a":1}{"b":2})", false},
+        {"bad literal",         R"({"a":tru})", false},
+
+        // Input that ends mid-value.
+        {"empty",               "", false},
+        {"open brace",          "{", false},
+        {"cut key",             R"({"typ)", false},
+        {"cut after colon",     R"({"type":)", false},
+        {"cut string",          R"({"type":"get_ca)", false},
+        {"cut number",          R"({"a":12)", false},
+        {"cut fraction",        R"({"a":1.)", false},
+        {"cut literal",         R"({"a":fal)", false},
+        {"cut after comma",     R"({"a":1,)", false},
+        {"cut upload_chunk",    uploadChunkLine().left(100 * 1024), false},
+    };
+    for (const auto &r : rows)
+        QTest::newRow(r.name) << r.line << r.fast;
+}
+
+void RequestScannerTest::scan()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(bool, fast);
+
+    const QJsonObject untouched{{"untouched", true}};
+    QJsonObject scanned = untouched;
+    QCOMPARE(RequestScanner::scan(line, &scanned), fast);
+    if (!fast) {
+        QCOMPARE(scanned, untouched);
+        return;
+    }
+
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+    QVERIFY2(error.error == QJsonParseError::NoError, qPrintable(error.errorString()));
+    QVERIFY(doc.isObject());
+
+    const QJsonObject parsed = doc.object();
+    QCOMPARE(scanned.keys(), parsed.keys());
+    for (auto it = parsed.constBegin(); it != parsed.constEnd(); ++it) {
+        const QJsonValue v = scanned.value(it.key());
+        QCOMPARE(v.type(), it.value().type());
+        // Integers must stay integers (and doubles doubles) on Qt 6.
+        QCOMPARE(v.toVariant().userType(), it.value().toVariant().userType());
+        QCOMPARE(v, it.value());
+    }
+    QCOMPARE(QJsonDocument(scanned).toJson(QJsonDocument::Compact),
+             doc.toJson(QJsonDocument::Compact));
+}
+
+QTEST_GUILESS_MAIN(RequestScannerTest)
+
+#include "requestscannertest.moc"
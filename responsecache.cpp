@@ -0,0 +1,41 @@
+#include "responsecache.h"
+
+ResponseCache::ResponseCache(int maxBytes)
+    : entries(maxBytes)
+{
+}
+
+QString ResponseCache::requestKey(const QString &etag)
+{
+    return etag.mid(etag.lastIndexOf(QLatin1Char('-')) + 1);
+}
+
+QByteArray ResponseCache::find(const QString &etag)
+{
+    const QString key = requestKey(etag);
+    Entry *e = entries.object(key);
+    if (!e)
+        return QByteArray();
+    if (e->etag != etag) {
+        entries.remove(key);
+        return QByteArray();
+    }
+    return e->data;
+}
+
+void ResponseCache::insert(const QString &etag, const QByteArray &data)
+{
+    auto *e = new Entry;
+    e->etag = etag;
+    // The caller's buffer is usually the JsonWriter's, which is shared
+    // and has grown well past the reply; copy so the cost below is what
+    // the entry actually holds.
+    e->data = QByteArray(data.constData(), data.size());
+    // QCache deletes the entry itself if it is over budget on its own.
+    entries.insert(requestKey(etag), e, qMax(1, int(data.size())));
+}
+
+void ResponseCache::clear()
+{
+    entries.clear();
+}
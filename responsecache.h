@@ -0,0 +1,38 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QCache>
+#include <QString>
+#include <QByteArray>
+
+// Fully encoded replies to list requests, keyed by the reply's etag (see
+// JsonHandler::etag()). An etag is "<versions>-<request digest>", so a
+// hit is always current: once the data changes, the same request gets a
+// new etag and the stored reply is replaced the next time it is built.
+// Entries are dropped least recently used first beyond maxBytes.
+class ResponseCache
+{
+public:
+    explicit ResponseCache(int maxBytes);
+
+    // Empty on a miss.
+    QByteArray find(const QString &etag);
+    void insert(const QString &etag, const QByteArray &data);
+    void clear();
+
+    int count() const { return entries.count(); }
+    int bytes() const { return entries.totalCost(); }
+
+private:
+    struct Entry {
+        QString    etag;
+        QByteArray data;
+    };
+
+    // Keyed by the request digest, so each request holds one entry.
+    QCache<QString, Entry> entries;
+
+    static QString requestKey(const QString &etag);
+};
+
+#endif
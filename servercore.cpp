@@ -1,12 +1,38 @@
 #include "servercore.h"
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QDateTime>
-#include <QDebug>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include "database.h"
+#include "metrics.h"
+#include "requestscanner.h"
+
+namespace {
+const int LEDGER_AUDIT_INTERVAL = 10 * 60 * 1000;
+const int RATE_WINDOW_MS = 1000;
+const int RESPONSE_CACHE_BYTES = 64 * 1024 * 1024;
+}
 
 ServerCore::ServerCore(QObject *parent)
     : QObject(parent)
+    , nextClientId(1)
+    , responses(RESPONSE_CACHE_BYTES)
+{
+    clock.start();
+    connect(&idleTimer, &QTimer::timeout, this, &ServerCore::evictIdleClients);
+    connect(&auditTimer, &QTimer::timeout, this, &ServerCore::runLedgerAudit);
+    connect(&auditWatcher, &QFutureWatcher<QStringList>::finished,
+            this, &ServerCore::onLedgerAuditFinished);
+}
+
+void ServerCore::setLimits(const Limits &l)
 {
+    limits = l;
+}
+
+RateLimiter &ServerCore::rateLimiter()
+{
+    return throttle;
 }
 
 bool ServerCore::start(quint16 port)
@@ -15,6 +41,19 @@ bool ServerCore::start(quint16 port)
         return false;
 
     connect(&server, &QTcpServer::newConnection, this, &ServerCore::onNewConnection);
+    auditTimer.start(LEDGER_AUDIT_INTERVAL);
+    if (limits.idleTimeoutSec > 0)
+        idleTimer.start(qBound(1000, limits.idleTimeoutSec * 1000 / 4, 30000));
+    return true;
+}
+
+bool ServerCore::enableTrafficCapture(const TrafficRecorder::Options &options)
+{
+    if (!recorder.open(options)) {
+        log("Cannot open traffic capture file: " + options.path, Logger::Error);
+        return false;
+    }
+    log("Capturing traffic to " + options.path);
     return true;
 }
 
@@ -22,14 +61,32 @@ void ServerCore::onNewConnection()
 {
     while (server.hasPendingConnections()) {
         QTcpSocket *socket = server.nextPendingConnection();
+        const QString peer = socket->peerAddress().toString();
+
+        if (limits.maxConnections > 0 && clients.size() >= limits.maxConnections) {
+            rejectConnection(socket, "too_many_connections", "Server is at its connection limit");
+            continue;
+        }
+        if (limits.maxConnectionsPerIp > 0
+            && peers.value(peer).connections >= limits.maxConnectionsPerIp) {
+            rejectConnection(socket, "too_many_connections", "Too many connections from this address");
+            continue;
+        }
+
         clients.insert(socket);
-        buffers[socket].clear();
+        peers[peer].connections++;
+        ClientState &state = states[socket];
+        state.id = nextClientId++;
+        state.captured = recorder.sampleConnection();
+        state.peer = peer;
+        state.lastRequestMs = clock.elapsed();
+        Metrics::instance().connectionOpened();
 
         connect(socket, &QTcpSocket::readyRead, this, &ServerCore::onClientReadyRead);
         connect(socket, &QTcpSocket::disconnected, this, &ServerCore::onClientDisconnected);
         connect(socket, &QTcpSocket::errorOccurred, this, &ServerCore::onSocketError);
 
-        log("Client connected: " + socket->peerAddress().toString());
+        log("Client connected: " + peer);
     }
 }
 
@@ -38,18 +95,31 @@ void ServerCore::onClientReadyRead()
     QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
     if (!socket) return;
 
-    QByteArray &buf = buffers[socket];
-    buf.append(socket->readAll());
+    ClientState &state = states[socket];
+    if (state.closing) {
+        socket->readAll();
+        return;
+    }
+
+    const qint64 before = state.buffer.size();
+    state.buffer.append(socket->readAll());
 
     processBuffer(socket);
+    Metrics::instance().addBufferedBytes(state.buffer.size() - before);
 }
 
 void ServerCore::processBuffer(QTcpSocket *socket)
 {
-    QByteArray &buf = buffers[socket];
+    ClientState &state = states[socket];
+    QByteArray &buf = state.buffer;
 
-    while (true) {
+    while (!state.closing) {
         int idx = buf.indexOf('\n');
+        const int lineBytes = idx < 0 ? buf.size() : idx;
+        if (limits.maxLineBytes > 0 && lineBytes > limits.maxLineBytes) {
+            closeClient(socket, "request_too_large", "Request exceeds the maximum line length");
+            break;
+        }
         if (idx < 0)
             break;
 
@@ -60,36 +130,234 @@ void ServerCore::processBuffer(QTcpSocket *socket)
         if (line.isEmpty())
             continue;
 
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(line, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
+        // Over the rate: answer at once without parsing, so a flooding
+        // client costs almost nothing and keeps its reply order.
+        if (!allowRequest(state)) {
+            static const QByteArray rateLimited =
+                encode(errorReply("rate_limited", "Too many requests, slow down"));
+            Metrics::instance().recordRejected("rate_limited");
+            writeLine(socket, rateLimited);
+            continue;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        // Flat requests skip the generic parser; the rest, and anything
+        // malformed, go through QJsonDocument.
+        QJsonObject req;
+        if (!RequestScanner::scan(line, &req)) {
+            QJsonParseError err;
+            QJsonDocument doc = QJsonDocument::fromJson(line, &err);
+            if (err.error != QJsonParseError::NoError || !doc.isObject()) {
+                Metrics::instance().recordBadRequest();
+                continue;
+            }
+            req = doc.object();
+        }
+        const qint64 parseNs = timer.nsecsElapsed();
+
+        if (state.captured)
+            recorder.record(state.id, line, req);
+
+        // Buckets belong to the connection: the username in a request is
+        // whatever the client claims. Extra connections buy little, as
+        // connections and total requests are also capped per address.
+        const QString type = req.value("type").toString();
+        qint64 retryAfterMs = 0;
+        if (!throttle.allow(QString::number(state.id), type, &retryAfterMs)) {
+            QJsonObject res = errorReply("rate_limited", "Too many " + type + " requests");
+            res["status"] = 429;
+            res["retry_after_ms"] = retryAfterMs;
+            Metrics::instance().recordRejected("throttled");
+            writeLine(socket, encode(res));
             continue;
+        }
+
+        const qint64 handleStart = timer.nsecsElapsed();
+
+        // List replies are kept encoded under their etag, so an unchanged
+        // listing costs a lookup and a buffer write. A request that already
+        // holds the etag is left to the handler's small not_modified reply.
+        const QString tag = handler.etag(req);
+        const bool cacheable = !tag.isEmpty() && req.value("if_none_match").toString() != tag;
+        QByteArray data = cacheable ? responses.find(tag) : QByteArray();
+        if (cacheable)
+            Metrics::instance().recordResponseCache(!data.isEmpty());
+
+        QJsonObject res;
+        qint64 handleNs = 0;
+        qint64 serializeNs = 0;
+        if (!data.isEmpty()) {
+            handleNs = timer.nsecsElapsed() - handleStart;
+        } else if (handler.writesReply(type)) {
+            // Row replies go straight from the database into the writer's
+            // buffer, so handling and serializing are one step.
+            writer.clear();
+            handler.writeReply(req, writer);
+            writer.endLine();
+            data = writer.data();
+            handleNs = timer.nsecsElapsed() - handleStart;
+            if (cacheable)
+                responses.insert(tag, data);
+        } else {
+            res = handler.handleRequest(req);
+            handleNs = timer.nsecsElapsed() - handleStart;
 
-        QJsonObject req = doc.object();
-        QJsonObject res = handler.handleRequest(req);
+            data = encode(res);
+            serializeNs = timer.nsecsElapsed() - handleStart - handleNs;
+            if (cacheable)
+                responses.insert(tag, data);
+        }
 
-        sendJson(socket, res);
+        writeLine(socket, data);
+
+        Metrics::instance().recordRequest(type, parseNs, handleNs, serializeNs, data.size());
+
+        Logger &logger = Logger::instance();
+        if (logger.accessLogEnabled()) {
+            // Cached and written replies are listings, which always succeed.
+            QString result = "ok";
+            if (res.value("type").toString() == "error")
+                result = "error";
+            else if (res.contains("success") && !res.value("success").toBool())
+                result = "fail";
+            logger.access(state.id, type, timer.nsecsElapsed(), line.size(), data.size(), result);
+        }
     }
 }
 
-void ServerCore::sendJson(QTcpSocket *socket, const QJsonObject &obj)
+QByteArray ServerCore::encode(const QJsonObject &obj) const
 {
-    QJsonDocument doc(obj);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
+    QByteArray data = QJsonDocument(obj).toJson(QJsonDocument::Compact);
     data.append('\n');
+    return data;
+}
+
+void ServerCore::writeLine(QTcpSocket *socket, const QByteArray &data)
+{
+    // A client that never reads its replies would otherwise grow the
+    // socket's write buffer without bound. Only what is still queued from
+    // earlier replies counts, so one large reply (a full listing, an
+    // image) does not get a client that reads normally dropped.
+    if (limits.maxPendingWriteBytes > 0 && socket->bytesToWrite() > limits.maxPendingWriteBytes) {
+        auto it = states.find(socket);
+        if (it == states.end() || it->closing)
+            return;
+        it->closing = true;
+        it->buffer.clear();
+        Metrics::instance().recordRejected("slow_reader");
+        log("Dropping client " + it->peer + ": not reading replies", Logger::Warning);
+        QMetaObject::invokeMethod(socket, [socket]() { socket->abort(); }, Qt::QueuedConnection);
+        return;
+    }
+
     socket->write(data);
     socket->flush();
 }
 
+QJsonObject ServerCore::errorReply(const QString &code, const QString &message)
+{
+    QJsonObject res;
+    res["type"] = "error";
+    res["code"] = code;
+    res["message"] = message;
+    return res;
+}
+
+// Fixed one-second windows per connection and per peer address. A
+// request counts as activity for the idle timeout; bytes alone do not, so
+// a client trickling a line that never ends is still evicted.
+bool ServerCore::allowRequest(ClientState &state)
+{
+    const qint64 now = clock.elapsed();
+    state.lastRequestMs = now;
+
+    if (limits.maxRequestsPerSecPerConnection > 0) {
+        if (now - state.windowStartMs >= RATE_WINDOW_MS) {
+            state.windowStartMs = now;
+            state.windowRequests = 0;
+        }
+        if (++state.windowRequests > limits.maxRequestsPerSecPerConnection)
+            return false;
+    }
+
+    if (limits.maxRequestsPerSecPerIp > 0) {
+        PeerState &peer = peers[state.peer];
+        if (now - peer.windowStartMs >= RATE_WINDOW_MS) {
+            peer.windowStartMs = now;
+            peer.windowRequests = 0;
+        }
+        if (++peer.windowRequests > limits.maxRequestsPerSecPerIp)
+            return false;
+    }
+    return true;
+}
+
+void ServerCore::rejectConnection(QTcpSocket *socket, const QString &code, const QString &message)
+{
+    Metrics::instance().recordRejected(code);
+    log("Rejected connection from " + socket->peerAddress().toString() + ": " + message,
+        Logger::Warning);
+
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    sendJson(socket, errorReply(code, message));
+    socket->disconnectFromHost();
+}
+
+// Sends a final error and closes once it is written. The close is queued
+// so callers can keep using the client's state until they return.
+void ServerCore::closeClient(QTcpSocket *socket, const QString &code, const QString &message)
+{
+    ClientState &state = states[socket];
+    if (state.closing)
+        return;
+    state.closing = true;
+    state.buffer.clear();
+
+    Metrics::instance().recordRejected(code);
+    log("Closing client " + state.peer + ": " + message, Logger::Warning);
+
+    socket->write(encode(errorReply(code, message)));
+    QMetaObject::invokeMethod(socket, [socket]() { socket->disconnectFromHost(); },
+                              Qt::QueuedConnection);
+}
+
+void ServerCore::evictIdleClients()
+{
+    const qint64 deadline = clock.elapsed() - qint64(limits.idleTimeoutSec) * 1000;
+    QList<QTcpSocket*> idle;
+    for (auto it = states.cbegin(); it != states.cend(); ++it)
+        if (!it->closing && it->lastRequestMs < deadline)
+            idle.append(it.key());
+
+    for (QTcpSocket *socket : idle) {
+        const qint64 buffered = states[socket].buffer.size();
+        closeClient(socket, "idle_timeout", "Connection closed after being idle");
+        Metrics::instance().addBufferedBytes(-buffered);
+    }
+}
+
+void ServerCore::sendJson(QTcpSocket *socket, const QJsonObject &obj)
+{
+    writeLine(socket, encode(obj));
+}
+
 void ServerCore::onClientDisconnected()
 {
     QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
     if (!socket) return;
 
+    const ClientState state = states.take(socket);
     clients.remove(socket);
-    buffers.remove(socket);
+    Metrics::instance().addBufferedBytes(-state.buffer.size());
+    Metrics::instance().connectionClosed();
 
-    log("Client disconnected: " + socket->peerAddress().toString());
+    auto peer = peers.find(state.peer);
+    if (peer != peers.end() && --peer->connections <= 0)
+        peers.erase(peer);
+
+    log("Client disconnected: " + state.peer);
 
     socket->deleteLater();
 }
@@ -99,11 +367,35 @@ void ServerCore::onSocketError(QAbstractSocket::SocketError)
     QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
     if (!socket) return;
 
-    log("Socket error: " + socket->errorString());
+    log("Socket error: " + socket->errorString(), Logger::Warning);
+}
+
+// Re-sums the ledger on a worker thread against a snapshot taken here on
+// the event loop thread (Database is only used from it), so the audit
+// never blocks request handling.
+void ServerCore::runLedgerAudit()
+{
+    if (auditWatcher.isRunning())
+        return;
+
+    Ledger::AuditSnapshot snapshot = Database::instance().ledgerSnapshot();
+    auditWatcher.setFuture(QtConcurrent::run([snapshot]() {
+        return Ledger::audit(snapshot);
+    }));
+}
+
+void ServerCore::onLedgerAuditFinished()
+{
+    const QStringList problems = auditWatcher.result();
+    if (problems.isEmpty()) {
+        log("Ledger audit passed");
+        return;
+    }
+    for (const auto &p : problems)
+        log("Ledger audit: " + p, Logger::Error);
 }
 
-void ServerCore::log(const QString &msg)
+void ServerCore::log(const QString &msg, Logger::Level level)
 {
-    QString t = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-    qDebug() << "[" << t << "]" << msg;
+    Logger::instance().log(level, msg);
 }
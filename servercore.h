@@ -8,32 +8,101 @@
 #include <QSet>
 #include <QByteArray>
 #include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QFutureWatcher>
 
 #include "jsonhandler.h"
+#include "trafficrecorder.h"
+#include "logger.h"
+#include "ratelimiter.h"
+#include "responsecache.h"
+#include "jsonwriter.h"
 
 class ServerCore : public QObject
 {
     Q_OBJECT
 
 public:
+    // Guards against clients that open too many connections, send lines
+    // that never end, go quiet, or flood requests. 0 disables a limit.
+    struct Limits {
+        int maxConnections = 1000;
+        int maxConnectionsPerIp = 50;
+        int maxLineBytes = 1536 * 1024;               // an upload_chunk: 1 MB as base64
+        // Off by default: the GUI windows keep their socket open between
+        // requests and report a server-side close as an error.
+        int idleTimeoutSec = 0;
+        int maxRequestsPerSecPerConnection = 100;
+        int maxRequestsPerSecPerIp = 500;
+        // Replies left unread when the next one is written; above a
+        // BlobStore::MAX_BLOB_BYTES image as base64.
+        qint64 maxPendingWriteBytes = 32 * 1024 * 1024;
+    };
+
     explicit ServerCore(QObject *parent = nullptr);
+    void setLimits(const Limits &limits);
+    // Per-connection, per-request-type throttling applied before JsonHandler.
+    RateLimiter &rateLimiter();
     bool start(quint16 port);
+    // Captures incoming requests to a rotating JSONL file for replay.
+    bool enableTrafficCapture(const TrafficRecorder::Options &options);
 
 private slots:
     void onNewConnection();
     void onClientReadyRead();
     void onClientDisconnected();
     void onSocketError(QAbstractSocket::SocketError);
+    void evictIdleClients();
+    void runLedgerAudit();
+    void onLedgerAuditFinished();
 
 private:
     QTcpServer server;
+    struct ClientState {
+        quint64    id = 0;
+        bool       captured = false;
+        bool       closing = false;
+        QString    peer;
+        QByteArray buffer;
+        qint64     lastRequestMs = 0;
+        qint64     windowStartMs = 0;
+        int        windowRequests = 0;
+    };
+
+    struct PeerState {
+        int    connections = 0;
+        qint64 windowStartMs = 0;
+        int    windowRequests = 0;
+    };
+
     QSet<QTcpSocket*> clients;
-    QMap<QTcpSocket*, QByteArray> buffers;
+    QMap<QTcpSocket*, ClientState> states;
+    QHash<QString, PeerState> peers;
+    quint64 nextClientId;
+    Limits limits;
+    QElapsedTimer clock;
+    QTimer idleTimer;
     JsonHandler handler;
+    ResponseCache responses;
+    JsonWriter writer;      // reused for every written reply
+    TrafficRecorder recorder;
+    RateLimiter throttle;
+
+    QTimer auditTimer;
+    QFutureWatcher<QStringList> auditWatcher;
 
     void processBuffer(QTcpSocket *socket);
+    bool allowRequest(ClientState &state);
+    void rejectConnection(QTcpSocket *socket, const QString &code, const QString &message);
+    void closeClient(QTcpSocket *socket, const QString &code, const QString &message);
+    static QJsonObject errorReply(const QString &code, const QString &message);
+    QByteArray encode(const QJsonObject &obj) const;
+    void writeLine(QTcpSocket *socket, const QByteArray &data);
     void sendJson(QTcpSocket *socket, const QJsonObject &obj);
-    void log(const QString &msg);
+    void log(const QString &msg, Logger::Level level = Logger::Info);
 };
 
 #endif
@@ -0,0 +1,175 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <QDebug>
+#include <csignal>
+#include "servercore.h"
+#include "database.h"
+#include "blobstore.h"
+#include "metricsexporter.h"
+#include "logger.h"
+
+namespace {
+const quint16 DEFAULT_SERVER_PORT = 4545;
+const QString DEFAULT_DB_PATH     = "kalanet_db.json";
+const int     STOP_POLL_MS        = 200;
+
+// Only a flag may be touched from a signal handler; a timer on the event
+// loop notices it and quits from there.
+volatile std::sig_atomic_t stopRequested = 0;
+
+void handleStopSignal(int)
+{
+    stopRequested = 1;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("kalanet-server");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("KalaNet marketplace server");
+    parser.addHelpOption();
+    QCommandLineOption portOption({"p", "port"}, "TCP port to listen on.", "port",
+                                  QString::number(DEFAULT_SERVER_PORT));
+    QCommandLineOption dbOption({"d", "database"}, "Database file.", "path", DEFAULT_DB_PATH);
+    QCommandLineOption blobsOption("blobs", "Directory for uploaded images.", "dir",
+                                   "kalanet_blobs");
+    QCommandLineOption captureOption("capture", "Record incoming requests to this JSONL file.",
+                                     "path");
+    QCommandLineOption sampleOption("capture-sample", "Fraction of connections to record.",
+                                    "rate", "1");
+    QCommandLineOption captureSizeOption("capture-max-mb", "Rotate the capture file at this size.",
+                                         "mb", "64");
+    parser.addOption(portOption);
+    parser.addOption(dbOption);
+    parser.addOption(blobsOption);
+    parser.addOption(captureOption);
+    parser.addOption(sampleOption);
+    QCommandLineOption metricsOption("metrics-port",
+                                     "Serve Prometheus metrics on this localhost port.", "port");
+    parser.addOption(captureSizeOption);
+    QCommandLineOption logFileOption("log-file", "Write JSON-lines logs here instead of stderr.",
+                                     "path");
+    QCommandLineOption logLevelOption("log-level", "debug, info, warning or error.", "level",
+                                      "info");
+    QCommandLineOption accessLogOption("access-log", "Log every request (type, latency, bytes).");
+    QCommandLineOption maxConnOption("max-connections", "Maximum open connections (0 = no limit).",
+                                     "n", "1000");
+    QCommandLineOption maxConnIpOption("max-connections-per-ip",
+                                       "Maximum open connections per address.", "n", "50");
+    QCommandLineOption maxLineOption("max-line-kb", "Largest accepted request line.", "kb", "1536");
+    QCommandLineOption idleOption("idle-timeout",
+                                  "Close connections with no request for this long (0 = never).",
+                                  "seconds", "0");
+    QCommandLineOption rateConnOption("rate-per-connection",
+                                      "Requests per second allowed per connection.", "n", "100");
+    QCommandLineOption rateIpOption("rate-per-ip", "Requests per second allowed per address.", "n",
+                                    "500");
+    QCommandLineOption rateLimitsOption("rate-limits",
+                                        "JSON file with per-request-type token bucket rules.",
+                                        "path");
+    QCommandLineOption noRateLimitsOption("no-rate-limits",
+                                          "Disable per-request-type throttling.");
+    parser.addOption(rateLimitsOption);
+    parser.addOption(noRateLimitsOption);
+    parser.addOption(maxConnOption);
+    parser.addOption(maxConnIpOption);
+    parser.addOption(maxLineOption);
+    parser.addOption(idleOption);
+    parser.addOption(rateConnOption);
+    parser.addOption(rateIpOption);
+    parser.addOption(metricsOption);
+    parser.addOption(logFileOption);
+    parser.addOption(logLevelOption);
+    parser.addOption(accessLogOption);
+    parser.process(a);
+
+    Logger::Options logOptions;
+    logOptions.path = parser.value(logFileOption);
+    logOptions.accessLog = parser.isSet(accessLogOption);
+    if (!Logger::levelFromString(parser.value(logLevelOption), &logOptions.level))
+        qWarning() << "Unknown log level" << parser.value(logLevelOption) << "- using info";
+    if (!Logger::instance().start(logOptions))
+        qWarning() << "Cannot open log file" << logOptions.path << "- logging to qDebug";
+
+    const quint16 port = quint16(parser.value(portOption).toUInt());
+    const QString dbPath = parser.value(dbOption);
+
+    QString loadError;
+    if (!Database::instance().loadFromFile(dbPath, &loadError)) {
+        qCritical() << "Cannot load database" << dbPath << "-" << loadError;
+        return -1;
+    }
+    if (!BlobStore::instance().setRoot(parser.value(blobsOption))) {
+        qCritical() << "Cannot use blob directory" << parser.value(blobsOption);
+        return -1;
+    }
+    // Blobs committed before a restart that no ad took up.
+    QSet<QString> referenced;
+    for (const Ad *ad : Database::instance().getAllAds()) {
+        referenced.insert(ad->imageBlobId);
+        referenced.insert(ad->thumbnailBlobId);
+    }
+    BlobStore::instance().removeUnreferenced(referenced);
+
+    ServerCore server;
+    ServerCore::Limits limits;
+    limits.maxConnections = parser.value(maxConnOption).toInt();
+    limits.maxConnectionsPerIp = parser.value(maxConnIpOption).toInt();
+    limits.maxLineBytes = parser.value(maxLineOption).toInt() * 1024;
+    limits.idleTimeoutSec = parser.value(idleOption).toInt();
+    limits.maxRequestsPerSecPerConnection = parser.value(rateConnOption).toInt();
+    limits.maxRequestsPerSecPerIp = parser.value(rateIpOption).toInt();
+    server.setLimits(limits);
+
+    if (parser.isSet(noRateLimitsOption)) {
+        server.rateLimiter().clearRules();
+    } else if (parser.isSet(rateLimitsOption)) {
+        QString error;
+        if (!server.rateLimiter().loadConfig(parser.value(rateLimitsOption), &error)) {
+            qCritical() << "Cannot load rate limits:" << error;
+            return -1;
+        }
+    }
+    if (parser.isSet(captureOption)) {
+        TrafficRecorder::Options capture;
+        capture.path = parser.value(captureOption);
+        capture.sampleRate = parser.value(sampleOption).toDouble();
+        capture.maxFileBytes = parser.value(captureSizeOption).toLongLong() * 1024 * 1024;
+        server.enableTrafficCapture(capture);
+    }
+
+    if (!server.start(port)) {
+        qCritical() << "Server failed to start";
+        return -1;
+    }
+    qDebug() << "KalaNet Server started on port" << port;
+
+    MetricsExporter exporter;
+    if (parser.isSet(metricsOption)) {
+        const quint16 metricsPort = quint16(parser.value(metricsOption).toUInt());
+        if (exporter.start(metricsPort))
+            qDebug() << "Metrics on http://127.0.0.1:" + QString::number(metricsPort) + "/metrics";
+        else
+            qWarning() << "Cannot listen for metrics on port" << metricsPort;
+    }
+
+    // Let Ctrl+C / service stop go through aboutToQuit so the data is saved.
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+    QTimer stopTimer;
+    QObject::connect(&stopTimer, &QTimer::timeout, &a, []() {
+        if (stopRequested)
+            QCoreApplication::quit();
+    });
+    stopTimer.start(STOP_POLL_MS);
+
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [dbPath]() {
+        Database::instance().saveToFile(dbPath);
+        Logger::instance().stop();
+    });
+    return a.exec();
+}
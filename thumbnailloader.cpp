@@ -0,0 +1,296 @@
+#include "thumbnailloader.h"
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QBuffer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QDebug>
+
+namespace {
+const quint16 DEFAULT_SERVER_PORT = 4545;
+const int     DECODE_THREADS      = 2;
+const int     MAX_DECODES         = 4;     // running or waiting in the pool
+const int     MAX_IN_FLIGHT       = 4;
+const int     MIN_BACKOFF_MS      = 100;
+const int     MEMORY_CACHE_BYTES  = 32 * 1024 * 1024;
+const QByteArray DISK_FORMAT      = "png";
+}
+
+ThumbnailLoader::ThumbnailLoader(const AdCatalogCache &cache, int size, QObject *parent)
+    : QObject(parent)
+    , size(size)
+    , socket(new QTcpSocket(this))
+    , reader(new JsonLineReader(this))
+    , serverIp("127.0.0.1")
+    , serverPort(DEFAULT_SERVER_PORT)
+    , disk(cache)
+    , memory(MEMORY_CACHE_BYTES)
+    , decoding(0)
+{
+    pool.setMaxThreadCount(DECODE_THREADS);
+
+    backoffTimer.setSingleShot(true);
+    connect(&backoffTimer, &QTimer::timeout, this, &ThumbnailLoader::sendRequests);
+
+    connect(socket, &QTcpSocket::connected,    this, &ThumbnailLoader::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &ThumbnailLoader::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead,    this, &ThumbnailLoader::onReadyRead);
+    connect(socket, &QTcpSocket::errorOccurred,this, &ThumbnailLoader::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &ThumbnailLoader::onMessage);
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+void ThumbnailLoader::setServerAddress(const QString &ip, quint16 port)
+{
+    serverIp   = ip;
+    serverPort = port;
+}
+
+// Called from paint, so it only ever queues work.
+QPixmap ThumbnailLoader::thumbnail(int adId, const QString &updatedAt)
+{
+    if (Entry *e = memory.object(adId)) {
+        if (e->updatedAt == updatedAt)
+            return e->pixmap;
+        memory.remove(adId);
+    }
+
+    auto f = failed.constFind(adId);
+    if (f != failed.constEnd() && *f == updatedAt)
+        return QPixmap();
+
+    auto p = pending.constFind(adId);
+    if (p != pending.constEnd() && *p == updatedAt)
+        return QPixmap();
+
+    pending.insert(adId, updatedAt);
+    decodeQueue.append({adId, updatedAt});
+    startDecodes();
+    return QPixmap();
+}
+
+// Loads that are running or already sent are left to finish; their
+// pixmaps are still worth keeping.
+void ThumbnailLoader::retainOnly(const QSet<int> &adIds)
+{
+    auto prune = [&](QVector<Job> &queue) {
+        QVector<Job> kept;
+        for (const auto &job : queue) {
+            if (adIds.contains(job.adId))
+                kept.append(job);
+            else if (!inFlight.contains(job.adId))
+                pending.remove(job.adId);
+        }
+        queue = kept;
+    };
+    prune(decodeQueue);
+    prune(networkQueue);
+}
+
+void ThumbnailLoader::startDecodes()
+{
+    while (decoding < MAX_DECODES && !decodeQueue.isEmpty()) {
+        Job job = decodeQueue.takeLast();
+        if (pending.value(job.adId) == job.updatedAt)
+            startDecode(job, QByteArray());
+    }
+}
+
+// With no data the job looks in the disk cache.
+void ThumbnailLoader::startDecode(const Job &job, const QByteArray &data)
+{
+    ++decoding;
+    auto *watcher = new QFutureWatcher<Decoded>(this);
+    connect(watcher, &QFutureWatcher<Decoded>::finished, this, [this, watcher]() {
+        --decoding;
+        finishDecode(watcher->result());
+        watcher->deleteLater();
+        startDecodes();
+    });
+
+    const AdCatalogCache cache = disk;
+    const int edge = size;
+    watcher->setFuture(QtConcurrent::run(&pool, [job, data, cache, edge]() {
+        return decode(job, data, cache, edge);
+    }));
+}
+
+ThumbnailLoader::Decoded ThumbnailLoader::decode(const Job &job, QByteArray data, AdCatalogCache disk, int size)
+{
+    Decoded r;
+    r.adId      = job.adId;
+    r.updatedAt = job.updatedAt;
+
+    const bool fromServer = !data.isEmpty();
+    if (!fromServer)
+        data = disk.thumbnail(job.adId, job.updatedAt);
+    if (data.isEmpty()) {
+        r.status = Decoded::NotCached;
+        return r;
+    }
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
+
+    // Full-size images are scaled by the decoder where it can (JPEG).
+    QSize target = reader.size();
+    if (target.isValid() && qMax(target.width(), target.height()) > size) {
+        target.scale(size, size, Qt::KeepAspectRatio);
+        reader.setScaledSize(target);
+    }
+
+    QImage image = reader.read();
+    if (image.isNull())
+        return r;
+    if (qMax(image.width(), image.height()) > size)
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    if (fromServer) {
+        QByteArray encoded;
+        QBuffer out(&encoded);
+        out.open(QIODevice::WriteOnly);
+        if (QImageWriter(&out, DISK_FORMAT).write(image))
+            disk.storeThumbnail(job.adId, job.updatedAt, encoded);
+    }
+
+    r.status = Decoded::Ok;
+    r.image  = image;
+    return r;
+}
+
+void ThumbnailLoader::finishDecode(const Decoded &r)
+{
+    // The ad changed while this was loading.
+    auto p = pending.constFind(r.adId);
+    if (p != pending.constEnd() && *p != r.updatedAt)
+        return;
+
+    switch (r.status) {
+    case Decoded::Ok: {
+        pending.remove(r.adId);
+        auto *e = new Entry;
+        e->updatedAt = r.updatedAt;
+        e->pixmap    = QPixmap::fromImage(r.image);
+        memory.insert(r.adId, e, qMax(1, int(r.image.sizeInBytes())));
+        emit thumbnailReady(r.adId);
+        break;
+    }
+    case Decoded::NotCached:
+        // Dropped by retainOnly() while on disk; no need to ask the server.
+        if (p == pending.constEnd())
+            return;
+        networkQueue.append({r.adId, r.updatedAt});
+        sendRequests();
+        break;
+    case Decoded::Invalid:
+        pending.remove(r.adId);
+        failed.insert(r.adId, r.updatedAt);
+        break;
+    }
+}
+
+void ThumbnailLoader::sendRequests()
+{
+    if (networkQueue.isEmpty() || backoffTimer.isActive())
+        return;
+
+    if (socket->state() != QAbstractSocket::ConnectedState) {
+        if (socket->state() == QAbstractSocket::UnconnectedState) {
+            reader->reset();
+            socket->connectToHost(QHostAddress(serverIp), serverPort);
+        }
+        return;
+    }
+
+    while (inFlight.size() < MAX_IN_FLIGHT && !networkQueue.isEmpty()) {
+        Job job = networkQueue.takeLast();
+        if (pending.value(job.adId) != job.updatedAt || inFlight.contains(job.adId))
+            continue;
+
+        QJsonObject obj;
+        obj["type"]      = "get_ad_image";
+        obj["ad_id"]     = job.adId;
+        obj["thumbnail"] = true;
+
+        QByteArray data = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+        data.append('\n');
+        socket->write(data);
+        inFlight.append(job.adId);
+    }
+    socket->flush();
+}
+
+void ThumbnailLoader::onConnected()
+{
+    sendRequests();
+}
+
+void ThumbnailLoader::onDisconnected()
+{
+    dropNetworkJobs();
+}
+
+void ThumbnailLoader::onReadyRead()
+{
+    reader->feed(socket->readAll());
+}
+
+// Replies come back in request order, which also pins an "error" reply
+// (e.g. rate limited) to its request.
+void ThumbnailLoader::onMessage(const QJsonObject &obj)
+{
+    if (inFlight.isEmpty())
+        return;
+    const int adId = inFlight.takeFirst();
+    const QString type = obj["type"].toString();
+
+    if (type == "get_ad_image_response" && obj["success"].toBool()) {
+        // Keyed by the updated_at the view asked for; a newer image shows
+        // until the listing catches up with the edit.
+        Job job;
+        job.adId      = adId;
+        job.updatedAt = pending.value(adId, obj["updated_at"].toString());
+        startDecode(job, QByteArray::fromBase64(obj["image_base64"].toString().toLatin1()));
+    } else if (type == "get_ad_image_response") {
+        failed.insert(adId, pending.value(adId));
+        pending.remove(adId);
+    } else if (obj["code"].toString() == "rate_limited" && pending.contains(adId)) {
+        // Not this ad's fault: ask again, first, once the server allows.
+        networkQueue.append({adId, pending.value(adId)});
+        backoffTimer.start(qMax(qMax(MIN_BACKOFF_MS, obj["retry_after_ms"].toInt()),
+                                backoffTimer.remainingTime()));
+    } else {
+        // Not this ad's fault; the next paint asks again.
+        pending.remove(adId);
+    }
+
+    sendRequests();
+}
+
+void ThumbnailLoader::onSocketError(QAbstractSocket::SocketError)
+{
+    qWarning() << "Thumbnail loader:" << socket->errorString();
+    dropNetworkJobs();
+}
+
+// Whatever was waiting on the connection is forgotten, so the next paint
+// of those rows starts over.
+void ThumbnailLoader::dropNetworkJobs()
+{
+    for (int adId : std::as_const(inFlight))
+        pending.remove(adId);
+    for (const auto &job : std::as_const(networkQueue))
+        pending.remove(job.adId);
+    inFlight.clear();
+    networkQueue.clear();
+    reader->reset();
+}
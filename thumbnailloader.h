@@ -0,0 +1,101 @@
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QThreadPool>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QVector>
+#include <QPixmap>
+#include <QImage>
+#include "jsonlinereader.h"
+#include "adcatalogcache.h"
+
+// Ad thumbnails for the ads browser, loaded only when a view asks for
+// them. thumbnail() returns what is in memory and otherwise queues a
+// load; thumbnailReady() follows once it is there.
+//
+// A load first looks in the on-disk thumbnail cache and then asks the
+// server (get_ad_image) over a socket of its own. Decoding and scaling
+// run on a small worker pool, never on the GUI thread. Queues are taken
+// newest first, so the rows painted last (the ones on screen) win, and
+// retainOnly() drops queued loads for rows that scrolled away. Decoded
+// pixmaps sit in an LRU cache bounded by their size in bytes.
+class ThumbnailLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    ThumbnailLoader(const AdCatalogCache &cache, int size, QObject *parent = nullptr);
+    ~ThumbnailLoader();
+
+    void setServerAddress(const QString &ip, quint16 port);
+
+    QPixmap thumbnail(int adId, const QString &updatedAt);
+    void retainOnly(const QSet<int> &adIds);
+
+signals:
+    void thumbnailReady(int adId);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onReadyRead();
+    void onMessage(const QJsonObject &obj);
+    void onSocketError(QAbstractSocket::SocketError socketError);
+
+private:
+    struct Job {
+        int adId = 0;
+        QString updatedAt;
+    };
+
+    struct Decoded {
+        enum Status { Ok, NotCached, Invalid };
+        Status  status = Invalid;
+        int     adId = 0;
+        QString updatedAt;
+        QImage  image;
+    };
+
+    struct Entry {
+        QString updatedAt;
+        QPixmap pixmap;
+    };
+
+    int size;
+
+    QTcpSocket     *socket;
+    JsonLineReader *reader;
+    QString         serverIp;
+    quint16         serverPort;
+
+    AdCatalogCache disk;
+    QThreadPool    pool;
+    QCache<int, Entry> memory;
+
+    // Every ad with a load under way, with the updated_at it is for.
+    QHash<int, QString> pending;
+    QVector<Job> decodeQueue;       // disk lookups, newest last
+    QVector<Job> networkQueue;      // server requests, newest last
+    QList<int>   inFlight;          // sent, in the order replies come back
+    // Running after a rate_limited reply; nothing is sent until it fires.
+    QTimer       backoffTimer;
+    int          decoding;
+    // Ads whose image could not be loaded, until their updated_at changes.
+    QHash<int, QString> failed;
+
+    void startDecodes();
+    void startDecode(const Job &job, const QByteArray &data);
+    void sendRequests();
+    void finishDecode(const Decoded &result);
+    void dropNetworkJobs();
+
+    static Decoded decode(const Job &job, QByteArray data, AdCatalogCache disk, int size);
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "trafficrecorder.h"
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <QJsonDocument>
+
+namespace {
+const QLatin1String SECRET_FIELDS[] = {
+    QLatin1String("password"),
+};
+}
+
+const QString TrafficRecorder::MaskedSecret = QStringLiteral("<masked>");
+
+TrafficRecorder::TrafficRecorder()
+    : written(0)
+{
+}
+
+bool TrafficRecorder::open(const Options &options)
+{
+    close();
+    opts = options;
+    if (opts.maxFiles < 1)
+        opts.maxFiles = 1;
+
+    file.setFileName(opts.path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    written = file.size();
+    return true;
+}
+
+void TrafficRecorder::close()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+bool TrafficRecorder::isEnabled() const
+{
+    return file.isOpen();
+}
+
+bool TrafficRecorder::sampleConnection() const
+{
+    if (!isEnabled() || opts.sampleRate <= 0.0)
+        return false;
+    if (opts.sampleRate >= 1.0)
+        return true;
+    return QRandomGenerator::global()->generateDouble() < opts.sampleRate;
+}
+
+void TrafficRecorder::record(quint64 connectionId, const QByteArray &line, const QJsonObject &req)
+{
+    if (!isEnabled())
+        return;
+
+    QJsonObject masked = req;
+    const QByteArray body = maskSecrets(&masked) ? QJsonDocument(masked).toJson(QJsonDocument::Compact)
+                                                 : line;
+
+    QByteArray rec;
+    rec.reserve(body.size() + 48);
+    rec.append("{\"ts\":");
+    rec.append(QByteArray::number(QDateTime::currentMSecsSinceEpoch()));
+    rec.append(",\"conn\":");
+    rec.append(QByteArray::number(connectionId));
+    rec.append(",\"req\":");
+    rec.append(body);
+    rec.append("}\n");
+
+    file.write(rec);
+    written += rec.size();
+
+    if (written >= opts.maxFileBytes)
+        rotate();
+}
+
+bool TrafficRecorder::maskSecrets(QJsonObject *req)
+{
+    bool masked = false;
+    for (const QLatin1String &field : SECRET_FIELDS) {
+        if (req->contains(field)) {
+            req->insert(field, MaskedSecret);
+            masked = true;
+        }
+    }
+    return masked;
+}
+
+void TrafficRecorder::rotate()
+{
+    file.close();
+
+    QString oldest = QString("%1.%2").arg(opts.path).arg(opts.maxFiles - 1);
+    QFile::remove(oldest);
+    for (int i = opts.maxFiles - 2; i >= 1; --i)
+        QFile::rename(QString("%1.%2").arg(opts.path).arg(i),
+                      QString("%1.%2").arg(opts.path).arg(i + 1));
+    if (opts.maxFiles > 1)
+        QFile::rename(opts.path, opts.path + ".1");
+    else
+        QFile::remove(opts.path);
+
+    written = 0;
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
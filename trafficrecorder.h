@@ -0,0 +1,52 @@
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QJsonObject>
+
+// Appends incoming request lines to a JSONL capture file, one record per
+// request: {"ts": <epoch ms>, "conn": <connection id>, "req": <request>}.
+// Sampling is per connection so sampled sessions stay complete (a cart
+// is always followed by its purchase). Files rotate by size:
+// path, path.1, ... path.<maxFiles - 1>.
+//
+// Secrets (passwords) never reach the file: they are replaced by
+// MaskedSecret, which is also what a replay sends. A replayed signup and
+// the logins after it therefore still agree with each other.
+class TrafficRecorder
+{
+public:
+    struct Options {
+        QString path = "kalanet_capture.jsonl";
+        double sampleRate = 1.0;             // fraction of connections captured
+        qint64 maxFileBytes = 64 * 1024 * 1024;
+        int maxFiles = 5;
+    };
+
+    TrafficRecorder();
+
+    bool open(const Options &options);
+    void close();
+    bool isEnabled() const;
+
+    // Decides once per connection whether its requests are captured.
+    bool sampleConnection() const;
+    static const QString MaskedSecret;
+    // Replaces secret fields in place; false if there were none.
+    static bool maskSecrets(QJsonObject *req);
+
+    // `req` is `line` parsed. The line is embedded verbatim unless the
+    // request carries a secret, in which case a masked copy is written.
+    void record(quint64 connectionId, const QByteArray &line, const QJsonObject &req);
+
+private:
+    Options opts;
+    QFile file;
+    qint64 written;
+
+    void rotate();
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "trafficreplayer.h"
+#include "trafficrecorder.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+double percentileMs(const QVector<qint64> &sorted, double p)
+{
+    if (sorted.isEmpty())
+        return 0.0;
+    int idx = qBound(0, int(qCeil(p * sorted.size())) - 1, int(sorted.size()) - 1);
+    return sorted.at(idx) / 1e6;
+}
+}
+
+TrafficReplayer::TrafficReplayer()
+    : wallNs(0)
+{
+}
+
+bool TrafficReplayer::load(const QStringList &files, QString *error)
+{
+    records.clear();
+
+    for (const QString &path : files) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            *error = "cannot open " + path;
+            return false;
+        }
+
+        while (!file.atEnd()) {
+            QByteArray line = file.readLine().trimmed();
+            if (line.isEmpty())
+                continue;
+
+            QJsonDocument doc = QJsonDocument::fromJson(line);
+            if (!doc.isObject())
+                continue;
+
+            QJsonObject o = doc.object();
+            Record r;
+            r.ts = qint64(o.value("ts").toDouble());
+            r.conn = quint64(o.value("conn").toDouble());
+            r.req = o.value("req").toObject();
+            // Captures written before masking may still hold passwords.
+            TrafficRecorder::maskSecrets(&r.req);
+            if (!r.req.isEmpty())
+                records.append(r);
+        }
+    }
+
+    // Rotation keeps each file ordered; a stable sort also repairs
+    // captures passed in the wrong file order.
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record &a, const Record &b) { return a.ts < b.ts; });
+    return true;
+}
+
+int TrafficReplayer::size() const
+{
+    return records.size();
+}
+
+void TrafficReplayer::run(double speed)
+{
+    stats.clear();
+    if (records.isEmpty())
+        return;
+
+    QElapsedTimer wall;
+    wall.start();
+    const qint64 firstTs = records.first().ts;
+
+    for (const Record &r : std::as_const(records)) {
+        if (speed > 0.0) {
+            qint64 dueNs = qint64((r.ts - firstTs) * 1e6 / speed);
+            qint64 waitNs = dueNs - wall.nsecsElapsed();
+            if (waitNs > 0)
+                QThread::usleep(quint64(waitNs / 1000));
+        }
+
+        const QString type = r.req.value("type").toString();
+        TypeStats &s = stats[type];
+        QElapsedTimer t;
+        t.start();
+        // Row replies are produced the way the server produces them;
+        // they are listings, which always succeed.
+        if (handler.writesReply(type)) {
+            writer.clear();
+            handler.writeReply(r.req, writer);
+            s.latenciesNs.append(t.nsecsElapsed());
+            continue;
+        }
+        QJsonObject res = handler.handleRequest(r.req);
+        s.latenciesNs.append(t.nsecsElapsed());
+
+        if (res.value("type").toString() == "error" || !res.value("success").toBool(true))
+            s.errors++;
+    }
+
+    wallNs = wall.nsecsElapsed();
+}
+
+void TrafficReplayer::report(QTextStream &out) const
+{
+    double seconds = qMax(1e-9, wallNs / 1e9);
+    out << QString("replayed %1 requests in %2 s\n").arg(records.size()).arg(seconds, 0, 'f', 2);
+    out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+               .arg("type", -22).arg("count", 9).arg("errors", 7)
+               .arg("p50 ms", 9).arg("p99 ms", 9).arg("p999 ms", 9).arg("max ms", 9);
+
+    for (auto it = stats.constBegin(); it != stats.constEnd(); ++it) {
+        QVector<qint64> sorted = it->latenciesNs;
+        std::sort(sorted.begin(), sorted.end());
+        out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                   .arg(it.key(), -22).arg(sorted.size(), 9).arg(it->errors, 7)
+                   .arg(percentileMs(sorted, 0.50), 9, 'f', 3)
+                   .arg(percentileMs(sorted, 0.99), 9, 'f', 3)
+                   .arg(percentileMs(sorted, 0.999), 9, 'f', 3)
+                   .arg(sorted.isEmpty() ? 0.0 : sorted.last() / 1e6, 9, 'f', 3);
+    }
+}
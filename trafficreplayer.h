@@ -0,0 +1,50 @@
+#ifndef TRAFFICREPLAYER_H
+#define TRAFFICREPLAYER_H
+
+#include <QJsonObject>
+#include <QMap>
+#include <QVector>
+#include <QStringList>
+#include <QTextStream>
+
+#include "jsonhandler.h"
+#include "jsonwriter.h"
+
+// Feeds a TrafficRecorder capture back through JsonHandler against
+// whatever Database state is loaded, keeping the original request order
+// and spacing (optionally sped up), and times every request.
+class TrafficReplayer
+{
+public:
+    TrafficReplayer();
+
+    // Files are read in the order given, so pass rotated captures oldest
+    // first (capture.jsonl.2 capture.jsonl.1 capture.jsonl).
+    bool load(const QStringList &files, QString *error);
+    int size() const;
+
+    // speed 1 keeps the original spacing, 10 is ten times faster and 0
+    // replays back to back.
+    void run(double speed);
+    void report(QTextStream &out) const;
+
+private:
+    struct Record {
+        qint64      ts;
+        quint64     conn;
+        QJsonObject req;
+    };
+
+    struct TypeStats {
+        QVector<qint64> latenciesNs;
+        qint64 errors = 0;
+    };
+
+    QVector<Record> records;
+    QMap<QString, TypeStats> stats;
+    qint64 wallNs;
+    JsonHandler handler;
+    JsonWriter writer;
+};
+
+#endif
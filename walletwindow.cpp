@@ -6,13 +6,13 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
-#include <QStandardItem>
 #include <QLineEdit>
 
 namespace {
 const QString DEFAULT_SERVER_IP   = "127.0.0.1";
 const quint16 DEFAULT_SERVER_PORT = 4545;
 const int     CONNECTION_TIMEOUT  = 5000;
+const int     PAGE_SIZE           = 500;
 }
 
 WalletWindow::WalletWindow(QWidget *parent)
@@ -20,9 +20,11 @@ WalletWindow::WalletWindow(QWidget *parent)
     , ui(new Ui::WalletWindow)
     , socket(new QTcpSocket(this))
     , connectionTimer(new QTimer(this))
+    , reader(new JsonLineReader(this))
     , serverIp(DEFAULT_SERVER_IP)
     , serverPort(DEFAULT_SERVER_PORT)
-    , transactionsModel(new QStandardItemModel(this))
+    , transactionsModel(new CompactTableModel(this))
+    , transactionsOffset(0)
     , currentBalance(0.0)
     , pendingAction(PendingAction::None)
     , pendingAmount(0.0)
@@ -39,6 +41,7 @@ WalletWindow::WalletWindow(QWidget *parent)
     connect(socket, &QTcpSocket::disconnected, this, &WalletWindow::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,    this, &WalletWindow::onReadyRead);
     connect(socket, &QTcpSocket::errorOccurred,this, &WalletWindow::onSocketError);
+    connect(reader, &JsonLineReader::messageReceived, this, &WalletWindow::onMessage);
 
     connectionTimer->setSingleShot(true);
     connect(connectionTimer, &QTimer::timeout, this, [this]() {
@@ -87,11 +90,13 @@ void WalletWindow::setupUiDesign()
 
 void WalletWindow::setupTransactionsModel()
 {
-    transactionsModel->setColumnCount(4);
-    transactionsModel->setHeaderData(0, Qt::Horizontal, "Type");
-    transactionsModel->setHeaderData(1, Qt::Horizontal, "Amount");
-    transactionsModel->setHeaderData(2, Qt::Horizontal, "Timestamp");
-    transactionsModel->setHeaderData(3, Qt::Horizontal, "Description");
+    transactionsModel->addColumn("type",        "Type",        CompactTableModel::ColumnType::Label);
+    transactionsModel->addColumn("amount",      "Amount",      CompactTableModel::ColumnType::Double);
+    transactionsModel->addColumn("timestamp",   "Timestamp",   CompactTableModel::ColumnType::String);
+    transactionsModel->addColumn("description", "Description", CompactTableModel::ColumnType::String);
+
+    connect(transactionsModel, &CompactTableModel::fetchMoreRequested,
+            this, [this](int offset) { requestTransactions(offset); });
 
     ui->transactionsTableView->setModel(transactionsModel);
     ui->transactionsTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
@@ -103,6 +108,7 @@ void WalletWindow::setupTransactionsModel()
 void WalletWindow::connectToServer()
 {
     socket->abort();
+    reader->reset();
     socket->connectToHost(QHostAddress(serverIp), serverPort);
     connectionTimer->start(CONNECTION_TIMEOUT);
 }
@@ -113,9 +119,10 @@ void WalletWindow::requestWallet()
     connectToServer();
 }
 
-void WalletWindow::requestTransactions()
+void WalletWindow::requestTransactions(int offset)
 {
     pendingAction = PendingAction::GetTransactions;
+    transactionsOffset = offset;
     connectToServer();
 }
 
@@ -175,28 +182,17 @@ void WalletWindow::handleWithdrawResponse(const QJsonObject &obj)
     }
 }
 
+// A reply at offset 0 replaces the table; later pages are appended.
 void WalletWindow::handleTransactionsResponse(const QJsonObject &obj)
 {
-    transactionsModel->removeRows(0, transactionsModel->rowCount());
-
-    QJsonArray arr = obj.value("transactions").toArray();
-    int row = 0;
-    for (const auto &v : arr) {
-        if (!v.isObject()) continue;
-        QJsonObject t = v.toObject();
-
-        QString type = t.value("type").toString();
-        double amount = t.value("amount").toDouble();
-        QString timestamp = t.value("timestamp").toString();
-        QString description = t.value("description").toString();
-
-        transactionsModel->insertRow(row);
-        transactionsModel->setData(transactionsModel->index(row, 0), type);
-        transactionsModel->setData(transactionsModel->index(row, 1), amount);
-        transactionsModel->setData(transactionsModel->index(row, 2), timestamp);
-        transactionsModel->setData(transactionsModel->index(row, 3), description);
-        ++row;
+    if (obj.value("not_modified").toBool())
+        return;
+    if (obj.value("offset").toInt() == 0) {
+        transactionsModel->clear();
+        transactionsEtag = obj.value("etag").toString();
     }
+    transactionsModel->appendRows(obj.value("transactions").toArray());
+    transactionsModel->setTotalRows(obj.value("total").toInt());
 }
 
 bool WalletWindow::validateAmountInput(QLineEdit *edit, double &amount, QString &error) const
@@ -281,6 +277,10 @@ void WalletWindow::onConnected()
     } else if (pendingAction == PendingAction::GetTransactions) {
         obj["type"]     = "get_transactions";
         obj["username"] = currentUsername;
+        obj["offset"]   = transactionsOffset;
+        obj["limit"]    = PAGE_SIZE;
+        if (transactionsOffset == 0 && !transactionsEtag.isEmpty())
+            obj["if_none_match"] = transactionsEtag;
     } else {
         connectionTimer->stop();
         socket->disconnectFromHost();
@@ -301,31 +301,21 @@ void WalletWindow::onDisconnected()
 
 void WalletWindow::onReadyRead()
 {
-    QByteArray allData = socket->readAll();
-    QList<QByteArray> messages = allData.split('\n');
-
-    for (auto msg : messages) {
-        msg = msg.trimmed();
-        if (msg.isEmpty())
-            continue;
-
-        QJsonParseError err;
-        QJsonDocument doc = QJsonDocument::fromJson(msg, &err);
-        if (err.error != QJsonParseError::NoError || !doc.isObject())
-            continue;
-
-        QJsonObject obj = doc.object();
-        QString type = obj.value("type").toString();
-
-        if (type == "get_wallet_response") {
-            handleGetWalletResponse(obj);
-        } else if (type == "wallet_deposit_response") {
-            handleDepositResponse(obj);
-        } else if (type == "wallet_withdraw_response") {
-            handleWithdrawResponse(obj);
-        } else if (type == "get_transactions_response") {
-            handleTransactionsResponse(obj);
-        }
+    reader->feed(socket->readAll());
+}
+
+void WalletWindow::onMessage(const QJsonObject &obj)
+{
+    QString type = obj.value("type").toString();
+
+    if (type == "get_wallet_response") {
+        handleGetWalletResponse(obj);
+    } else if (type == "wallet_deposit_response") {
+        handleDepositResponse(obj);
+    } else if (type == "wallet_withdraw_response") {
+        handleWithdrawResponse(obj);
+    } else if (type == "get_transactions_response") {
+        handleTransactionsResponse(obj);
     }
 
     pendingAction = PendingAction::None;
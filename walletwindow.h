@@ -4,7 +4,8 @@
 #include <QMainWindow>
 #include <QTcpSocket>
 #include <QTimer>
-#include <QStandardItemModel>
+#include "jsonlinereader.h"
+#include "compacttablemodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class WalletWindow; }
@@ -34,6 +35,7 @@ private slots:
     void onDisconnected();
     void onReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onMessage(const QJsonObject &obj);
 
 private:
     Ui::WalletWindow *ui;
@@ -42,10 +44,13 @@ private:
 
     QTcpSocket *socket;
     QTimer     *connectionTimer;
+    JsonLineReader *reader;
     QString     serverIp;
     quint16     serverPort;
 
-    QStandardItemModel *transactionsModel;
+    CompactTableModel *transactionsModel;
+    int transactionsOffset;
+    QString transactionsEtag;   // of the first page
     double currentBalance;
 
     enum class PendingAction {
@@ -63,7 +68,7 @@ private:
     void setupTransactionsModel();
     void connectToServer();
     void requestWallet();
-    void requestTransactions();
+    void requestTransactions(int offset = 0);
     void sendDeposit(double amount);
     void sendWithdraw(double amount);
     void updateBalanceDisplay();